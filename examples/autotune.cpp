@@ -0,0 +1,116 @@
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <functional>
+#include <vexcl/devlist.hpp>
+#include <vexcl/vector.hpp>
+#include <vexcl/reductor.hpp>
+#include <vexcl/spmat.hpp>
+#include <vexcl/profiler.hpp>
+
+// Compares heuristic launch configuration with the one selected by the
+// autotuner. Tuning results are stored in the kernel cache directory, so set
+// VEXCL_CACHE_DIR to an empty directory to see the tuning from scratch.
+
+//---------------------------------------------------------------------------
+double run(const vex::Context &ctx, std::function<void()> f, size_t m) {
+    ctx.finish();
+    vex::stopwatch<> w;
+
+    for(size_t i = 0; i < m; ++i) f();
+
+    ctx.finish();
+    return w.toc() / m;
+}
+
+//---------------------------------------------------------------------------
+void compare(const vex::Context &ctx, const std::string &name,
+        std::function<void()> f)
+{
+    const size_t M = 100;
+
+    // Only the kernels built with autotuning enabled are tuned.
+    vex::autotune(true);
+    f();
+
+    // Heuristic configuration:
+    vex::autotune(false);
+    double t0 = run(ctx, f, M);
+
+    // Enough launches to time all candidate configurations:
+    vex::autotune(true);
+    for(int i = 0; i < 64; ++i) f();
+    double t1 = run(ctx, f, M);
+
+    std::cout
+        << std::setw(12) << name
+        << std::setw(12) << std::scientific << std::setprecision(3) << t0
+        << std::setw(12) << t1
+        << std::setw(10) << std::fixed << std::setprecision(2) << t0 / t1
+        << std::endl;
+}
+
+//---------------------------------------------------------------------------
+int main() {
+    vex::Context ctx(
+            vex::Filter::Env &&
+            vex::Filter::Type(CL_DEVICE_TYPE_CPU) &&
+            vex::Filter::Count(1)
+            );
+
+    if (!ctx) {
+        std::cerr << "No CPU devices found" << std::endl;
+        return 1;
+    }
+
+    std::cout << ctx << std::endl;
+
+    const size_t n = 1024;
+    const size_t N = n * n;
+
+    vex::vector<double> x(ctx, N);
+    vex::vector<double> y(ctx, N);
+    vex::vector<double> z(ctx, N);
+
+    x = 1;
+    y = 2;
+
+    // 2D Poisson matrix.
+    std::vector<size_t> row;
+    std::vector<size_t> col;
+    std::vector<double> val;
+
+    row.reserve(N + 1);
+    col.reserve(5 * N);
+    val.reserve(5 * N);
+
+    row.push_back(0);
+    for(size_t j = 0, idx = 0; j < n; ++j) {
+        for(size_t i = 0; i < n; ++i, ++idx) {
+            if (j > 0)     { col.push_back(idx - n); val.push_back(-1); }
+            if (i > 0)     { col.push_back(idx - 1); val.push_back(-1); }
+
+            col.push_back(idx); val.push_back(4);
+
+            if (i + 1 < n) { col.push_back(idx + 1); val.push_back(-1); }
+            if (j + 1 < n) { col.push_back(idx + n); val.push_back(-1); }
+
+            row.push_back(col.size());
+        }
+    }
+
+    vex::SpMat<double, size_t> A(ctx, N, N, row.data(), col.data(), val.data());
+
+    vex::Reductor<double, vex::SUM> sum(ctx);
+
+    std::cout
+        << std::setw(12) << "kernel"
+        << std::setw(12) << "heuristic"
+        << std::setw(12) << "tuned"
+        << std::setw(10) << "speedup"
+        << std::endl;
+
+    compare(ctx, "assign",    [&]() { z = 2 * x + sin(y); });
+    compare(ctx, "reduction", [&]() { sum(x * y); });
+    compare(ctx, "spmv",      [&]() { z = A * x; });
+}
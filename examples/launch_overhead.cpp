@@ -0,0 +1,64 @@
+#include <iostream>
+#include <iomanip>
+#include <functional>
+#include <vexcl/devlist.hpp>
+#include <vexcl/vector.hpp>
+#include <vexcl/reductor.hpp>
+#include <vexcl/profiler.hpp>
+
+// Measures host overhead of a kernel launch for typical expressions on tiny
+// vectors, where the device work is negligible.
+
+//---------------------------------------------------------------------------
+void measure(const vex::Context &ctx, const std::string &name,
+        std::function<void()> f)
+{
+    const size_t M = 10000;
+
+    // Build the kernel:
+    f();
+    ctx.finish();
+
+    vex::stopwatch<> w;
+    for(size_t i = 0; i < M; ++i) f();
+    ctx.finish();
+
+    std::cout
+        << std::setw(20) << name
+        << std::setw(12) << std::fixed << std::setprecision(2)
+        << w.toc() / M * 1e6 << " us"
+        << std::endl;
+}
+
+//---------------------------------------------------------------------------
+int main() {
+    vex::Context ctx(vex::Filter::Env && vex::Filter::Count(1));
+
+    if (!ctx) {
+        std::cerr << "No compute devices found" << std::endl;
+        return 1;
+    }
+
+    std::cout << ctx << std::endl;
+
+    const size_t n = 16;
+
+    vex::vector<double> x(ctx, n);
+    vex::vector<double> y(ctx, n);
+    vex::vector<double> z(ctx, n);
+
+    x = 1;
+    y = 2;
+
+    double a = 0.5;
+
+    vex::Reductor<double, vex::SUM> sum(ctx);
+
+    std::cout << "Average time per launch:" << std::endl;
+
+    measure(ctx, "z = 0",         [&]() { z = 0; });
+    measure(ctx, "z = x + y",     [&]() { z = x + y; });
+    measure(ctx, "z = a * x + y", [&]() { z = a * x + y; });
+    measure(ctx, "z += a * x",    [&]() { z += a * x; a = -a; });
+    measure(ctx, "sum(x * y)",    [&]() { sum(x * y); });
+}
@@ -0,0 +1,76 @@
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <vexcl/devlist.hpp>
+#include <vexcl/vector.hpp>
+#include <vexcl/profiler.hpp>
+
+// Compares memory bandwidth of CPU devices used as a whole and split into
+// NUMA nodes (see vex::numa_fission()). Makes a difference on multi-socket
+// systems only.
+
+//---------------------------------------------------------------------------
+void triad(const vex::Context &ctx, const std::string &name) {
+    const size_t m = 50;
+
+    std::cout << name << ": " << ctx.size() << " device(s)" << std::endl;
+
+    for(size_t n = 1 << 20; n <= (1 << 26); n <<= 2) {
+        vex::vector<double> a(ctx, n);
+        vex::vector<double> b(ctx, n);
+        vex::vector<double> c(ctx, n);
+
+        // Memory pages are first touched by the cores of the device (or
+        // the NUMA node) that owns the partition.
+        a = 0;
+        b = 1;
+        c = 2;
+
+        // Build the kernel:
+        a = b + 3 * c;
+        ctx.finish();
+
+        vex::stopwatch<> w;
+        for(size_t i = 0; i < m; ++i) a = b + 3 * c;
+        ctx.finish();
+
+        double time = w.toc() / m;
+
+        std::cout
+            << std::setw(12) << n
+            << std::setw(12) << std::fixed << std::setprecision(2)
+            << 3.0 * n * sizeof(double) / time / 1e9 << " GB/s"
+            << std::endl;
+    }
+
+    std::cout << std::endl;
+}
+
+//---------------------------------------------------------------------------
+int main() {
+    {
+        vex::numa_fission(false);
+        vex::Context ctx(vex::Filter::Env && vex::Filter::Type(CL_DEVICE_TYPE_CPU));
+
+        if (!ctx) {
+            std::cerr << "No CPU devices found" << std::endl;
+            return 1;
+        }
+
+        std::cout << ctx << std::endl;
+        triad(ctx, "Whole devices");
+
+        // Release the kernels and pooled buffers of the context.
+        vex::purge_kernel_caches(ctx);
+    }
+
+    {
+        vex::numa_fission(true);
+        vex::Context ctx(vex::Filter::Env && vex::Filter::Type(CL_DEVICE_TYPE_CPU));
+
+        std::cout << ctx << std::endl;
+        triad(ctx, "NUMA nodes");
+
+        vex::purge_kernel_caches(ctx);
+    }
+}
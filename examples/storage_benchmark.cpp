@@ -0,0 +1,112 @@
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <cmath>
+#include <vexcl/devlist.hpp>
+#include <vexcl/vector.hpp>
+#include <vexcl/storage_vector.hpp>
+#include <vexcl/element_index.hpp>
+#include <vexcl/profiler.hpp>
+
+// Compares throughput and accuracy of vectors stored with single and half
+// precision. All computations are done in single precision.
+
+//---------------------------------------------------------------------------
+template <class X, class Y>
+double axpy(const vex::Context &ctx, X &x, Y &y, size_t m) {
+    const float a = 1e-3f;
+
+    // Build the kernel:
+    y = a * x + y;
+    ctx.finish();
+
+    vex::stopwatch<> w;
+    for(size_t i = 0; i < m; ++i) y = a * x + y;
+    ctx.finish();
+
+    return w.toc() / m;
+}
+
+//---------------------------------------------------------------------------
+template <class V>
+std::vector<float> to_host(const V &v) {
+    std::vector<float> h(v.size());
+    vex::copy(v, h);
+    return h;
+}
+
+//---------------------------------------------------------------------------
+void report(const std::string &name, double time, size_t n, size_t bytes,
+        const std::vector<float> &y, const std::vector<double> &ref)
+{
+    double err = 0, nrm = 0;
+    for(size_t i = 0; i < n; ++i) {
+        err = std::max(err, std::fabs(y[i] - ref[i]));
+        nrm = std::max(nrm, std::fabs(ref[i]));
+    }
+
+    std::cout
+        << std::setw(12) << name
+        << std::setw(12) << std::fixed << std::setprecision(2)
+        << 3.0 * n * bytes / time / 1e9
+        << std::setw(12) << n / time / 1e9
+        << std::setw(14) << std::scientific << std::setprecision(3)
+        << err / nrm
+        << std::endl;
+}
+
+//---------------------------------------------------------------------------
+int main() {
+    vex::Context ctx(vex::Filter::Env && vex::Filter::Count(1));
+
+    if (!ctx) {
+        std::cerr << "No compute devices found" << std::endl;
+        return 1;
+    }
+
+    std::cout << ctx << std::endl;
+
+    const size_t n = 1 << 24;
+    const size_t m = 100;
+
+    vex::vector<float> x(ctx, n);
+    vex::vector<float> y(ctx, n);
+
+    vex::storage_vector<float, vex::half_float> hx(ctx, n);
+    vex::storage_vector<float, vex::half_float> hy(ctx, n);
+
+    x  = sin(vex::element_index() * 1e-3f);
+    y  = 0;
+    hx = x;
+    hy = y;
+
+    double tf = axpy(ctx, x,  y,  m);
+    double th = axpy(ctx, hx, hy, m);
+
+    // Reference solution in double precision (m + 1 updates) for the same
+    // single precision input:
+    std::vector<double> ref(n);
+    {
+        std::vector<float> xf = to_host(x);
+        std::vector<float> xh = to_host(hx);
+
+        double err = 0;
+        for(size_t i = 0; i < n; ++i) {
+            ref[i] = (m + 1) * 1e-3 * static_cast<double>(xf[i]);
+            err = std::max(err, std::fabs(static_cast<double>(xh[i]) - xf[i]));
+        }
+
+        std::cout << "Max storage error of x: " << std::scientific << err
+                  << std::endl << std::endl;
+    }
+
+    std::cout
+        << std::setw(12) << "storage"
+        << std::setw(12) << "GB/s"
+        << std::setw(12) << "Gelem/s"
+        << std::setw(14) << "rel. error"
+        << std::endl;
+
+    report("float", tf, n, sizeof(float),     to_host(y),  ref);
+    report("half",  th, n, sizeof(cl_ushort), to_host(hy), ref);
+}
@@ -0,0 +1,96 @@
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <sstream>
+#include <vexcl/devlist.hpp>
+#include <vexcl/vector.hpp>
+#include <vexcl/reductor.hpp>
+#include <vexcl/streaming.hpp>
+#include <vexcl/profiler.hpp>
+
+// Compares throughput of out-of-core evaluation with vex::stream_executor to
+// in-core evaluation (including transfers of the data to and from the
+// device) for arrays that still fit into device memory.
+
+//---------------------------------------------------------------------------
+void report(const std::string &name, double time, size_t n) {
+    // Two arrays are read and one is written.
+    std::cout
+        << std::setw(24) << name
+        << std::setw(10) << std::fixed << std::setprecision(3) << time
+        << std::setw(10) << std::setprecision(2) << 3.0 * n * sizeof(float) / time / 1e9
+        << std::endl;
+}
+
+//---------------------------------------------------------------------------
+int main() {
+    vex::Context ctx(vex::Filter::Env && vex::Filter::Count(1));
+
+    if (!ctx) {
+        std::cerr << "No devices found" << std::endl;
+        return 1;
+    }
+
+    std::cout << ctx << std::endl;
+
+    const size_t n = 1 << 26;
+
+    std::vector<float> x(n, 1.0f), y(n, 2.0f), z(n);
+
+    std::cout
+        << std::setw(24) << "mode"
+        << std::setw(10) << "time"
+        << std::setw(10) << "GB/s"
+        << std::endl;
+
+    vex::Reductor<float, vex::SUM> sum(ctx);
+
+    // Build the kernels (they are shared by all runs below).
+    {
+        vex::vector<float> X(ctx, 1024), Y(ctx, 1024), Z(ctx, 1024);
+        X = 1;
+        Y = 2;
+        Z = sin(X) * cos(Y) + X * Y;
+        sum(Z);
+    }
+
+    // In-core evaluation.
+    {
+        vex::stopwatch<> w;
+
+        vex::vector<float> X(ctx, x);
+        vex::vector<float> Y(ctx, y);
+        vex::vector<float> Z(ctx, n);
+
+        Z = sin(X) * cos(Y) + X * Y;
+        float s = sum(Z);
+        vex::copy(Z, z);
+
+        report("in-core", w.toc(), n);
+        (void)s;
+    }
+
+    // Out-of-core evaluation with several chunk sizes.
+    for(size_t chunk = 1 << 20; chunk <= (1 << 24); chunk *= 4) {
+        for(unsigned depth = 2; depth <= 3; ++depth) {
+            vex::stream_executor ex(ctx.queue(0), n, chunk, depth);
+
+            const vex::vector<float> &X = ex.input(x.data());
+            const vex::vector<float> &Y = ex.input(y.data());
+            vex::vector<float>       &Z = ex.output(z.data());
+
+            vex::stopwatch<> w;
+
+            // Single device context, so the reductor uses the same queue.
+            float s = 0;
+            ex.run([&]() {
+                    Z = sin(X) * cos(Y) + X * Y;
+                    s += sum(Z);
+                    });
+
+            std::ostringstream name;
+            name << "chunk " << (chunk >> 20) << "M, depth " << depth;
+            report(name.str(), w.toc(), n);
+        }
+    }
+}
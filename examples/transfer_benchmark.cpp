@@ -0,0 +1,70 @@
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <functional>
+#include <vexcl/devlist.hpp>
+#include <vexcl/vector.hpp>
+#include <vexcl/profiler.hpp>
+
+// Compares host-device bandwidth of direct transfers from pageable memory
+// with transfers staged through pinned buffers (see vex::pinned_transfers()).
+
+//---------------------------------------------------------------------------
+double bandwidth(const vex::Context &ctx, size_t bytes, std::function<void()> f) {
+    const size_t m = 10;
+
+    // Warm up (allocates staging buffers).
+    f();
+    ctx.finish();
+
+    vex::stopwatch<> w;
+    for(size_t i = 0; i < m; ++i) f();
+    ctx.finish();
+
+    return m * bytes / w.toc() / 1e9;
+}
+
+//---------------------------------------------------------------------------
+int main() {
+    vex::Context ctx(vex::Filter::Env && vex::Filter::Count(1));
+
+    if (!ctx) {
+        std::cerr << "No devices found" << std::endl;
+        return 1;
+    }
+
+    std::cout << ctx << std::endl;
+
+    std::cout
+        << std::setw(10) << "MB"
+        << std::setw(14) << "H2D pageable"
+        << std::setw(12) << "H2D pinned"
+        << std::setw(14) << "D2H pageable"
+        << std::setw(12) << "D2H pinned"
+        << "  (GB/s)"
+        << std::endl;
+
+    for(size_t n = 1 << 20; n <= (1 << 26); n *= 4) {
+        std::vector<float> h(n, 1.0f);
+        vex::vector<float>  d(ctx, n);
+
+        size_t bytes = n * sizeof(float);
+
+        double bw[4];
+        for(int pinned = 0; pinned < 2; ++pinned) {
+            vex::pinned_transfers(pinned != 0);
+
+            bw[pinned]     = bandwidth(ctx, bytes, [&]() { vex::copy(h, d); });
+            bw[pinned + 2] = bandwidth(ctx, bytes, [&]() { vex::copy(d, h); });
+        }
+
+        std::cout
+            << std::setw(10) << bytes / (1 << 20)
+            << std::fixed << std::setprecision(2)
+            << std::setw(14) << bw[0]
+            << std::setw(12) << bw[1]
+            << std::setw(14) << bw[2]
+            << std::setw(12) << bw[3]
+            << std::endl;
+    }
+}
@@ -0,0 +1,211 @@
+#define BOOST_TEST_MODULE BinaryCache
+#include <cstdlib>
+#include <fstream>
+#include <boost/test/unit_test.hpp>
+#include <boost/filesystem.hpp>
+#include <vexcl/backend.hpp>
+#include <vexcl/backend/binary_cache.hpp>
+#include <vexcl/backend/kernel_pack.hpp>
+#include <vexcl/backend/autotune.hpp>
+
+struct CacheSetup {
+    CacheSetup() {
+        dir = boost::filesystem::temp_directory_path() / boost::filesystem::unique_path();
+
+        // Cache location and budget are read once, so these have to be set
+        // before the cache is used.
+#ifdef _WIN32
+        _putenv_s("VEXCL_CACHE_DIR",  dir.string().c_str());
+        _putenv_s("VEXCL_CACHE_SIZE", "2K");
+#else
+        setenv("VEXCL_CACHE_DIR",  dir.string().c_str(), 1);
+        setenv("VEXCL_CACHE_SIZE", "2K", 1);
+#endif
+    }
+
+    ~CacheSetup() {
+        boost::filesystem::remove_all(dir);
+    }
+
+    boost::filesystem::path dir;
+};
+
+BOOST_GLOBAL_FIXTURE( CacheSetup )
+
+BOOST_AUTO_TEST_CASE(store_and_load)
+{
+    vex::reset_binary_cache_stats();
+
+    std::string hash = vex::sha1("store_and_load");
+    std::vector<char> bin(100, 'x'), buf;
+
+    BOOST_CHECK(!vex::binary_cache<>::load(hash, buf));
+
+    vex::binary_cache<>::store(hash, bin.data(), bin.size(), "source");
+
+    BOOST_CHECK(vex::binary_cache<>::load(hash, buf));
+    BOOST_CHECK(buf == bin);
+
+    vex::binary_cache_statistics s = vex::binary_cache_stats();
+    BOOST_CHECK_EQUAL(s.hits,   1);
+    BOOST_CHECK_EQUAL(s.misses, 1);
+    BOOST_CHECK_EQUAL(s.stores, 1);
+}
+
+BOOST_AUTO_TEST_CASE(store_again)
+{
+    vex::reset_binary_cache_stats();
+
+    std::string hash = vex::sha1("store_again");
+    std::vector<char> bin(100, 'x'), buf;
+
+    // Entries stored again are not counted twice, so the cache stays
+    // within the budget.
+    for(int i = 0; i < 32; ++i)
+        vex::binary_cache<>::store(hash, bin.data(), bin.size(), "source");
+
+    BOOST_CHECK_EQUAL(vex::binary_cache_stats().evictions, 0);
+    BOOST_CHECK(vex::binary_cache<>::load(vex::sha1("store_and_load"), buf));
+}
+
+BOOST_AUTO_TEST_CASE(corrupt_entry)
+{
+    vex::reset_binary_cache_stats();
+
+    std::string hash = vex::sha1("corrupt_entry");
+    std::vector<char> bin(100, 'x'), buf;
+
+    vex::binary_cache<>::store(hash, bin.data(), bin.size(), "source");
+
+    {
+        std::fstream f(vex::program_binaries_path(hash) + "kernel",
+                std::ios::in | std::ios::out | std::ios::binary);
+        // Binary is followed by "\nsource\n":
+        f.seekp(-60, std::ios::end);
+        f.put('y');
+    }
+
+    BOOST_CHECK(!vex::binary_cache<>::load(hash, buf));
+    BOOST_CHECK_EQUAL(vex::binary_cache_stats().invalid, 1);
+
+    // Corrupt entry is removed.
+    BOOST_CHECK(!boost::filesystem::exists(vex::program_binaries_path(hash) + "kernel"));
+}
+
+BOOST_AUTO_TEST_CASE(eviction)
+{
+    vex::reset_binary_cache_stats();
+
+    std::vector<char> bin(500, 'x'), buf;
+
+    for(int i = 0; i < 8; ++i) {
+        std::string hash = vex::sha1("eviction" + std::to_string(i));
+        vex::binary_cache<>::store(hash, bin.data(), bin.size(), "source");
+    }
+
+    BOOST_CHECK(vex::binary_cache_stats().evictions > 0);
+
+    // The most recently stored entry is kept.
+    BOOST_CHECK(vex::binary_cache<>::load(vex::sha1("eviction7"), buf));
+}
+
+BOOST_AUTO_TEST_CASE(kernel_pack)
+{
+    std::string fname = (boost::filesystem::temp_directory_path()
+            / boost::filesystem::unique_path()).string();
+
+    std::string bin1(100, 'x'), bin2 = "binary\nwith\nnewlines";
+
+    // Nothing is recorded until recording is started.
+    BOOST_CHECK(!vex::kernel_pack_recorder<>::wants("hash1"));
+
+    vex::record_kernel_pack(fname);
+
+    BOOST_CHECK(vex::kernel_pack_recorder<>::wants("hash1"));
+    vex::kernel_pack_recorder<>::add("hash1", "device A", bin1.data(), bin1.size());
+    vex::kernel_pack_recorder<>::add("hash2", "device B", bin2.data(), bin2.size());
+    BOOST_CHECK(!vex::kernel_pack_recorder<>::wants("hash1"));
+
+    vex::save_kernel_pack();
+
+    {
+        vex::kernel_pack_reader pack(fname);
+
+        BOOST_REQUIRE_EQUAL(pack.entry().size(), 2);
+
+        const vex::kernel_pack_entry &e1 = pack.entry()[0];
+        const vex::kernel_pack_entry &e2 = pack.entry()[1];
+
+        BOOST_CHECK_EQUAL(e1.hash,   "hash1");
+        BOOST_CHECK_EQUAL(e1.device, "device A");
+        BOOST_CHECK_EQUAL(std::string(e1.data, e1.size), bin1);
+
+        BOOST_CHECK_EQUAL(e2.hash,   "hash2");
+        BOOST_CHECK_EQUAL(e2.device, "device B");
+        BOOST_CHECK_EQUAL(std::string(e2.data, e2.size), bin2);
+    }
+
+    boost::filesystem::remove(fname);
+}
+
+BOOST_AUTO_TEST_CASE(autotuner)
+{
+    std::vector<vex::launch_config> cand;
+    for(size_t i = 0; i < 3; ++i) {
+        vex::launch_config c = {i + 1, 1};
+        cand.push_back(c);
+    }
+
+    auto candidates = [&]() { return cand; };
+
+    vex::launch_config c;
+
+    // Each candidate is timed twice; the second one is the fastest.
+    for(size_t i = 0; i < 2 * cand.size(); ++i) {
+        int idx = vex::autotuner<>::select("kernel", 1000, candidates, c);
+
+        BOOST_REQUIRE(idx >= 0);
+        BOOST_CHECK(c == cand[idx]);
+
+        vex::autotuner<>::report("kernel", 1000, idx, idx == 1 ? 1.0 : 2.0);
+    }
+
+    // Problem sizes in the same bucket share the tuned configuration.
+    BOOST_CHECK_EQUAL(vex::autotuner<>::select("kernel", 1023, candidates, c), -1);
+    BOOST_CHECK(c == cand[1]);
+
+    // Other buckets are tuned separately.
+    BOOST_CHECK(vex::autotuner<>::select("kernel", 4096, candidates, c) >= 0);
+
+    // The result is persisted.
+    std::ifstream f(vex::cache_path() + vex::path_delim() + "autotune");
+
+    std::string key;
+    size_t bucket, groups, wgsize;
+
+    BOOST_REQUIRE(f >> key >> bucket >> groups >> wgsize);
+    BOOST_CHECK_EQUAL(key, "kernel");
+    BOOST_CHECK_EQUAL(bucket, 9);
+    BOOST_CHECK_EQUAL(groups, 2);
+    BOOST_CHECK_EQUAL(wgsize, 1);
+}
+
+BOOST_AUTO_TEST_CASE(lazy_tuning_key)
+{
+    BOOST_CHECK(vex::tuning_key().empty());
+
+    vex::tuning_key k("kernel void k() {}", "k");
+    vex::tuning_key c = k;
+
+    int calls = 0;
+    auto signature = [&]() { ++calls; return std::string("device"); };
+
+    BOOST_CHECK(!k.empty());
+    BOOST_CHECK_EQUAL(calls, 0);
+
+    // The hash is computed once and is shared between the copies.
+    std::string h = k.get(signature);
+    BOOST_CHECK_EQUAL(c.get(signature), h);
+    BOOST_CHECK_EQUAL(calls, 1);
+    BOOST_CHECK_EQUAL(h, vex::sha1("device\nk\nkernel void k() {}"));
+}
@@ -0,0 +1,81 @@
+#define BOOST_TEST_MODULE CompiledExpressions
+#include <boost/test/unit_test.hpp>
+#include <vexcl/vector.hpp>
+#include <vexcl/compiled.hpp>
+#include <vexcl/element_index.hpp>
+#include <vexcl/reductor.hpp>
+#include "context_setup.hpp"
+
+BOOST_AUTO_TEST_CASE(compiled_assignment)
+{
+    const size_t n = 1024;
+
+    std::vector<double> x = random_vector<double>(n);
+
+    vex::vector<double> X(ctx, x);
+    vex::vector<double> Y(ctx, n);
+
+    vex::parameter<double> alpha(1);
+    const double beta = 2;
+
+    vex::compiled_expression f = vex::compile(Y, alpha * X + beta * vex::element_index());
+
+    for(int i = 1; i <= 3; ++i) {
+        alpha = i;
+        f();
+
+        check_sample(Y, [&](size_t idx, double a) {
+                BOOST_CHECK_CLOSE(a, i * x[idx] + beta * idx, 1e-8);
+                });
+    }
+}
+
+BOOST_AUTO_TEST_CASE(compiled_compound_assignment)
+{
+    const size_t n = 1024;
+
+    std::vector<double> x = random_vector<double>(n);
+
+    vex::vector<double> X(ctx, x);
+    vex::vector<double> Y(ctx, n);
+    vex::vector<double> Z(ctx, n);
+
+    Y = 0;
+
+    vex::parameter<double> alpha(0.5);
+    auto f = vex::compile<vex::assign::ADD>(Y, alpha * X);
+
+    f();
+    f();
+
+    check_sample(Y, [&](size_t idx, double a) {
+            BOOST_CHECK_CLOSE(a, x[idx], 1e-8);
+            });
+
+    // Vectors are captured by reference, so swapped contents are seen by
+    // the next launch.
+    Z = 1;
+    Y.swap(Z);
+    f();
+
+    check_sample(Y, Z, [&](size_t idx, double a, double b) {
+            BOOST_CHECK_CLOSE(a, 1 + 0.5 * x[idx], 1e-8);
+            BOOST_CHECK_CLOSE(b, x[idx], 1e-8);
+            });
+}
+
+BOOST_AUTO_TEST_CASE(parameter_in_expressions)
+{
+    const size_t n = 1024;
+
+    std::vector<double> x = random_vector<double>(n);
+
+    vex::vector<double> X(ctx, x);
+    vex::Reductor<double, vex::SUM> sum(ctx);
+
+    vex::parameter<double> alpha(3);
+
+    BOOST_CHECK_CLOSE(sum(alpha * X), 3 * std::accumulate(x.begin(), x.end(), 0.0), 1e-6);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
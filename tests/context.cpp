@@ -1,4 +1,6 @@
 #define BOOST_TEST_MODULE VexContext
+#include <atomic>
+#include <stdexcept>
 #include <boost/test/unit_test.hpp>
 #include <vexcl/devlist.hpp>
 #include <vexcl/vector.hpp>
@@ -29,3 +31,67 @@ BOOST_AUTO_TEST_CASE(create_destroy)
     local_context();
     local_context();
 }
+
+BOOST_AUTO_TEST_CASE(precompile)
+{
+    static std::atomic<int> ntasks(0);
+
+    vex::precompile([](const std::vector<vex::backend::command_queue> &q) {
+            vex::vector<int> x(q, 1), y(q, 1);
+            x = 1;
+            y = 2 * x + 1;
+            ++ntasks;
+            });
+
+    vex::Context ctx( vex::Filter::Env );
+    BOOST_CHECK( !ctx.empty() );
+
+    ctx.wait_precompiled();
+    BOOST_CHECK_EQUAL(ntasks, 1);
+
+    const size_t n = 1024;
+
+    vex::vector<int> x(ctx, n), y(ctx, n);
+    x = 2;
+    y = 2 * x + 1;
+
+    BOOST_CHECK_EQUAL(y[0], 5);
+}
+
+BOOST_AUTO_TEST_CASE(precompile_error)
+{
+    static std::atomic<bool> fail(true);
+
+    vex::precompile([](const std::vector<vex::backend::command_queue>&) {
+            if (fail) throw std::runtime_error("precompile failed");
+            });
+
+    vex::Context ctx( vex::Filter::Env );
+
+    // The error is reported once.
+    BOOST_CHECK_THROW(ctx.wait_precompiled(), std::runtime_error);
+    BOOST_CHECK_NO_THROW(ctx.wait_precompiled());
+
+    // Contexts created by the following tests should not fail.
+    fail = false;
+}
+
+#ifdef VEXCL_BACKEND_OPENCL
+BOOST_AUTO_TEST_CASE(numa_fission)
+{
+    vex::numa_fission(true);
+    vex::Context ctx( vex::Filter::Env );
+    vex::numa_fission(false);
+
+    BOOST_CHECK( !ctx.empty() );
+
+    const size_t n = 1 << 16;
+
+    vex::vector<int> x(ctx, n), y(ctx, n);
+    x = 2;
+    y = 2 * x + 1;
+
+    BOOST_CHECK_EQUAL(y[0],     5);
+    BOOST_CHECK_EQUAL(y[n - 1], 5);
+}
+#endif
@@ -0,0 +1,69 @@
+#define BOOST_TEST_MODULE FileIO
+#include <boost/test/unit_test.hpp>
+#include <boost/filesystem.hpp>
+#include <vexcl/vector.hpp>
+#include <vexcl/file_io.hpp>
+#include "context_setup.hpp"
+
+std::string temp_file() {
+    namespace fs = boost::filesystem;
+    return (fs::temp_directory_path() / fs::unique_path()).string();
+}
+
+BOOST_AUTO_TEST_CASE(save_load_with_header)
+{
+    const size_t n = 1 << 20;
+
+    std::vector<double> x = random_vector<double>(n);
+    vex::vector<double> X(ctx, x);
+
+    std::string fname = temp_file();
+    vex::save(fname, X);
+
+    vex::vector<double> Y = vex::load<double>(ctx, fname);
+    BOOST_CHECK_EQUAL(Y.size(), n);
+
+    check_sample(Y, [&](size_t idx, double a) { BOOST_CHECK_EQUAL(a, x[idx]); });
+
+    // Value type is stored in the header.
+    vex::vector<float> Z(ctx, 2 * n);
+    BOOST_CHECK_THROW(vex::load(fname, Z), std::exception);
+
+    boost::filesystem::remove(fname);
+}
+
+BOOST_AUTO_TEST_CASE(save_load_raw)
+{
+    const size_t n = 12345;
+
+    std::vector<int> x(n);
+    for(size_t i = 0; i < n; ++i) x[i] = static_cast<int>(i);
+
+    std::string fname = temp_file();
+    {
+        std::ofstream f(fname, std::ios::binary);
+        f.write(reinterpret_cast<const char*>(x.data()), n * sizeof(int));
+    }
+
+    vex::vector<int> X(ctx, n);
+    vex::load(fname, X);
+
+    check_sample(X, [](size_t idx, int a) { BOOST_CHECK_EQUAL(a, idx); });
+
+    X = 2 * X;
+    vex::save(fname, X, false);
+
+    BOOST_CHECK_EQUAL(boost::filesystem::file_size(fname), n * sizeof(int));
+
+    std::vector<int> y(n);
+    {
+        std::ifstream f(fname, std::ios::binary);
+        f.read(reinterpret_cast<char*>(y.data()), n * sizeof(int));
+    }
+
+    check_sample(y, [&](size_t idx, int a) { BOOST_CHECK_EQUAL(a, 2 * x[idx]); });
+
+    boost::filesystem::remove(fname);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
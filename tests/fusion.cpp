@@ -0,0 +1,138 @@
+#define BOOST_TEST_MODULE FusedAssignments
+#include <boost/test/unit_test.hpp>
+#include <vexcl/vector.hpp>
+#include <vexcl/fusion.hpp>
+#include <vexcl/element_index.hpp>
+#include <vexcl/tagged_terminal.hpp>
+#include <vexcl/reductor.hpp>
+#include "context_setup.hpp"
+
+BOOST_AUTO_TEST_CASE(fused_statements)
+{
+    const size_t n = 1024;
+
+    std::vector<double> x = random_vector<double>(n);
+    std::vector<double> y = random_vector<double>(n);
+
+    vex::vector<double> X(ctx, x);
+    vex::vector<double> Y(ctx, y);
+    vex::vector<double> Z(ctx, n);
+    vex::vector<double> W(ctx, n);
+
+    {
+        vex::fusion_scope fuse;
+
+        Z  = X + Y;
+        W  = 2 * Z - vex::element_index();
+        Z += W;
+        X  = 1;
+    }
+
+    check_sample(X, Z, W, [&](size_t idx, double a, double b, double c) {
+            double z = x[idx] + y[idx];
+            double w = 2 * z - idx;
+
+            BOOST_CHECK_EQUAL(a, 1);
+            BOOST_CHECK_CLOSE(b, z + w, 1e-8);
+            BOOST_CHECK_CLOSE(c, w, 1e-8);
+            });
+}
+
+BOOST_AUTO_TEST_CASE(fusion_barriers)
+{
+    const size_t n = 1024;
+
+    std::vector<double> x = random_vector<double>(n);
+
+    vex::vector<double> X(ctx, x);
+    vex::vector<double> Y(ctx, n);
+    vex::vector<double> Z(ctx, n);
+
+    vex::Reductor<double, vex::SUM> sum(ctx);
+
+    vex::fusion_scope fuse;
+
+    Y = 2 * X;
+
+    // Reduction reads Y, so the recorded assignment is launched first.
+    BOOST_CHECK_CLOSE(sum(Y), 2 * std::accumulate(x.begin(), x.end(), 0.0), 1e-6);
+
+    // Tagged terminals are not fused; Z is assigned after Y.
+    Y = Y + 1;
+    Z = vex::tag<1>(Y) * vex::tag<1>(Y);
+
+    check_sample(Y, Z, [&](size_t idx, double a, double b) {
+            BOOST_CHECK_CLOSE(a, 2 * x[idx] + 1, 1e-8);
+            BOOST_CHECK_CLOSE(b, a * a, 1e-8);
+            });
+}
+
+BOOST_AUTO_TEST_CASE(swap_fused_vectors)
+{
+    const size_t n = 1024;
+
+    std::vector<double> x = random_vector<double>(n);
+
+    vex::vector<double> X(ctx, x);
+    vex::vector<double> Y(ctx, n);
+    vex::vector<double> Z(ctx, n);
+
+    {
+        vex::fusion_scope fuse;
+
+        // Recorded statements keep the buffers they were given, so swaps
+        // and moves are not launch barriers.
+        Y = 2 * X;
+        swap(X, Y);
+        Y = X + 1;
+
+        vex::vector<double> W(std::move(Y));
+        Z = W * X;
+
+        fuse.flush();
+    }
+
+    check_sample(X, Z, [&](size_t idx, double a, double b) {
+            BOOST_CHECK_CLOSE(a, 2 * x[idx], 1e-8);
+            BOOST_CHECK_CLOSE(b, (2 * x[idx] + 1) * 2 * x[idx], 1e-8);
+            });
+}
+
+BOOST_AUTO_TEST_CASE(fused_solver_loop)
+{
+    const size_t n = 1024;
+
+    std::vector<double> x = random_vector<double>(n);
+    std::vector<double> p = random_vector<double>(n);
+    std::vector<double> r = random_vector<double>(n);
+
+    vex::vector<double> X(ctx, x);
+    vex::vector<double> P(ctx, p);
+    vex::vector<double> R(ctx, r);
+
+    const double alpha = 0.5, beta = 0.25;
+
+    for(int iter = 0; iter < 10; ++iter) {
+        {
+            vex::fusion_scope fuse;
+
+            P  = R + beta * P;
+            X += alpha * P;
+            R -= alpha * P;
+        }
+
+        for(size_t i = 0; i < n; ++i) {
+            p[i]  = r[i] + beta * p[i];
+            x[i] += alpha * p[i];
+            r[i] -= alpha * p[i];
+        }
+    }
+
+    check_sample(X, P, R, [&](size_t idx, double a, double b, double c) {
+            BOOST_CHECK_CLOSE(a, x[idx], 1e-8);
+            BOOST_CHECK_CLOSE(b, p[idx], 1e-8);
+            BOOST_CHECK_CLOSE(c, r[idx], 1e-8);
+            });
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,55 @@
+#define BOOST_TEST_MODULE HostView
+#include <boost/test/unit_test.hpp>
+#include <vexcl/vector.hpp>
+#include <vexcl/host_view.hpp>
+#include <vexcl/reductor.hpp>
+#include "context_setup.hpp"
+
+BOOST_AUTO_TEST_CASE(host_view)
+{
+    const size_t n = 1024;
+
+    std::vector<double> x = random_vector<double>(n);
+    std::vector<double> y(x);
+
+    vex::vector<double> X = vex::host_view(ctx, x);
+
+    vex::Reductor<double, vex::SUM> sum(ctx);
+    BOOST_CHECK_CLOSE(sum(X), std::accumulate(y.begin(), y.end(), 0.0), 1e-6);
+
+    X = 2 * X;
+
+    {
+        vex::mapped_view<double> m(X);
+
+        for(size_t i = 0; i < n; ++i)
+            BOOST_CHECK_EQUAL(x[i], 2 * y[i]);
+
+        for(size_t i = 0; i < n; ++i)
+            m[i] = static_cast<double>(i);
+    }
+
+    check_sample(X, [](size_t idx, double a) { BOOST_CHECK_EQUAL(a, idx); });
+}
+
+BOOST_AUTO_TEST_CASE(mapped_view)
+{
+    const size_t n = 1024;
+
+    vex::vector<int> X(ctx, n);
+    X = 42;
+
+    {
+        vex::mapped_view<int> m(X);
+
+        BOOST_CHECK_EQUAL(m.size(), n);
+
+        for(unsigned d = 0; d < X.nparts(); ++d)
+            for(size_t i = 0; i < X.part_size(d); ++i)
+                m.part(d)[i] += static_cast<int>(X.part_start(d) + i);
+    }
+
+    check_sample(X, [](size_t idx, int a) { BOOST_CHECK_EQUAL(a, 42 + idx); });
+}
+
+BOOST_AUTO_TEST_SUITE_END()
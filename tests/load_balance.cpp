@@ -0,0 +1,151 @@
+#define BOOST_TEST_MODULE LoadBalance
+#include <cstdlib>
+#include <boost/test/unit_test.hpp>
+#include <boost/filesystem.hpp>
+#include <vexcl/vector.hpp>
+#include <vexcl/spmat.hpp>
+#include <vexcl/compiled.hpp>
+#include <vexcl/host_view.hpp>
+
+// Stored device weights should not go to the user's cache directory.
+struct CacheSetup {
+    CacheSetup() {
+        dir = boost::filesystem::temp_directory_path() / boost::filesystem::unique_path();
+
+        // Cache location is read once, so it has to be set before the
+        // context is created.
+#ifdef _WIN32
+        _putenv_s("VEXCL_CACHE_DIR", dir.string().c_str());
+#else
+        setenv("VEXCL_CACHE_DIR", dir.string().c_str(), 1);
+#endif
+    }
+
+    ~CacheSetup() {
+        boost::filesystem::remove_all(dir);
+    }
+
+    boost::filesystem::path dir;
+};
+
+BOOST_GLOBAL_FIXTURE( CacheSetup )
+
+#include "context_setup.hpp"
+
+BOOST_AUTO_TEST_CASE(adaptive_rebalance)
+{
+    const size_t n = 1 << 18;
+
+    vex::adaptive_partitioning(true, 0.5);
+
+    std::vector<double> x = random_vector<double>(n);
+
+    vex::vector<double> X(ctx, x);
+    vex::vector<double> Y(ctx, n);
+
+    auto update = vex::compile(Y, 2 * X + 1);
+
+    for(int i = 0; i < 64; ++i) update();
+
+    double imbalance = vex::load_imbalance(ctx);
+    BOOST_CHECK(imbalance >= 0);
+    BOOST_CHECK(imbalance < 1);
+
+    if (ctx.size() < 2) BOOST_CHECK_EQUAL(imbalance, 0);
+
+    // Zero threshold forces the update whenever the weights are measured.
+    if (vex::rebalance_partitioning(ctx, 0)) {
+        X.repartition();
+        Y.repartition();
+
+        BOOST_CHECK(vex::load_imbalance(ctx) < 1e-8);
+    }
+
+    BOOST_CHECK(vex::partition(n, ctx) == X.partition());
+
+    // The compiled expression follows the new partitioning.
+    Y = 0;
+    update();
+
+    check_sample(X, Y, [&](size_t idx, double a, double b) {
+            BOOST_CHECK_EQUAL(a, x[idx]);
+            BOOST_CHECK_CLOSE(b, 2 * x[idx] + 1, 1e-8);
+            });
+
+    Y = X - 1;
+
+    check_sample(Y, [&](size_t idx, double a) {
+            BOOST_CHECK_CLOSE(a, x[idx] - 1, 1e-8);
+            });
+
+    vex::adaptive_partitioning(false);
+}
+
+#ifndef VEXCL_BACKEND_CUDA
+BOOST_AUTO_TEST_CASE(repartition_host_view)
+{
+    const size_t n = 1 << 18;
+
+    std::vector<double> x = random_vector<double>(n);
+    std::vector<double> y = x;
+
+    vex::vector<double> Y = vex::host_view(ctx, y);
+
+    Y.repartition();
+    Y = 2 * Y;
+
+    // The vector still uses the host memory as its storage.
+    {
+        vex::mapped_view<double> m(Y);
+        for(size_t i = 0; i < n; i += n / 64)
+            BOOST_CHECK_EQUAL(y[i], 2 * x[i]);
+    }
+}
+#endif
+
+BOOST_AUTO_TEST_CASE(stored_device_weights)
+{
+    typedef vex::device_weight_cache<> cache;
+
+    if (!cache::enabled()) return;
+
+    const size_t n = 1 << 18;
+
+    // Two queues on the same device make sure the weights are needed.
+    std::vector<vex::backend::command_queue> q(2, ctx.queue(0));
+    const std::string sig = vex::backend::device_signature(q[0]);
+
+    double w = 0;
+
+    vex::recompute_device_weights();
+    BOOST_CHECK(!cache::load(sig, w));
+
+    // The weight is measured and stored.
+    std::vector<size_t> p1 = vex::partition(n, q);
+    BOOST_CHECK(cache::load(sig, w));
+    BOOST_CHECK(w > 0);
+
+    BOOST_CHECK(p1[1] > 0 && p1[1] < n);
+    BOOST_CHECK(vex::partition(n, q) == p1);
+
+    // The stored weight is reused instead of the measurement.
+    vex::recompute_device_weights();
+    BOOST_CHECK(!cache::load(sig, w));
+
+    cache::store(sig, 42.5);
+
+    std::vector<size_t> p2 = vex::partition(n, q);
+    BOOST_CHECK(cache::load(sig, w));
+    BOOST_CHECK_EQUAL(w, 42.5);
+    BOOST_CHECK(p2 == p1);
+
+    // The stored file is forgotten as well.
+    vex::recompute_device_weights();
+
+    boost::filesystem::path fname =
+        boost::filesystem::path(vex::cache_path()) / "device_weights";
+    BOOST_CHECK(!boost::filesystem::exists(fname) ||
+            boost::filesystem::file_size(fname) == 0);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,112 @@
+#define BOOST_TEST_MODULE MemoryPool
+#include <boost/test/unit_test.hpp>
+#include <vexcl/vector.hpp>
+#include <vexcl/reductor.hpp>
+#include "context_setup.hpp"
+
+BOOST_AUTO_TEST_CASE(size_classes)
+{
+    typedef vex::backend::device_memory_pool pool;
+
+    BOOST_CHECK_EQUAL(pool::size_class(1),    256);
+    BOOST_CHECK_EQUAL(pool::size_class(256),  256);
+    BOOST_CHECK_EQUAL(pool::size_class(257),  320);
+    BOOST_CHECK_EQUAL(pool::size_class(1000), 1024);
+    BOOST_CHECK_EQUAL(pool::size_class(1025), 1280);
+
+    for(size_t n = 1; n < 100000; n += 97) {
+        size_t c = pool::size_class(n);
+        BOOST_CHECK(c >= n);
+        BOOST_CHECK(c <= std::max<size_t>(256, n + n / 4));
+    }
+}
+
+BOOST_AUTO_TEST_CASE(reuse_released_buffers)
+{
+    const size_t n = 1024;
+
+    vex::trim_memory_pool();
+
+    {
+        vex::vector<double> x(ctx, n);
+    }
+
+    vex::memory_pool_stats s0 = vex::memory_pool_statistics();
+    BOOST_CHECK(s0.cached_buffers > 0);
+
+    std::vector<double> x = random_vector<double>(n);
+    vex::vector<double> X(ctx, x);
+
+    vex::memory_pool_stats s1 = vex::memory_pool_statistics();
+    BOOST_CHECK(s1.hits > s0.hits);
+
+    // Recycled buffer is properly initialized.
+    check_sample(X, [&](size_t idx, double a) { BOOST_CHECK_EQUAL(a, x[idx]); });
+
+    // Scratch buffers of reductors are pooled as well.
+    vex::Reductor<double, vex::SUM> sum(ctx);
+    BOOST_CHECK_CLOSE(sum(X), std::accumulate(x.begin(), x.end(), 0.0), 1e-6);
+}
+
+BOOST_AUTO_TEST_CASE(trim_policy)
+{
+    {
+        vex::vector<float> x(ctx, 4096);
+        vex::vector<float> y(ctx, 8192);
+    }
+
+    BOOST_CHECK(vex::memory_pool_statistics().cached_bytes > 0);
+
+    vex::memory_pool_limit(0);
+    BOOST_CHECK_EQUAL(vex::memory_pool_statistics().cached_bytes, 0);
+
+    {
+        vex::vector<float> x(ctx, 4096);
+    }
+    BOOST_CHECK_EQUAL(vex::memory_pool_statistics().cached_bytes, 0);
+
+    vex::memory_pool_limit(64 << 20);
+
+    {
+        vex::vector<float> x(ctx, 4096);
+    }
+    BOOST_CHECK(vex::memory_pool_statistics().cached_bytes > 0);
+
+    BOOST_CHECK(vex::trim_memory_pool() > 0);
+    BOOST_CHECK_EQUAL(vex::memory_pool_statistics().cached_buffers, 0);
+}
+
+BOOST_AUTO_TEST_CASE(purge_context_buffers)
+{
+    {
+        vex::vector<double> x(ctx, 1024);
+    }
+    BOOST_CHECK(vex::memory_pool_statistics().cached_buffers > 0);
+
+    vex::purge_kernel_caches(ctx);
+    BOOST_CHECK_EQUAL(vex::memory_pool_statistics().cached_buffers, 0);
+
+    vex::vector<double> x(ctx, 1024);
+    x = 42;
+    BOOST_CHECK_EQUAL(x[42], 42);
+}
+
+BOOST_AUTO_TEST_CASE(disabled_pool)
+{
+    vex::use_memory_pool(false);
+
+    size_t hits = vex::memory_pool_statistics().hits;
+
+    for(int i = 0; i < 4; ++i) {
+        vex::vector<int> x(ctx, 1024);
+        x = 42;
+        BOOST_CHECK_EQUAL(x[42], 42);
+    }
+
+    BOOST_CHECK_EQUAL(vex::memory_pool_statistics().hits, hits);
+    BOOST_CHECK_EQUAL(vex::memory_pool_statistics().cached_bytes, 0);
+
+    vex::use_memory_pool(true);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
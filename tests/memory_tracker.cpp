@@ -0,0 +1,61 @@
+#define BOOST_TEST_MODULE MemoryTracker
+#include <sstream>
+#include <boost/test/unit_test.hpp>
+#include <vexcl/vector.hpp>
+#include <vexcl/reductor.hpp>
+#include "context_setup.hpp"
+
+BOOST_AUTO_TEST_CASE(vector_usage)
+{
+    const size_t n = 1024;
+
+    const vex::backend::command_queue &q = ctx.queue(0);
+
+    vex::memory_usage u0 = vex::device_memory_usage(q, "vector");
+
+    {
+        vex::vector<double> x(ctx.queue(), n);
+
+        vex::memory_usage u1 = vex::device_memory_usage(q, "vector");
+        BOOST_CHECK_EQUAL(u1.live_bytes,       u0.live_bytes + n * sizeof(double));
+        BOOST_CHECK_EQUAL(u1.live_allocations, u0.live_allocations + 1);
+        BOOST_CHECK_EQUAL(u1.allocations,      u0.allocations + 1);
+        BOOST_CHECK(u1.peak_bytes >= u1.live_bytes);
+    }
+
+    vex::memory_usage u2 = vex::device_memory_usage(q, "vector");
+    BOOST_CHECK_EQUAL(u2.live_bytes,       u0.live_bytes);
+    BOOST_CHECK_EQUAL(u2.live_allocations, u0.live_allocations);
+    BOOST_CHECK(u2.peak_bytes >= u0.live_bytes + n * sizeof(double));
+
+    vex::reset_peak_memory_usage();
+    BOOST_CHECK_EQUAL(vex::device_memory_usage(q, "vector").peak_bytes, u2.live_bytes);
+}
+
+BOOST_AUTO_TEST_CASE(custom_category)
+{
+    const size_t n = 1024;
+
+    const vex::backend::command_queue &q = ctx.queue(0);
+
+    {
+        vex::memory_category cat("solver");
+
+        vex::vector<double>  x(ctx.queue(), n);
+        vex::Reductor<double, vex::SUM> sum(ctx.queue());
+
+        // The outermost scope wins.
+        vex::memory_usage u = vex::device_memory_usage(q, "solver");
+        BOOST_CHECK(u.live_bytes >= n * sizeof(double));
+        BOOST_CHECK(u.live_allocations >= 2);
+
+        std::ostringstream s;
+        vex::memory_report(s);
+        BOOST_CHECK(s.str().find("solver") != std::string::npos);
+    }
+
+    BOOST_CHECK_EQUAL(vex::device_memory_usage(q, "solver").live_bytes, 0);
+    BOOST_CHECK_EQUAL(vex::memory_category::name(), std::string("other"));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,82 @@
+#define BOOST_TEST_MODULE StorageVector
+#include <boost/test/unit_test.hpp>
+#include <vexcl/vector.hpp>
+#include <vexcl/storage_vector.hpp>
+#include <vexcl/element_index.hpp>
+#include <vexcl/reductor.hpp>
+#include <vexcl/where.hpp>
+#include "context_setup.hpp"
+
+BOOST_AUTO_TEST_CASE(half_conversion)
+{
+    const float values[] = {0.0f, 1.0f, -2.5f, 65504.0f, 6.103515625e-05f, 5.9604645e-08f, 0.1f};
+
+    for(float v : values)
+        BOOST_CHECK_CLOSE(vex::detail::half_to_float(vex::detail::float_to_half(v)), v, 0.05);
+
+    // Round to nearest even.
+    BOOST_CHECK_EQUAL(vex::detail::float_to_half(1.0f + 1.0f / 2048), 0x3c00);
+    BOOST_CHECK_EQUAL(vex::detail::float_to_half(1.0f + 3.0f / 2048), 0x3c02);
+
+    // Overflow to infinity.
+    BOOST_CHECK_EQUAL(vex::detail::float_to_half(1e6f), 0x7c00);
+}
+
+BOOST_AUTO_TEST_CASE(float_storage)
+{
+    const size_t n = 1024;
+
+    std::vector<double> x = random_vector<double>(n);
+
+    vex::storage_vector<double, float> X(ctx, x);
+    vex::vector<double> Y(ctx, n);
+
+    Y = 2 * X;
+
+    check_sample(Y, [&](size_t idx, double a) {
+            BOOST_CHECK_CLOSE(a, 2 * static_cast<float>(x[idx]), 1e-6);
+            });
+
+    X += Y;
+
+    std::vector<double> z(n);
+    vex::copy(X, z);
+
+    for(size_t i = 0; i < n; ++i)
+        BOOST_CHECK_CLOSE(z[i], 3 * x[i], 1e-4);
+
+    vex::Reductor<double, vex::SUM> sum(ctx);
+    BOOST_CHECK_CLOSE(sum(X), std::accumulate(z.begin(), z.end(), 0.0), 1e-6);
+}
+
+BOOST_AUTO_TEST_CASE(half_storage)
+{
+    const size_t n = 1024;
+
+    std::vector<float> x = random_vector<float>(n);
+
+    vex::storage_vector<float, vex::half_float> X(ctx, n);
+    vex::vector<float> Y(ctx, x);
+
+    X = Y;
+    X *= 2;
+
+    std::vector<float> z(n);
+    vex::copy(X, z);
+
+    for(size_t i = 0; i < n; ++i)
+        BOOST_CHECK_CLOSE(z[i], 2 * x[i], 0.1);
+
+    vex::where(vex::element_index() % 2 == 0, vex::tie(X, Y)) = std::tie(Y, X);
+
+    vex::copy(X, z);
+
+    for(size_t i = 0; i < n; i += 2)
+        BOOST_CHECK_CLOSE(z[i], x[i], 0.1);
+
+    check_sample(Y, [&](size_t idx, float a) {
+            BOOST_CHECK_CLOSE(a, idx % 2 == 0 ? 2 * x[idx] : x[idx], 0.1);
+            });
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,66 @@
+#define BOOST_TEST_MODULE Streaming
+#include <boost/test/unit_test.hpp>
+#include <vexcl/vector.hpp>
+#include <vexcl/reductor.hpp>
+#include <vexcl/element_index.hpp>
+#include <vexcl/streaming.hpp>
+#include "context_setup.hpp"
+
+BOOST_AUTO_TEST_CASE(stream_expressions)
+{
+    const size_t n = 10000;
+
+    std::vector<double> x = random_vector<double>(n);
+    std::vector<double> y = random_vector<double>(n);
+
+    for(unsigned depth = 2; depth <= 3; ++depth) {
+        std::vector<double> z(n);
+        std::vector<double> w(y);
+
+        // Chunk size does not divide the array size.
+        vex::stream_executor ex(ctx.queue(0), n, 1024, depth);
+
+        const vex::vector<double> &X = ex.input(x.data());
+        vex::vector<double>       &Y = ex.inout(w.data());
+        vex::vector<double>       &Z = ex.output(z.data());
+
+        vex::Reductor<double, vex::SUM> sum(ex.queue_list());
+
+        double s = 0;
+        ex.run([&]() {
+                Z = X + 2 * Y;
+                Y = X * Y;
+                s += sum(Z);
+                });
+
+        check_sample(z, w, [&](size_t idx, double a, double b) {
+                BOOST_CHECK_CLOSE(a, x[idx] + 2 * y[idx], 1e-8);
+                BOOST_CHECK_CLOSE(b, x[idx] * y[idx], 1e-8);
+                });
+
+        BOOST_CHECK_CLOSE(s, std::accumulate(z.begin(), z.end(), 0.0), 1e-6);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(stream_output_only)
+{
+    const size_t n = 10000;
+
+    for(unsigned depth = 2; depth <= 3; ++depth) {
+        std::vector<double> y(n);
+
+        vex::stream_executor ex(ctx.queue(0), n, 512, depth);
+
+        vex::vector<double> &Y = ex.output(y.data());
+
+        ex.run([&]() {
+                Y = sin(1e-3 * vex::element_index(ex.offset()));
+                });
+
+        check_sample(y, [&](size_t idx, double a) {
+                BOOST_CHECK_CLOSE(a, sin(1e-3 * idx), 1e-8);
+                });
+    }
+}
+
+BOOST_AUTO_TEST_SUITE_END()
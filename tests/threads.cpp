@@ -0,0 +1,87 @@
+#define BOOST_TEST_MODULE Threads
+#include <algorithm>
+#include <thread>
+#include <boost/test/unit_test.hpp>
+#include <vexcl/vector.hpp>
+#include <vexcl/reductor.hpp>
+#include <vexcl/sort.hpp>
+#include "context_setup.hpp"
+
+BOOST_AUTO_TEST_CASE(concurrent_kernels)
+{
+    const size_t   n  = 1024 * 1024;
+    const unsigned nt = 8;
+    const unsigned m  = 16;
+
+    // Random number generators in random_vector() are not thread-safe.
+    std::vector< std::vector<float> > input(nt);
+    for(unsigned t = 0; t < nt; ++t) input[t] = random_vector<float>(n);
+
+    std::vector<int> ok(nt, 0);
+    std::vector<std::thread> pool;
+
+    for(unsigned t = 0; t < nt; ++t) {
+        pool.push_back(std::thread([&, t]() {
+            try {
+                vex::vector<float> x(ctx, n);
+                vex::vector<float> y(ctx, n);
+
+                vex::Reductor<float, vex::SUM> sum(ctx);
+                vex::Reductor<float, vex::MAX> max(ctx);
+
+                bool good = true;
+
+                for(unsigned i = 0; i < m; ++i) {
+                    float a = static_cast<float>(t + i);
+
+                    x = a;
+                    y = 2 * x + 1;
+
+                    good = good && sum(y - 2 * x) == n;
+                    good = good && max(y) == 2 * a + 1;
+                }
+
+                vex::vector<float> keys(ctx, input[t]);
+                vex::sort(keys);
+
+                std::vector<float> k(n);
+                vex::copy(keys, k);
+
+                ok[t] = good && std::is_sorted(k.begin(), k.end());
+            } catch(...) {
+                ok[t] = 0;
+            }
+        }));
+    }
+
+    for(auto t = pool.begin(); t != pool.end(); ++t) t->join();
+
+    for(unsigned t = 0; t < nt; ++t) BOOST_CHECK(ok[t]);
+}
+
+BOOST_AUTO_TEST_CASE(thread_exit_releases_resources)
+{
+    const size_t n = 1024;
+
+    vex::vector<double> x(ctx, n);
+    x = 1;
+
+    const vex::backend::command_queue &q = ctx.queue(0);
+    size_t live = vex::device_memory_usage(q, "reductor").live_bytes;
+
+    for(int t = 0; t < 4; ++t) {
+        double s = 0;
+
+        std::thread([&]() {
+            s = vex::get_reductor<double, vex::SUM>(ctx)(x);
+            x = 2 * x - 1;
+        }).join();
+
+        BOOST_CHECK_EQUAL(s, n);
+
+        // Reductors (and kernels) of the thread are released when it exits.
+        BOOST_CHECK_EQUAL(vex::device_memory_usage(q, "reductor").live_bytes, live);
+    }
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -4,6 +4,7 @@
 #include <vexcl/vector.hpp>
 #include <vexcl/reductor.hpp>
 #include <vexcl/element_index.hpp>
+#include <vexcl/specialize.hpp>
 #include <vexcl/tagged_terminal.hpp>
 #include <boost/math/constants/constants.hpp>
 #include "context_setup.hpp"
@@ -41,6 +42,52 @@ BOOST_AUTO_TEST_CASE(compound_assignment)
     check_sample(x, [](size_t, double a) { BOOST_CHECK(a == -1); });
 }
 
+BOOST_AUTO_TEST_CASE(vectorized_assignment)
+{
+    // Sizes that are not multiples of the vector width exercise the scalar
+    // tail of vectorized kernels on CPU devices.
+    for(size_t n = 1; n < 40; n += 3) {
+        std::vector<float> x = random_vector<float>(n);
+        std::vector<float> y = random_vector<float>(n);
+
+        vex::vector<float> X(ctx, x);
+        vex::vector<float> Y(ctx, y);
+        vex::vector<float> Z(ctx, n);
+
+        Z = 2 * X - Y / 3.0f;
+        Z += X;
+        Z *= -Y;
+
+        check_sample(X, Y, Z, [](size_t, float a, float b, float c) {
+                BOOST_CHECK_SMALL(c + (2 * a - b / 3 + a) * b, 1e-5f);
+                });
+    }
+}
+
+BOOST_AUTO_TEST_CASE(changing_kernel_arguments)
+{
+    const size_t n = 1024;
+
+    vex::vector<double> x(ctx, n);
+    vex::vector<double> y(ctx, n);
+
+    // The same kernel is launched with alternating arguments.
+    for(int i = 0; i < 4; ++i) {
+        vex::vector<double> &v = (i % 2) ? x : y;
+        v = i;
+    }
+
+    check_sample(x, [](size_t, double a) { BOOST_CHECK_EQUAL(a, 3); });
+    check_sample(y, [](size_t, double a) { BOOST_CHECK_EQUAL(a, 2); });
+
+    // A vector reallocated in place of a released one gets the new buffer.
+    for(int i = 0; i < 2; ++i) {
+        vex::vector<double> z(ctx, n);
+        z = i;
+        check_sample(z, [i](size_t, double a) { BOOST_CHECK_EQUAL(a, i); });
+    }
+}
+
 BOOST_AUTO_TEST_CASE(reduce_expression)
 {
     const size_t N = 1024;
@@ -60,6 +107,67 @@ BOOST_AUTO_TEST_CASE(reduce_expression)
     BOOST_CHECK_SMALL(max(fabs(X - X)), 1e-12);
 }
 
+BOOST_AUTO_TEST_CASE(assign_and_reduce)
+{
+    const size_t N = 1024;
+
+    std::vector<double> x = random_vector<double>(N);
+    std::vector<double> y = random_vector<double>(N);
+
+    vex::vector<double> X(ctx, x);
+    vex::vector<double> Y(ctx, y);
+
+    vex::Reductor<double,vex::SUM> sum(ctx);
+    vex::Reductor<double,vex::MAX> max(ctx);
+
+    const double a = 0.5;
+
+    for(size_t i = 0; i < N; ++i) y[i] += a * x[i];
+
+    double yy = sum.assign_and_reduce(Y, a * X + Y, Y * Y);
+
+    BOOST_CHECK_CLOSE(yy, std::inner_product(y.begin(), y.end(), y.begin(), 0.0), 1e-6);
+
+    check_sample(Y, [&](size_t idx, double v) { BOOST_CHECK_CLOSE(v, y[idx], 1e-8); });
+
+    // Lhs is not used in the assigned expression.
+    for(size_t i = 0; i < N; ++i) y[i] = 2 * x[i];
+
+    std::array<double, 2> r = max.assign_and_reduce(Y, 2 * X, Y, -X);
+
+    BOOST_CHECK_CLOSE(r[0], *std::max_element(y.begin(), y.end()), 1e-6);
+    BOOST_CHECK_CLOSE(r[1], -*std::min_element(x.begin(), x.end()), 1e-6);
+}
+
+BOOST_AUTO_TEST_CASE(multi_reduce)
+{
+    const size_t N = 1024;
+
+    std::vector<double> x = random_vector<double>(N);
+    std::vector<double> y = random_vector<double>(N);
+
+    vex::vector<double> X(ctx, x);
+    vex::vector<double> Y(ctx, y);
+
+    vex::MultiReductor<double, vex::SUM, vex::MIN, vex::MAX> stats(ctx);
+
+    std::tuple<double, double, double> r = stats(X * Y, X, Y - X);
+
+    BOOST_CHECK_CLOSE(std::get<0>(r), std::inner_product(x.begin(), x.end(), y.begin(), 0.0), 1e-6);
+    BOOST_CHECK_CLOSE(std::get<1>(r), *std::min_element(x.begin(), x.end()), 1e-12);
+
+    double m = y[0] - x[0];
+    for(size_t i = 1; i < N; ++i) m = std::max(m, y[i] - x[i]);
+
+    BOOST_CHECK_CLOSE(std::get<2>(r), m, 1e-12);
+
+    r = stats(std::tie(X, Y, X));
+
+    BOOST_CHECK_CLOSE(std::get<0>(r), std::accumulate(x.begin(), x.end(), 0.0), 1e-6);
+    BOOST_CHECK_CLOSE(std::get<1>(r), *std::min_element(y.begin(), y.end()), 1e-12);
+    BOOST_CHECK_CLOSE(std::get<2>(r), *std::max_element(x.begin(), x.end()), 1e-12);
+}
+
 BOOST_AUTO_TEST_CASE(static_reductor)
 {
     const size_t N = 1024;
@@ -274,6 +382,87 @@ BOOST_AUTO_TEST_CASE(constants)
     check_sample(x, [](size_t, double v) { BOOST_CHECK_CLOSE(v, boost::math::constants::pi<double>(), 1e-8); });
 }
 
+BOOST_AUTO_TEST_CASE(specialized_values)
+{
+    const size_t n = 1024;
+
+    std::vector<double> y_host = random_vector<double>(n);
+
+    vex::vector<double> x(ctx, n);
+    vex::vector<double> y(ctx, y_host);
+
+    vex::specialize_sizes(true);
+
+    // More values than variants allowed, so that the generic kernel is used
+    // for the last ones.
+    for(int a = 0; a < 12; ++a) {
+        x = vex::specialize(a) * y + vex::specialize(0.5);
+
+        check_sample(x, y, [a](size_t, double v, double w) {
+                BOOST_CHECK_CLOSE(v, a * w + 0.5, 1e-8);
+                });
+    }
+
+    vex::specialize_sizes(false);
+
+    // Non-finite values have no numeric literal in the kernel language.
+    x = y - vex::specialize(std::numeric_limits<double>::infinity());
+    check_sample(x, [](size_t, double v) {
+            BOOST_CHECK(v == -std::numeric_limits<double>::infinity());
+            });
+
+    x = y + vex::specialize(std::numeric_limits<double>::quiet_NaN());
+    check_sample(x, [](size_t, double v) { BOOST_CHECK(v != v); });
+
+    // Integer values out of range of int.
+    vex::vector<cl_long>  l(ctx, n);
+    vex::vector<cl_ulong> u(ctx, n);
+
+    l = vex::specialize(std::numeric_limits<cl_long>::min());
+    u = vex::specialize(std::numeric_limits<cl_ulong>::max());
+
+    check_sample(l, u, [](size_t, cl_long a, cl_ulong b) {
+            BOOST_CHECK_EQUAL(a, std::numeric_limits<cl_long>::min());
+            BOOST_CHECK_EQUAL(b, std::numeric_limits<cl_ulong>::max());
+            });
+}
+
+BOOST_AUTO_TEST_CASE(common_subexpressions)
+{
+    const size_t n = 1024;
+
+    std::vector<double> x = random_vector<double>(n);
+    std::vector<double> y = random_vector<double>(n);
+
+    vex::vector<double> X(ctx, x);
+    vex::vector<double> Y(ctx, y);
+    vex::vector<double> Z(ctx, n);
+
+    Z = sin(X) * sin(X) + X * Y;
+
+    check_sample(Z, [&](size_t idx, double v) {
+            BOOST_CHECK_CLOSE(v, sin(x[idx]) * sin(x[idx]) + x[idx] * y[idx], 1e-8);
+            });
+
+    // Same expression type, but the vectors are different now.
+    Z = sin(X) * sin(Y) + X * Y;
+
+    check_sample(Z, [&](size_t idx, double v) {
+            BOOST_CHECK_CLOSE(v, sin(x[idx]) * sin(y[idx]) + x[idx] * y[idx], 1e-8);
+            });
+
+    Z = if_else(X > 0.5, exp(-X * X), 1 - exp(-X * X)) + exp(-X * X);
+
+    check_sample(Z, [&](size_t idx, double v) {
+            double e = exp(-x[idx] * x[idx]);
+            BOOST_CHECK_CLOSE(v, (x[idx] > 0.5 ? e : 1 - e) + e, 1e-8);
+            });
+
+    vex::Reductor<double, vex::SUM> sum(ctx);
+
+    BOOST_CHECK_CLOSE(sum(sin(X) * sin(X) + cos(X) * cos(X)), static_cast<double>(n), 1e-8);
+}
+
 #if (VEXCL_CHECK_SIZES > 0)
 BOOST_AUTO_TEST_CASE(expression_size_check)
 {
@@ -55,6 +55,51 @@ BOOST_AUTO_TEST_CASE(copy_from_std_vector)
     check_sample(X, [](size_t, double a) { BOOST_CHECK(a == 42); });
 }
 
+BOOST_AUTO_TEST_CASE(async_copy)
+{
+    const size_t N = 1 << 20;
+
+    std::vector<double> x = random_vector<double>(N);
+    std::vector<double> y(N);
+    vex::vector<double> X(ctx, N);
+
+    vex::copy_event e = vex::copy_async(x, X);
+    e.wait();
+
+    X = 2 * X;
+
+    vex::copy_async(X, y).wait();
+
+    check_sample(y, [&](size_t idx, double a) { BOOST_CHECK_EQUAL(a, 2 * x[idx]); });
+}
+
+BOOST_AUTO_TEST_CASE(pinned_copy)
+{
+    // Large enough for several staging chunks with a partial one at the end.
+    const size_t N = 3 * (1 << 20) + 123;
+
+    std::vector<double> x = random_vector<double>(N);
+    std::vector<double> y(N);
+    vex::vector<double> X(ctx, N);
+
+    vex::pinned_transfers(true);
+
+    vex::copy(x, X);
+    check_sample(X, x, [](size_t, double a, double b) { BOOST_CHECK(a == b); });
+
+    X = 2 * X;
+
+    vex::copy(X, y);
+    check_sample(y, [&](size_t idx, double a) { BOOST_CHECK_EQUAL(a, 2 * x[idx]); });
+
+    // Sub-range crossing partition boundaries.
+    std::vector<double> z(N / 2);
+    vex::copy(X.begin() + N / 4, X.begin() + N / 4 + z.size(), z.begin());
+    check_sample(z, [&](size_t idx, double a) { BOOST_CHECK_EQUAL(a, 2 * x[idx + N / 4]); });
+
+    vex::pinned_transfers(false);
+}
+
 BOOST_AUTO_TEST_CASE(map_buffer)
 {
     const size_t N = 1 << 20;
@@ -0,0 +1,61 @@
+#define BOOST_TEST_MODULE MaskedAssignment
+#include <boost/test/unit_test.hpp>
+#include <vexcl/vector.hpp>
+#include <vexcl/multivector.hpp>
+#include <vexcl/element_index.hpp>
+#include <vexcl/where.hpp>
+#include "context_setup.hpp"
+
+BOOST_AUTO_TEST_CASE(masked_assignment)
+{
+    const size_t n = 1024;
+
+    std::vector<double> x = random_vector<double>(n);
+    std::vector<double> y = random_vector<double>(n);
+
+    vex::vector<double> X(ctx, x);
+    vex::vector<double> Y(ctx, y);
+
+    vex::where(X > 0.5, Y) = 2 * X;
+
+    check_sample(Y, [&](size_t idx, double a) {
+            BOOST_CHECK_CLOSE(a, x[idx] > 0.5 ? 2 * x[idx] : y[idx], 1e-8);
+            });
+
+    vex::where(vex::element_index() % 2 == 0, X) += 1;
+
+    check_sample(X, [&](size_t idx, double a) {
+            BOOST_CHECK_CLOSE(a, idx % 2 == 0 ? x[idx] + 1 : x[idx], 1e-8);
+            });
+}
+
+BOOST_AUTO_TEST_CASE(masked_tie)
+{
+    const size_t n = 1024;
+
+    std::vector<double> x = random_vector<double>(n);
+    std::vector<double> y = random_vector<double>(n);
+
+    vex::vector<double> X(ctx, x);
+    vex::vector<double> Y(ctx, y);
+
+    // Both components are evaluated before any of them is stored.
+    vex::where(X < Y, vex::tie(X, Y)) = std::tie(Y, X);
+
+    check_sample(X, Y, [&](size_t idx, double a, double b) {
+            BOOST_CHECK_EQUAL(a, std::max(x[idx], y[idx]));
+            BOOST_CHECK_EQUAL(b, std::min(x[idx], y[idx]));
+            });
+
+    vex::multivector<double, 2> Z(ctx, n);
+    Z = 0;
+
+    vex::where(X > 0.5, vex::tie(Z(0), Z(1))) = 2 * Z + 1;
+
+    check_sample(X, Z(0), Z(1), [&](size_t, double a, double b, double c) {
+            BOOST_CHECK_EQUAL(b, a > 0.5 ? 1 : 0);
+            BOOST_CHECK_EQUAL(c, a > 0.5 ? 1 : 0);
+            });
+}
+
+BOOST_AUTO_TEST_SUITE_END()
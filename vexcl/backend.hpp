@@ -80,6 +80,54 @@ namespace vex {
     using backend::error;
     using backend::device_vector;
     using backend::is_cpu;
+
+    /// Returns device memory pool statistics.
+    inline memory_pool_stats memory_pool_statistics() {
+        return backend::device_memory_pool::instance().statistics();
+    }
+
+    /// Frees cached device buffers until at most keep bytes remain cached.
+    /** Returns number of freed bytes. */
+    inline size_t trim_memory_pool(size_t keep = 0) {
+        return backend::device_memory_pool::instance().trim(keep);
+    }
+
+    /// Sets maximum number of bytes kept in device memory pool.
+    inline void memory_pool_limit(size_t bytes) {
+        backend::device_memory_pool::instance().limit(bytes);
+    }
+
+    /// Enables or disables caching of released device buffers.
+    /**
+     * The pool may be disabled at compile time with VEXCL_DISABLE_MEMORY_POOL
+     * macro.
+     */
+    inline void use_memory_pool(bool enable = true) {
+        backend::device_memory_pool::instance().enable(enable);
+    }
+
+    /// Returns device memory usage by the given category (or total usage).
+    /**
+     * Only memory allocated by VexCL is accounted. Buffers held in the
+     * memory pool are not counted as live. Accounting may be disabled with
+     * VEXCL_DISABLE_MEMORY_TRACKING macro.
+     */
+    inline memory_usage device_memory_usage(const command_queue &q,
+            const std::string &category = "")
+    {
+        return backend::device_memory_tracker::instance().usage(
+                backend::get_device_id(q), category);
+    }
+
+    /// Resets peak device memory usage to the current one.
+    inline void reset_peak_memory_usage() {
+        backend::device_memory_tracker::instance().reset_peaks();
+    }
+
+    /// Writes device memory usage report for all devices and categories.
+    inline void memory_report(std::ostream &os = std::cout) {
+        backend::device_memory_tracker::instance().report(os);
+    }
 } // namespace vex
 
 #endif
@@ -0,0 +1,303 @@
+#ifndef VEXCL_BACKEND_AUTOTUNE_HPP
+#define VEXCL_BACKEND_AUTOTUNE_HPP
+
+/*
+The MIT License
+
+Copyright (c) 2012-2014 Denis Demidov <dennis.demidov@gmail.com>
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+/**
+ * \file   vexcl/backend/autotune.hpp
+ * \author Denis Demidov <dennis.demidov@gmail.com>
+ * \brief  Launch configuration autotuner.
+ */
+
+#include <string>
+#include <vector>
+#include <map>
+#include <memory>
+#include <fstream>
+#include <algorithm>
+#include <limits>
+#include <cstdlib>
+
+#if defined(_MSC_VER) && (_MSC_VER < 1700)
+#  include <boost/chrono.hpp>
+#else
+#  include <chrono>
+#endif
+
+#include <boost/filesystem.hpp>
+
+#include <vexcl/backend/common.hpp>
+#include <vexcl/detail/mutex.hpp>
+
+namespace vex {
+
+/// \cond INTERNAL
+
+/// Kernel launch configuration.
+struct launch_config {
+    size_t groups;  ///< Number of workgroups.
+    size_t wgsize;  ///< Workgroup size.
+
+    bool operator==(const launch_config &c) const {
+        return groups == c.groups && wgsize == c.wgsize;
+    }
+};
+
+/// Autotuner key of a kernel.
+/**
+ * The key is a hash of the device signature, the kernel name and the kernel
+ * source. Kernels only hold a key when they are built with autotuning
+ * enabled. The hash is computed on first use and is shared between copies
+ * of the kernel.
+ */
+class tuning_key {
+    public:
+        tuning_key() {}
+
+        tuning_key(const std::string &src, const std::string &name)
+            : d(std::make_shared<data>(src, name)) {}
+
+        bool empty() const {
+            return !d;
+        }
+
+        /// Returns the key; signature() gives the device signature.
+        template <class Signature>
+        const std::string& get(Signature &&signature) const {
+            detail::lock_guard lock(d->mx);
+
+            if (d->key.empty()) {
+                d->key = sha1(signature() + "\n" + d->name + "\n" + d->src);
+                std::string().swap(d->src);
+            }
+
+            return d->key;
+        }
+    private:
+        struct data {
+            data(const std::string &src, const std::string &name)
+                : src(src), name(name) {}
+
+            detail::mutex mx;
+            std::string   src, name, key;
+        };
+
+        std::shared_ptr<data> d;
+};
+
+/// Launch configuration autotuner.
+/**
+ * The first launches of a tunable kernel for each problem size bucket
+ * (floor(log2(n))) are used to time a set of candidate configurations. Each
+ * candidate is timed twice, and the fastest one is stored in
+ * cache_path()/autotune, so that it is reused by later runs.
+ *
+ * Autotuning is disabled by default. It is enabled with vex::autotune() or
+ * with VEXCL_AUTOTUNE environment variable.
+ */
+template <bool dummy = true>
+struct autotuner {
+    static_assert(dummy, "dummy parameter should be true");
+
+    static bool enabled() {
+        return flag();
+    }
+
+    static void enable(bool on) {
+        flag() = on;
+    }
+
+    static size_t bucket(size_t n) {
+        size_t b = 0;
+        while(n >>= 1) ++b;
+        return b;
+    }
+
+    /// Selects launch configuration for a kernel.
+    /**
+     * Candidates are only generated when the bucket is seen for the first
+     * time. Returns the candidate index when the launch should be timed and
+     * reported, or -1 when the tuned configuration is returned.
+     */
+    template <class Candidates>
+    static int select(const std::string &key, size_t n,
+            Candidates &&candidates, launch_config &cfg)
+    {
+        state &s = get();
+        detail::lock_guard lock(s.mx);
+
+        record &r = s.find(key, bucket(n));
+
+        if (r.tuned) {
+            cfg = r.best;
+            return -1;
+        }
+
+        if (r.cand.empty()) {
+            r.cand = candidates();
+            r.time.assign(r.cand.size(), std::numeric_limits<double>::max());
+
+            if (r.cand.empty()) {
+                r.tuned = true;
+                return -1;
+            }
+        }
+
+        // Several threads may explore the same record; extra reports are ignored.
+        int i = static_cast<int>(r.next % r.cand.size());
+        cfg = r.cand[i];
+
+        ++r.next;
+        return i;
+    }
+
+    /// Wall clock time in seconds (used for timing the candidates).
+    static double now() {
+#if defined(_MSC_VER) && (_MSC_VER < 1700)
+        namespace chrono = boost::chrono;
+#else
+        namespace chrono = std::chrono;
+#endif
+        return chrono::duration<double>(
+                chrono::high_resolution_clock::now().time_since_epoch()
+                ).count();
+    }
+
+    /// Reports time taken by a launch with the selected candidate.
+    static void report(const std::string &key, size_t n, int idx, double time) {
+        state &s = get();
+        detail::lock_guard lock(s.mx);
+
+        record &r = s.find(key, bucket(n));
+        if (r.tuned || idx < 0 || static_cast<size_t>(idx) >= r.cand.size()) return;
+
+        r.time[idx] = std::min(r.time[idx], time);
+
+        if (++r.reported < rounds * r.cand.size()) return;
+
+        size_t best = 0;
+        for(size_t i = 1; i < r.cand.size(); ++i)
+            if (r.time[i] < r.time[best]) best = i;
+
+        r.best  = r.cand[best];
+        r.tuned = true;
+
+        r.cand.clear();
+        r.time.clear();
+
+        s.save(key, bucket(n), r.best);
+    }
+
+    private:
+        static const size_t rounds = 2;
+
+        struct record {
+            bool tuned;
+            launch_config best;
+
+            std::vector<launch_config> cand;
+            std::vector<double> time;
+            size_t next, reported;
+
+            record() : tuned(false), next(0), reported(0) {
+                best.groups = best.wgsize = 0;
+            }
+        };
+
+        struct state {
+            detail::mutex mx;
+            std::map<std::pair<std::string, size_t>, record> db;
+
+            state() {
+                std::ifstream f(fname());
+
+                std::string key;
+                size_t b;
+                launch_config c;
+
+                while(f >> key >> b >> c.groups >> c.wgsize) {
+                    record &r = db[std::make_pair(key, b)];
+                    r.tuned = true;
+                    r.best  = c;
+                }
+            }
+
+            record& find(const std::string &key, size_t b) {
+                return db[std::make_pair(key, b)];
+            }
+
+            void save(const std::string &key, size_t b, const launch_config &c) {
+                boost::system::error_code ec;
+                boost::filesystem::create_directories(cache_path(), ec);
+
+                // Results of concurrent processes are appended; the
+                // last one read wins.
+                std::ofstream f(fname(), std::ios::app);
+                f << key << " " << b << " " << c.groups << " " << c.wgsize << std::endl;
+            }
+
+            static std::string fname() {
+                return cache_path() + path_delim() + "autotune";
+            }
+        };
+
+        static state& get() {
+            static state s;
+            return s;
+        }
+
+        static bool& flag() {
+#ifdef _MSC_VER
+#  pragma warning(push)
+#  pragma warning(disable: 4996)
+#endif
+            static bool on = getenv("VEXCL_AUTOTUNE") != 0;
+#ifdef _MSC_VER
+#  pragma warning(pop)
+#endif
+            return on;
+        }
+};
+
+/// \endcond
+
+/// Enables or disables launch configuration autotuning.
+/**
+ * When enabled, the first few launches of element-wise, reduction, and
+ * sparse matrix-vector kernels are used to time several workgroup and grid
+ * sizes. The fastest configuration for each kernel, device, and problem size
+ * range is stored in the cache directory and reused afterwards. Only kernels
+ * compiled while autotuning is enabled are tuned, so it should be enabled
+ * before the first use of the expressions. May also be enabled with
+ * VEXCL_AUTOTUNE environment variable. When disabled again, the kernels
+ * return to the default launch configuration.
+ */
+inline void autotune(bool enable = true) {
+    autotuner<>::enable(enable);
+}
+
+} // namespace vex
+
+#endif
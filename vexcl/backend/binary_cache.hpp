@@ -0,0 +1,417 @@
+#ifndef VEXCL_BACKEND_BINARY_CACHE_HPP
+#define VEXCL_BACKEND_BINARY_CACHE_HPP
+
+/*
+The MIT License
+
+Copyright (c) 2012-2014 Denis Demidov <dennis.demidov@gmail.com>
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+/**
+ * \file   vexcl/backend/binary_cache.hpp
+ * \author Denis Demidov <dennis.demidov@gmail.com>
+ * \brief  Offline cache of compiled program binaries.
+ */
+
+#include <string>
+#include <vector>
+#include <fstream>
+#include <sstream>
+#include <map>
+#include <algorithm>
+#include <ctime>
+#include <cctype>
+#include <cstdlib>
+
+#include <boost/filesystem.hpp>
+#include <boost/interprocess/sync/file_lock.hpp>
+#include <boost/interprocess/sync/scoped_lock.hpp>
+
+#include <vexcl/backend/common.hpp>
+#include <vexcl/detail/mutex.hpp>
+
+namespace vex {
+
+/// Offline binary cache statistics for the current process.
+struct binary_cache_statistics {
+    size_t hits;        ///< Valid entries found in the cache.
+    size_t misses;      ///< Entries not found in the cache.
+    size_t stores;      ///< Entries written to the cache.
+    size_t invalid;     ///< Entries discarded as corrupt or unusable.
+    size_t evictions;   ///< Entries removed to stay within the size budget.
+};
+
+/// \cond INTERNAL
+
+/// Offline cache of compiled program binaries.
+/**
+ * Each entry is stored in cache_path()/xx/yyy/kernel, where xxyyy is the SHA1
+ * hash of the program source and build options. An entry is written to a
+ * temporary file and then renamed into place, so that concurrent processes
+ * never see a partially written entry. Entries carry the SHA1 checksum of the
+ * binary, which is validated on load.
+ *
+ * Sizes of the entries are tracked in cache_path()/index (guarded by an
+ * interprocess file lock), so that an entry stored again replaces its old
+ * size. When the size exceeds the budget, the least
+ * recently used entries are removed. The budget is set in bytes with
+ * VEXCL_CACHE_SIZE environment variable (suffixes K, M, and G are accepted)
+ * and defaults to 1G. Zero budget disables eviction.
+ */
+template <bool dummy = true>
+struct binary_cache {
+    static_assert(dummy, "dummy parameter should be true");
+
+    /// Reads the binary stored under the given hash.
+    static bool load(const std::string &hash, std::vector<char> &binary) {
+        namespace fs = boost::filesystem;
+
+        std::string fname = program_binaries_path(hash) + "kernel";
+
+        std::ifstream f(fname, std::ios::binary);
+        if (!f) {
+            count(&binary_cache_statistics::misses);
+            return false;
+        }
+
+        std::string magic, checksum;
+        size_t size = 0;
+
+        std::getline(f, magic);
+        f >> size >> checksum;
+        f.get();
+
+        bool valid = f && magic == signature();
+
+        if (valid) {
+            binary.resize(size);
+            f.read(binary.data(), size);
+
+            valid = f && sha1(binary.data(), size) == checksum;
+        }
+
+        if (!valid) {
+            f.close();
+            discard(hash);
+            count(&binary_cache_statistics::misses);
+            return false;
+        }
+
+        // Update access time of the entry for LRU eviction.
+        boost::system::error_code ec;
+        fs::last_write_time(fname, std::time(0), ec);
+
+        count(&binary_cache_statistics::hits);
+        return true;
+    }
+
+    /// Stores the binary under the given hash.
+    /**
+     * Source is appended to the entry for reference.
+     */
+    static void store(const std::string &hash,
+            const char *binary, size_t size, const std::string &source)
+    {
+        namespace fs = boost::filesystem;
+        boost::system::error_code ec;
+
+        std::string dir   = program_binaries_path(hash, true);
+        std::string fname = dir + "kernel";
+        std::string tmp   = dir + "kernel." + fs::unique_path().string();
+
+        {
+            std::ofstream f(tmp, std::ios::binary);
+            if (!f) return;
+
+            f << signature() << "\n" << size << " " << sha1(binary, size) << "\n";
+            f.write(binary, size);
+            f << "\n" << source << "\n";
+
+            if (!f) {
+                f.close();
+                fs::remove(tmp, ec);
+                return;
+            }
+        }
+
+        // Rename is atomic. If it fails (e.g. another process has already
+        // stored the same entry on a platform that does not replace existing
+        // files), the entry written by the other process is used.
+        fs::rename(tmp, fname, ec);
+        if (ec) {
+            fs::remove(tmp, ec);
+            return;
+        }
+
+        count(&binary_cache_statistics::stores);
+
+        account(hash);
+    }
+
+    /// Accounts for the files written under the given hash by other means.
+    /**
+     * Used for the entries produced by external compilers (e.g. ptx files
+     * written by nvcc), so that they are subject to the size budget.
+     */
+    static void record(const std::string &hash) {
+        count(&binary_cache_statistics::stores);
+        account(hash);
+    }
+
+    /// Removes the entry stored under the given hash.
+    static void discard(const std::string &hash) {
+        boost::system::error_code ec;
+        boost::filesystem::remove(program_binaries_path(hash) + "kernel", ec);
+
+        count(&binary_cache_statistics::invalid);
+    }
+
+    /// Size budget of the cache in bytes.
+    static size_t budget() {
+#ifdef _MSC_VER
+#  pragma warning(push)
+#  pragma warning(disable: 4996)
+#endif
+        static const char *env = getenv("VEXCL_CACHE_SIZE");
+#ifdef _MSC_VER
+#  pragma warning(pop)
+#endif
+        static const size_t b = env ? parse_size(env) : (size_t(1) << 30);
+        return b;
+    }
+
+    static binary_cache_statistics statistics() {
+        detail::lock_guard lock(stat_mx());
+        return stat();
+    }
+
+    static void reset_statistics() {
+        detail::lock_guard lock(stat_mx());
+        binary_cache_statistics s = {0, 0, 0, 0, 0};
+        stat() = s;
+    }
+
+    private:
+        static const char* signature() {
+            return "VEXCL-BINARY-CACHE-1";
+        }
+
+        static binary_cache_statistics& stat() {
+            static binary_cache_statistics s = {0, 0, 0, 0, 0};
+            return s;
+        }
+
+        static detail::mutex& stat_mx() {
+            static detail::mutex mx;
+            return mx;
+        }
+
+        static void count(size_t binary_cache_statistics::*field, size_t n = 1) {
+            detail::lock_guard lock(stat_mx());
+            stat().*field += n;
+        }
+
+        static size_t parse_size(const std::string &s) {
+            std::istringstream is(s);
+
+            double v = 0;
+            char   suffix = 0;
+
+            is >> v >> suffix;
+
+            switch (suffix) {
+                case 'g':
+                case 'G':
+                    v *= 1024;
+                    // fall through
+                case 'm':
+                case 'M':
+                    v *= 1024;
+                    // fall through
+                case 'k':
+                case 'K':
+                    v *= 1024;
+            }
+
+            return static_cast<size_t>(v);
+        }
+
+        typedef std::map<std::string, size_t> index_type;
+
+        // Updates size of the entry in the index, evicts old entries when
+        // the budget is exceeded.
+        static void account(const std::string &hash) {
+            namespace ip = boost::interprocess;
+
+            if (!budget()) return;
+
+            // File locks do not synchronize threads of the same process.
+            static detail::mutex mx;
+            detail::lock_guard lock(mx);
+
+            try {
+                std::string lockfile = cache_path() + path_delim() + "lock";
+                std::string index    = cache_path() + path_delim() + "index";
+
+                { std::ofstream f(lockfile, std::ios::app); }
+
+                ip::file_lock flock(lockfile.c_str());
+                ip::scoped_lock<ip::file_lock> flk(flock);
+
+                // The index holds size of each entry, so that entries
+                // stored again are not counted twice.
+                index_type entries;
+                {
+                    std::ifstream f(index);
+
+                    std::string h;
+                    size_t size;
+
+                    while(f >> h >> size) entries[h] = size;
+                }
+
+                entries[hash] = entry_size(program_binaries_path(hash));
+
+                size_t total = 0;
+                for(auto e = entries.begin(); e != entries.end(); ++e)
+                    total += e->second;
+
+                if (total > budget()) entries = evict(hash);
+
+                std::ofstream f(index, std::ios::trunc);
+                for(auto e = entries.begin(); e != entries.end(); ++e)
+                    f << e->first << " " << e->second << "\n";
+            } catch(...) {
+                // Cache accounting is not critical.
+            }
+        }
+
+        struct entry {
+            std::time_t atime;
+            size_t      size;
+            std::string hash;
+            std::string path;
+
+            bool operator<(const entry &e) const {
+                return atime < e.atime;
+            }
+        };
+
+        static bool is_hash_prefix(const std::string &s) {
+            return s.size() == 2 &&
+                std::isxdigit(static_cast<unsigned char>(s[0])) &&
+                std::isxdigit(static_cast<unsigned char>(s[1]));
+        }
+
+        // Total size of the files of the entry, and their last access time.
+        static size_t entry_size(const std::string &dir, std::time_t *atime = 0) {
+            namespace fs = boost::filesystem;
+            boost::system::error_code ec;
+
+            size_t size = 0;
+
+            fs::directory_iterator end;
+            for(fs::directory_iterator f(dir, ec); !ec && f != end; f.increment(ec)) {
+                if (!fs::is_regular_file(f->status())) continue;
+
+                boost::system::error_code ec1;
+
+                size += static_cast<size_t>(fs::file_size(f->path(), ec1));
+                if (atime)
+                    *atime = std::max(*atime, fs::last_write_time(f->path(), ec1));
+            }
+
+            return size;
+        }
+
+        // Removes least recently used entries (except the current one) until
+        // the cache size is reduced to 90% of the budget. Returns the index
+        // of the remaining entries, rebuilt from the cache contents.
+        static index_type evict(const std::string &current) {
+            namespace fs = boost::filesystem;
+            boost::system::error_code ec;
+
+            std::vector<entry> entries;
+            size_t total = 0;
+
+            fs::directory_iterator end;
+            boost::system::error_code ec1, ec2;
+
+            for(fs::directory_iterator d1(cache_path(), ec1); !ec1 && d1 != end; d1.increment(ec1)) {
+                if (!fs::is_directory(d1->status()) || !is_hash_prefix(d1->path().filename().string()))
+                    continue;
+
+                for(fs::directory_iterator d2(d1->path(), ec2); !ec2 && d2 != end; d2.increment(ec2)) {
+                    if (!fs::is_directory(d2->status())) continue;
+
+                    entry e = {0, 0,
+                        d1->path().filename().string() + d2->path().filename().string(),
+                        d2->path().string()};
+
+                    e.size = entry_size(e.path, &e.atime);
+
+                    total += e.size;
+                    entries.push_back(e);
+                }
+            }
+
+            std::sort(entries.begin(), entries.end());
+
+            const size_t target = budget() / 10 * 9;
+
+            index_type index;
+            size_t evicted = 0;
+
+            for(auto e = entries.begin(); e != entries.end(); ++e) {
+                if (total > target && e->hash != current) {
+                    fs::remove_all(e->path, ec);
+
+                    if (!ec) {
+                        total -= e->size;
+                        ++evicted;
+                        continue;
+                    }
+                }
+
+                index[e->hash] = e->size;
+            }
+
+            count(&binary_cache_statistics::evictions, evicted);
+
+            return index;
+        }
+};
+
+/// \endcond
+
+/// Returns statistics of the offline binary cache for the current process.
+inline binary_cache_statistics binary_cache_stats() {
+    return binary_cache<>::statistics();
+}
+
+/// Resets statistics of the offline binary cache.
+inline void reset_binary_cache_stats() {
+    binary_cache<>::reset_statistics();
+}
+
+} // namespace vex
+
+#endif
@@ -33,6 +33,7 @@ THE SOFTWARE.
 
 #include <vector>
 #include <map>
+#include <memory>
 
 #include <fstream>
 #include <sstream>
@@ -42,6 +43,8 @@ THE SOFTWARE.
 #include <boost/optional.hpp>
 #include <boost/filesystem.hpp>
 
+#include <vexcl/detail/mutex.hpp>
+
 namespace vex {
 
 /// \cond INTERNAL
@@ -53,29 +56,39 @@ enum device_options_kind {
 /// Global program options holder
 template <device_options_kind kind>
 struct device_options {
-    static const std::string& get(const backend::command_queue &q) {
+    static std::string get(const backend::command_queue &q) {
         auto dev = backend::get_device_id(q);
+
+        detail::lock_guard lock(mx);
         if (options[dev].empty()) options[dev].push_back("");
         return options[dev].back();
     }
 
     static void push(const backend::command_queue &q, const std::string &str) {
         auto dev = backend::get_device_id(q);
+
+        detail::lock_guard lock(mx);
         options[dev].push_back(str);
     }
 
     static void pop(const backend::command_queue &q) {
         auto dev = backend::get_device_id(q);
+
+        detail::lock_guard lock(mx);
         if (!options[dev].empty()) options[dev].pop_back();
     }
 
     private:
         static std::map<backend::device_id, std::vector<std::string> > options;
+        static detail::mutex mx;
 };
 
 template <device_options_kind kind>
 std::map<backend::device_id, std::vector<std::string> > device_options<kind>::options;
 
+template <device_options_kind kind>
+detail::mutex device_options<kind>::mx;
+
 inline std::string get_compile_options(const backend::command_queue &q) {
     return device_options<compile_options>::get(q);
 }
@@ -161,20 +174,38 @@ inline const std::string& appdata_path() {
     return appdata;
 }
 
+/// Path to the offline kernel cache.
+/**
+ * Defaults to appdata_path(). May be changed with VEXCL_CACHE_DIR environment
+ * variable.
+ */
+inline const std::string& cache_path() {
+#ifdef _MSC_VER
+#  pragma warning(push)
+#  pragma warning(disable: 4996)
+#endif
+    static const char *env = getenv("VEXCL_CACHE_DIR");
+#ifdef _MSC_VER
+#  pragma warning(pop)
+#endif
+    static const std::string path = (env && *env) ? std::string(env) : appdata_path();
+    return path;
+}
+
 /// Path to cached binaries.
 inline std::string program_binaries_path(const std::string &hash, bool create = false)
 {
-    std::string dir = appdata_path()    + path_delim()
+    std::string dir = cache_path()      + path_delim()
                     + hash.substr(0, 2) + path_delim()
                     + hash.substr(2);
     if (create) boost::filesystem::create_directories(dir);
     return dir + path_delim();
 }
 
-/// Returns SHA1 hash of the string parameter.
-inline std::string sha1(const std::string &src) {
+/// Returns SHA1 hash of the memory block.
+inline std::string sha1(const char *data, size_t size) {
     boost::uuids::detail::sha1 sha1;
-    sha1.process_bytes(src.c_str(), src.size());
+    sha1.process_bytes(data, size);
 
     unsigned int hash[5];
     sha1.get_digest(hash);
@@ -186,6 +217,92 @@ inline std::string sha1(const std::string &src) {
     return buf.str();
 }
 
+/// Returns SHA1 hash of the string parameter.
+inline std::string sha1(const std::string &src) {
+    return sha1(src.c_str(), src.size());
+}
+
+/// \cond INTERNAL
+
+/// Programs compiled in the current process.
+/**
+ * Programs are keyed by context and SHA1 hash of the source, so that
+ * identical sources are compiled (or loaded from the offline cache) only once
+ * per context and are shared between kernel caches.
+ */
+template <class Program>
+struct program_table {
+    template <class Builder>
+    static Program get(backend::kernel_cache_key ctx,
+            const std::string &hash, Builder &&build)
+    {
+        std::shared_ptr<slot> s;
+        {
+            detail::lock_guard lock(mx);
+            auto &p = programs[std::make_pair(ctx, hash)];
+            if (!p) p = std::make_shared<slot>();
+            s = p;
+        }
+
+        detail::lock_guard lock(s->mx);
+        if (!s->program) s->program = build();
+        return *s->program;
+    }
+
+    /// Adds a prebuilt program (unless the program is already known).
+    static void insert(backend::kernel_cache_key ctx,
+            const std::string &hash, const Program &program)
+    {
+        detail::lock_guard lock(mx);
+
+        auto &p = programs[std::make_pair(ctx, hash)];
+        if (!p) p = std::make_shared<slot>();
+
+        detail::lock_guard slock(p->mx);
+        if (!p->program) p->program = program;
+    }
+
+    static void clear() {
+        detail::lock_guard lock(mx);
+        programs.clear();
+    }
+
+    static void erase(backend::kernel_cache_key ctx) {
+        detail::lock_guard lock(mx);
+
+        for(auto p = programs.begin(); p != programs.end(); ) {
+            if (p->first.first == ctx)
+                programs.erase(p++);
+            else
+                ++p;
+        }
+    }
+
+    private:
+        struct slot {
+            detail::mutex mx;
+            boost::optional<Program> program;
+        };
+
+        static std::map<
+            std::pair<backend::kernel_cache_key, std::string>,
+            std::shared_ptr<slot>
+            > programs;
+
+        static detail::mutex mx;
+};
+
+template <class Program>
+std::map<
+    std::pair<backend::kernel_cache_key, std::string>,
+    std::shared_ptr<typename program_table<Program>::slot>
+    > program_table<Program>::programs;
+
+template <class Program>
+detail::mutex program_table<Program>::mx;
+
+/// \endcond
+
 } // namespace vex
 
 
@@ -32,16 +32,85 @@ THE SOFTWARE.
  */
 
 #include <cstdlib>
+#include <memory>
+#include <type_traits>
 #include <cuda.h>
 
 #include <vexcl/backend/common.hpp>
+#include <vexcl/backend/binary_cache.hpp>
+#include <vexcl/backend/kernel_pack.hpp>
+#include <vexcl/backend/cuda/context.hpp>
 
 namespace vex {
 namespace backend {
 namespace cuda {
 
+/// Compiled module handle.
+typedef std::shared_ptr<std::remove_pointer<CUmodule>::type> program;
+
+/// Modules built in the current process.
+typedef program_table<program> program_cache;
+
+/// Identifies device and driver a module was compiled for.
+inline std::string device_signature(const device &dev) {
+    int driver = 0;
+    cuda_check( cuDriverGetVersion(&driver) );
+
+    auto cc = dev.compute_capability();
+
+    std::ostringstream s;
+    s << dev.name() << " / sm_" << std::get<0>(cc) << std::get<1>(cc)
+      << " / " << driver;
+
+    return s.str();
+}
+
+/// Identifies device and driver of the command queue.
+inline std::string device_signature(const command_queue &q) {
+    return device_signature(q.device());
+}
+
+/// Creates modules from the kernel pack for each of the given queues.
+/**
+ * Kernel packs for the CUDA backend hold PTX, so only the entries recorded
+ * for the matching device and driver are used. Returns the number of created
+ * modules.
+ */
+inline size_t load_kernel_pack(
+        const std::vector<command_queue> &queue, const std::string &fname
+        )
+{
+    kernel_pack_reader pack(fname);
+
+    size_t loaded = 0;
+
+    for(auto q = queue.begin(); q != queue.end(); ++q) {
+        auto sig = device_signature(q->device());
+
+        select_context(*q);
+
+        for(auto e = pack.entry().begin(); e != pack.entry().end(); ++e) {
+            if (e->device != sig) continue;
+
+            // cuModuleLoadData expects null-terminated PTX.
+            std::string ptx(e->data, e->size);
+
+            CUmodule module;
+            if (CUDA_SUCCESS != cuModuleLoadData(&module, ptx.c_str())) continue;
+
+            program_cache::insert(cache_key(*q), e->hash, program(module, detail::deleter()));
+            ++loaded;
+        }
+    }
+
+    return loaded;
+}
+
 /// Create and build a program from source string.
-inline CUmodule build_sources(
+/**
+ * Identical sources are only built once per context.
+ */
+inline program build_sources(
         const command_queue &queue, const std::string &source,
         const std::string &options = ""
         )
@@ -67,41 +136,58 @@ inline CUmodule build_sources(
             << "// options: " << options << "\n"
             << source;
 
-    // Write source to a .cu file
     std::string hash = sha1( fullsrc.str() );
-    std::string basename = program_binaries_path(hash, true) + "kernel";
-    std::string ptxfile  = basename + ".ptx";
-
-    if ( !boost::filesystem::exists(ptxfile) ) {
-        std::string cufile = basename + ".cu";
 
-
-        {
-            std::ofstream f(basename + ".cu");
-            f << fullsrc.str();
-        }
-
-        // Compile the source to ptx.
-        std::ostringstream cmdline;
-        auto cc = queue.device().compute_capability();
-        cmdline
-            << "nvcc -ptx -O3"
-            << " -arch=sm_" << std::get<0>(cc) << std::get<1>(cc)
-            << " " << options
-            << " -o " << ptxfile << " " << cufile;
-        if (0 != system(cmdline.str().c_str()) ) {
+    std::string ptxfile = program_binaries_path(hash, true) + "kernel.ptx";
+
+    program module = program_cache::get(cache_key(queue), hash, [&]() -> program {
+        // Write source to a .cu file
+        std::string basename = program_binaries_path(hash, true) + "kernel";
+
+        if ( !boost::filesystem::exists(ptxfile) ) {
+            std::string cufile = basename + ".cu";
+
+            {
+                std::ofstream f(basename + ".cu");
+                f << fullsrc.str();
+            }
+
+            // Compile the source to ptx.
+            std::ostringstream cmdline;
+            auto cc = queue.device().compute_capability();
+            cmdline
+                << "nvcc -ptx -O3"
+                << " -arch=sm_" << std::get<0>(cc) << std::get<1>(cc)
+                << " " << options
+                << " -o " << ptxfile << " " << cufile;
+            if (0 != system(cmdline.str().c_str()) ) {
 #ifndef VEXCL_SHOW_KERNELS
-            std::cerr << fullsrc.str() << std::endl;
+                std::cerr << fullsrc.str() << std::endl;
 #endif
-            throw std::runtime_error("nvcc invocation failed");
+                throw std::runtime_error("nvcc invocation failed");
+            }
+
+            binary_cache<>::record(hash);
         }
-    }
 
-    // Load the compiled ptx.
-    CUmodule program;
-    cuda_check( cuModuleLoad(&program, ptxfile.c_str()) );
+        // Load the compiled ptx.
+        CUmodule module;
+        cuda_check( cuModuleLoad(&module, ptxfile.c_str()) );
+
+        return program(module, detail::deleter());
+    });
+
+    if (kernel_pack_recorder<>::wants(hash)) {
+        std::ifstream f(ptxfile, std::ios::binary);
+        std::vector<char> ptx(
+                (std::istreambuf_iterator<char>(f)), std::istreambuf_iterator<char>());
+
+        if (!ptx.empty())
+            kernel_pack_recorder<>::add(hash, device_signature(queue.device()),
+                    ptx.data(), ptx.size());
+    }
 
-    return program;
+    return module;
 }
 
 } // namespace cuda
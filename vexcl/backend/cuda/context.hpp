@@ -78,6 +78,13 @@ struct deleter_impl<CUstream> {
     }
 };
 
+template <>
+struct deleter_impl<CUevent> {
+    static void dispose(CUevent event) {
+        cuda_check( cuEventDestroy(event) );
+    }
+};
+
 // Knows how to dispose of various CUDA handles.
 struct deleter {
     template <class Handle>
@@ -231,6 +238,47 @@ class command_queue {
         }
 };
 
+/// Marker in a command queue.
+/** With the CUDA backend, this is a wrapper around CUevent. */
+class event {
+    public:
+        /// Empty constructor.
+        event() {}
+
+        /// Records the event in the command queue.
+        /**
+         * The event completes when all previously queued commands in the
+         * queue have completed.
+         */
+        event(const command_queue &q)
+            : ctx(q.context()), e( create(q), detail::deleter() )
+        { }
+
+        /// Blocks until the event completes.
+        void wait() const {
+            ctx.set_current();
+            cuda_check( cuEventSynchronize( e.get() ) );
+        }
+
+        /// Returns raw CUevent handle.
+        CUevent raw() const {
+            return e.get();
+        }
+    private:
+        vex::backend::context ctx;
+        std::shared_ptr<std::remove_pointer<CUevent>::type> e;
+
+        static CUevent create(const command_queue &q) {
+            q.context().set_current();
+
+            CUevent e;
+            cuda_check( cuEventCreate(&e, CU_EVENT_DISABLE_TIMING) );
+            cuda_check( cuEventRecord(e, q.raw()) );
+
+            return e;
+        }
+};
+
 /// Binds the specified CUDA context to the calling CPU thread.
 inline void select_context(const command_queue &q) {
     q.context().set_current();
@@ -254,6 +302,11 @@ inline kernel_cache_key cache_key(const command_queue &q) {
 }
 /// \endcond
 
+/// Checks if both objects refer to the same command queue.
+inline bool same_queue(const command_queue &a, const command_queue &b) {
+    return a.raw() == b.raw();
+}
+
 /// Create command queue on the same context and device as the given one.
 inline command_queue duplicate_queue(const command_queue &q) {
     return command_queue(q.context(), q.device(), q.flags());
@@ -267,6 +320,15 @@ inline bool is_cpu(const command_queue&) {
     return false;
 }
 
+/// Preferred width of native vector types on the compute device.
+/**
+ * Always returns 1 with the CUDA backend.
+ */
+template <typename T>
+inline unsigned preferred_vector_width(const command_queue&) {
+    return 1;
+}
+
 /// Select devices by given criteria.
 /**
  * \param filter  Device filter functor. Functors may be combined with logical
@@ -9,6 +9,7 @@
 #include <vexcl/vector.hpp>
 #include <vexcl/backend/cuda/error.hpp>
 #include <vexcl/backend/cuda/context.hpp>
+#include <vexcl/detail/mutex.hpp>
 
 namespace vex {
 namespace backend {
@@ -70,8 +71,11 @@ struct deleter_impl<cusparseHybMat_t> {
 inline cusparseHandle_t cusparse_handle(const command_queue &q) {
     typedef std::shared_ptr<std::remove_pointer<cusparseHandle_t>::type> smart_handle;
     static std::map< kernel_cache_key, smart_handle > cache;
+    static vex::detail::mutex mx;
 
     auto key = cache_key(q);
+
+    vex::detail::lock_guard lock(mx);
     auto h   = cache.find(key);
 
     if (h == cache.end()) {
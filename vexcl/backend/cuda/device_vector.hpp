@@ -34,6 +34,8 @@ THE SOFTWARE.
 #include <cuda.h>
 
 #include <vexcl/backend/cuda/context.hpp>
+#include <vexcl/backend/memory_pool.hpp>
+#include <vexcl/backend/memory_tracker.hpp>
 
 namespace vex {
 namespace backend {
@@ -50,6 +52,11 @@ static const mem_flags MEM_READ_ONLY  = 1;
 static const mem_flags MEM_WRITE_ONLY = 2;
 static const mem_flags MEM_READ_WRITE = 4;
 
+/// Checks if buffers created with the flags use host memory as storage.
+inline bool uses_host_ptr(mem_flags) {
+    return false;
+}
+
 /// \cond INTERNAL
 namespace detail {
 
@@ -60,7 +67,65 @@ struct deleter_impl<char*> {
     }
 };
 
+// Frees device memory; keeps the context alive while the memory is cached.
+struct device_memory_deleter {
+    context ctx;
+
+    device_memory_deleter(const context &ctx) : ctx(ctx) {}
+
+    void operator()(char *ptr) const {
+        ctx.set_current();
+        deleter_impl<char*>::dispose(ptr);
+    }
+};
+
 } // namespace detail
+
+/// Page-locked host memory used for staging of host-device transfers.
+class pinned_buffer {
+    public:
+        pinned_buffer(const command_queue &q, size_t bytes) : ctx(q.context()) {
+            ctx.set_current();
+
+            void *p;
+            cuda_check( cuMemAllocHost(&p, bytes) );
+            ptr = static_cast<char*>(p);
+        }
+
+        ~pinned_buffer() {
+            cuCtxSetCurrent(ctx.raw());
+            cuMemFreeHost(ptr);
+        }
+
+        char* data() const {
+            return ptr;
+        }
+    private:
+        context ctx;
+        char *ptr;
+
+        pinned_buffer(const pinned_buffer&);
+        pinned_buffer& operator=(const pinned_buffer&);
+};
+
+/// Key of the device memory pool buckets.
+struct memory_pool_key {
+    command_queue queue;
+
+    memory_pool_key(const command_queue &queue) : queue(queue) {}
+
+    bool operator<(const memory_pool_key &k) const {
+        return queue.raw() < k.queue.raw();
+    }
+};
+
+/// Pool of device buffers (see vex::memory_pool).
+typedef vex::memory_pool<
+            memory_pool_key, std::shared_ptr<char>
+            > device_memory_pool;
+
+/// Accounting of device allocations (see vex::memory_tracker).
+typedef vex::memory_tracker<CUdevice> device_memory_tracker;
 /// \endcond
 
 /// Wrapper around CUdeviceptr.
@@ -75,14 +140,7 @@ class device_vector {
 
         /// Allocates memory buffer on the device associated with the given queue.
         device_vector(const command_queue &q, size_t n) : n(n) {
-            if (n) {
-                q.context().set_current();
-
-                CUdeviceptr ptr;
-                cuda_check( cuMemAlloc(&ptr, n * sizeof(T)) );
-
-                buffer.reset(reinterpret_cast<char*>(static_cast<size_t>(ptr)), detail::deleter() );
-            }
+            if (n) allocate(q, n * sizeof(T));
         }
 
         /// Allocates memory buffer on the device associated with the given queue.
@@ -94,12 +152,7 @@ class device_vector {
             (void)flags;
 
             if (n) {
-                q.context().set_current();
-
-                CUdeviceptr ptr;
-                cuda_check( cuMemAlloc(&ptr, n * sizeof(T)) );
-
-                buffer.reset(reinterpret_cast<char*>(static_cast<size_t>(ptr)), detail::deleter() );
+                allocate(q, n * sizeof(T));
 
                 if (host) {
                     if (std::is_same<T, H>::value)
@@ -111,26 +164,36 @@ class device_vector {
         }
 
         /// Copies data from host memory to device.
+        /**
+         * Non-blocking copies are only asynchronous for page-locked host
+         * memory. When event is given, it is recorded after the copy.
+         */
         void write(const command_queue &q, size_t offset, size_t size, const T *host,
-                bool blocking = false) const
+                bool blocking = false, event *e = 0) const
         {
-            (void)blocking;
-
             if (size) {
                 q.context().set_current();
-                cuda_check( cuMemcpyHtoD(raw() + offset * sizeof(T), host, size * sizeof(T)) );
+                cuda_check( cuMemcpyHtoDAsync(raw() + offset * sizeof(T), host, size * sizeof(T), q.raw()) );
+
+                if (blocking) q.finish();
+                if (e) *e = event(q);
             }
         }
 
         /// Copies data from device to host memory.
+        /**
+         * Non-blocking copies are only asynchronous for page-locked host
+         * memory. When event is given, it is recorded after the copy.
+         */
         void read(const command_queue &q, size_t offset, size_t size, T *host,
-                bool blocking = false) const
+                bool blocking = false, event *e = 0) const
         {
-            (void)blocking;
-
             if (size) {
                 q.context().set_current();
-                cuda_check( cuMemcpyDtoH(host, raw() + offset * sizeof(T), size * sizeof(T)) );
+                cuda_check( cuMemcpyDtoHAsync(host, raw() + offset * sizeof(T), size * sizeof(T), q.raw()) );
+
+                if (blocking) q.finish();
+                if (e) *e = event(q);
             }
         }
 
@@ -189,6 +252,43 @@ class device_vector {
     private:
         std::shared_ptr<char> buffer;
         size_t n;
+
+        // Releases the allocation record when the last copy is destroyed.
+        device_memory_tracker::token usage;
+
+        void allocate(const command_queue &q, size_t bytes) {
+#ifndef VEXCL_DISABLE_MEMORY_TRACKING
+            usage = device_memory_tracker::instance().allocate(
+                    q.device().raw(), [&q]() { return q.device().name(); }, bytes);
+#endif
+            buffer = allocate_buffer(q, bytes);
+        }
+
+        static std::shared_ptr<char> allocate_buffer(const command_queue &q, size_t bytes) {
+            context ctx = q.context();
+
+            auto alloc = [&](size_t bytes) {
+                ctx.set_current();
+
+                CUdeviceptr ptr;
+                cuda_check( cuMemAlloc(&ptr, bytes) );
+
+                return std::shared_ptr<char>(
+                        reinterpret_cast<char*>(static_cast<size_t>(ptr)),
+                        detail::device_memory_deleter(ctx)
+                        );
+            };
+
+#ifdef VEXCL_DISABLE_MEMORY_POOL
+            return alloc(bytes);
+#else
+            // The lease returns the memory to the pool when the last copy
+            // of the vector is destroyed.
+            device_memory_pool::lease l = device_memory_pool::instance().get(
+                    memory_pool_key(q), bytes, alloc);
+            return std::shared_ptr<char>(l, l->get());
+#endif
+        }
 };
 
 } // namespace cuda
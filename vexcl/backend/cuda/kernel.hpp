@@ -32,10 +32,13 @@ THE SOFTWARE.
  */
 
 #include <functional>
+#include <vector>
+#include <string>
 
 #include <cuda.h>
 
 #include <vexcl/backend/cuda/compiler.hpp>
+#include <vexcl/backend/autotune.hpp>
 
 namespace vex {
 namespace backend {
@@ -46,7 +49,10 @@ namespace cuda {
 /// An abstraction over CUDA compute kernel.
 class kernel {
     public:
-        kernel() : w_size(0), g_size(0), smem(0) {}
+        kernel()
+            : w_size(0), g_size(0), def_w_size(0), def_g_size(0), smem(0),
+              tuned_n(0), timed(-1)
+        {}
 
         /// Constructor. Creates a cl::Kernel instance from source.
         kernel(const command_queue &queue,
@@ -55,8 +61,8 @@ class kernel {
                size_t smem_per_thread = 0
                )
             : ctx(queue.context()),
-              module(build_sources(queue, src), detail::deleter()),
-              smem(0)
+              module(build_sources(queue, src)),
+              smem(0), tune_key(autotuner<>::enabled() ? tuning_key(src, name) : tuning_key()), tuned_n(0), timed(-1)
         {
             cuda_check( cuModuleGetFunction(&K, module.get(), name.c_str()) );
 
@@ -70,13 +76,29 @@ class kernel {
                std::function<size_t(size_t)> smem
                )
             : ctx(queue.context()),
-              module(build_sources(queue, src), detail::deleter()),
-              smem(0)
+              module(build_sources(queue, src)),
+              smem(0), tune_key(autotuner<>::enabled() ? tuning_key(src, name) : tuning_key()), tuned_n(0), timed(-1)
         {
             cuda_check( cuModuleGetFunction(&K, module.get(), name.c_str()) );
             config(queue, smem);
         }
 
+        /// Creates an independent copy of the kernel.
+        /**
+         * The copy shares the compiled module, but has its own argument
+         * state, so that it may be launched concurrently with the original.
+         */
+        kernel clone() const {
+            kernel k(*this);
+
+            k.stack.clear();
+            k.prm_pos.clear();
+            k.prm_addr.clear();
+            k.timed = -1;
+
+            return k;
+        }
+
         /// Adds an argument to the kernel.
         template <class Arg>
         void push_arg(const Arg &arg) {
@@ -103,6 +125,12 @@ class kernel {
             for(auto p = prm_pos.begin(); p != prm_pos.end(); ++p)
                 prm_addr.push_back(stack.data() + *p);
 
+            double t = 0;
+            if (timed >= 0) {
+                q.finish();
+                t = autotuner<>::now();
+            }
+
             cuda_check(
                     cuLaunchKernel(
                         K,
@@ -115,6 +143,12 @@ class kernel {
                         )
                     );
 
+            if (timed >= 0) {
+                q.finish();
+                autotuner<>::report(key(q), tuned_n, timed, autotuner<>::now() - t);
+                timed = -1;
+            }
+
             stack.clear();
             prm_pos.clear();
         }
@@ -134,6 +168,11 @@ class kernel {
             return w_size;
         }
 
+        /// Number of workgroups in the current launch configuration.
+        size_t num_groups() const {
+            return g_size;
+        }
+
         /// Standard number of workgroups to launch on a device.
         static inline size_t num_workgroups(const command_queue &q) {
             return 8 * q.device().multiprocessor_count();
@@ -154,6 +193,8 @@ class kernel {
 
         /// Select best launch configuration for the given shared memory requirements.
         void config(const command_queue &q, std::function<size_t(size_t)> smem) {
+            smem_fn = smem;
+
             // Select workgroup size that would fit into the device.
             w_size = q.device().max_threads_per_block() / 2;
 
@@ -165,6 +206,9 @@ class kernel {
                 w_size /= 2;
 
             g_size = num_workgroups(q);
+
+            def_w_size = w_size;
+            def_g_size = g_size;
         }
 
         /// Set launch configuration.
@@ -172,6 +216,33 @@ class kernel {
             g_size = blocks;
             w_size = threads;
         }
+
+        /// Lets the autotuner select launch configuration for the next launch.
+        /**
+         * Should only be called for kernels that give the same result with
+         * any launch configuration (e.g. kernels with grid-stride loops), and
+         * before the shared memory is set. The default launch configuration is
+         * used unless autotuning is enabled (see vex::autotune()) and the
+         * kernel was built while it was enabled. Zero limits mean no limit.
+         */
+        void tune(const command_queue &q, size_t n,
+                size_t max_groups = 0, size_t max_wgsize = 0)
+        {
+            // Configurations selected for earlier launches do not persist.
+            w_size = def_w_size;
+            g_size = def_g_size;
+
+            if (tune_key.empty() || !autotuner<>::enabled()) return;
+
+            launch_config c;
+            timed = autotuner<>::select(key(q), n, [&]() {
+                        return candidates(q, max_groups, max_wgsize);
+                    }, c);
+
+            if (c.groups && c.wgsize) config(c.groups, c.wgsize);
+
+            tuned_n = n;
+        }
     private:
         context ctx;
         std::shared_ptr< std::remove_pointer<CUmodule>::type > module;
@@ -179,12 +250,58 @@ class kernel {
 
         size_t   w_size;
         size_t   g_size;
+
+        // Launch configuration selected by config(queue, smem).
+        size_t   def_w_size;
+        size_t   def_g_size;
+
         size_t   smem;
 
         std::vector<char>   stack;
         std::vector<size_t> prm_pos;
         std::vector<void*>  prm_addr;
 
+        std::function<size_t(size_t)> smem_fn;
+
+        tuning_key  tune_key;
+        size_t      tuned_n;
+        int         timed;
+
+        const std::string& key(const command_queue &q) const {
+            return tune_key.get([&]() { return device_signature(q.device()); });
+        }
+
+        // Launch configurations to try: block sizes around the heuristic
+        // one, and grids of 1 to 32 blocks per multiprocessor.
+        std::vector<launch_config> candidates(const command_queue &q,
+                size_t max_groups, size_t max_wgsize) const
+        {
+            size_t mp       = q.device().multiprocessor_count();
+            size_t w0       = q.device().max_threads_per_block() / 2;
+            size_t max_ws   = max_threads_per_block(q);
+            size_t max_smem = max_shared_memory_per_block(q);
+
+            size_t ws[] = {w0 / 4, w0 / 2, w0, w0 * 2};
+
+            std::vector<launch_config> c;
+            for(size_t i = 0; i < 4; ++i) {
+                size_t w = ws[i];
+
+                if (!w || w > max_ws) continue;
+                if (smem_fn && smem_fn(w) > max_smem) continue;
+                if (max_wgsize && w > max_wgsize) continue;
+
+                for(size_t g = mp; g <= 32 * mp; g *= 2) {
+                    if (max_groups && g > max_groups) break;
+
+                    launch_config cfg = {g, w};
+                    c.push_back(cfg);
+                }
+            }
+
+            return c;
+        }
+
         size_t shared_size_bytes() const {
             int n;
             cuda_check( cuFuncGetAttribute(&n, CU_FUNC_ATTRIBUTE_SHARED_SIZE_BYTES, K) );
@@ -0,0 +1,222 @@
+#ifndef VEXCL_BACKEND_DEVICE_WEIGHTS_HPP
+#define VEXCL_BACKEND_DEVICE_WEIGHTS_HPP
+
+/*
+The MIT License
+
+Copyright (c) 2012-2014 Denis Demidov <dennis.demidov@gmail.com>
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+
+/**
+ * \file   vexcl/backend/device_weights.hpp
+ * \author Denis Demidov <dennis.demidov@gmail.com>
+ * \brief  On-disk cache of device weights used for partitioning.
+ */
+
+#include <string>
+#include <map>
+#include <fstream>
+#include <iomanip>
+#include <ctime>
+#include <cstdlib>
+
+#include <boost/filesystem.hpp>
+#include <boost/interprocess/sync/file_lock.hpp>
+#include <boost/interprocess/sync/scoped_lock.hpp>
+
+#include <vexcl/backend/common.hpp>
+#include <vexcl/detail/mutex.hpp>
+
+namespace vex {
+
+/// \cond INTERNAL
+
+/// Device weights measured by earlier runs.
+/**
+ * Weights are stored in cache_path()/device_weights and are keyed by SHA1
+ * hash of the device signature (platform, device name, and driver version),
+ * so that a driver update invalidates them. Entries older than
+ * VEXCL_DEVICE_WEIGHTS_TTL hours (168 by default) are ignored; zero TTL
+ * disables the cache.
+ *
+ * The file is accessed under an interprocess file lock. New weights are
+ * appended to it; the file is compacted to the latest unexpired entry of
+ * each device when it is loaded.
+ */
+template <bool dummy = true>
+struct device_weight_cache {
+    static_assert(dummy, "dummy parameter should be true");
+
+    static bool enabled() {
+        return ttl() > 0;
+    }
+
+    /// Looks up the weight of the device with the given signature.
+    static bool load(const std::string &signature, double &weight) {
+        if (!enabled()) return false;
+
+        state &s = get();
+        detail::lock_guard lock(s.mx);
+
+        auto r = s.db.find(sha1(signature));
+        if (r == s.db.end()) return false;
+
+        if (std::difftime(std::time(0), r->second.second) > ttl() * 3600.0)
+            return false;
+
+        weight = r->second.first;
+        return true;
+    }
+
+    /// Stores the weight of the device with the given signature.
+    static void store(const std::string &signature, double weight) {
+        if (!enabled()) return;
+
+        state &s = get();
+        detail::lock_guard lock(s.mx);
+
+        std::string key = sha1(signature);
+        std::time_t now = std::time(0);
+
+        s.db[key] = std::make_pair(weight, now);
+
+        // Results of concurrent processes are appended; the last one read
+        // wins.
+        locked([&]() {
+            std::ofstream f(fname(), std::ios::app);
+            write(f, key, s.db[key]);
+        });
+    }
+
+    /// Forgets the stored weights, so that they are measured again.
+    /**
+     * Both the weights loaded by this process and the stored file are
+     * cleared.
+     */
+    static void invalidate() {
+        state &s = get();
+        detail::lock_guard lock(s.mx);
+
+        s.db.clear();
+
+        if (enabled())
+            locked([]() { std::ofstream f(fname(), std::ios::trunc); });
+    }
+
+    private:
+        typedef std::pair<double, std::time_t> record;
+
+        struct state {
+            detail::mutex mx;
+            std::map<std::string, record> db;
+
+            state() {
+                if (!enabled()) return;
+
+                locked([&]() {
+                    size_t lines = 0;
+                    {
+                        std::ifstream f(fname());
+
+                        std::string key;
+                        double w;
+                        long long t;
+
+                        for(; f >> key >> w >> t; ++lines)
+                            db[key] = record(w, static_cast<std::time_t>(t));
+                    }
+
+                    // Drop the expired entries, and rewrite the file if
+                    // it has any superseded or expired lines.
+                    std::time_t now = std::time(0);
+                    for(auto r = db.begin(); r != db.end(); ) {
+                        if (std::difftime(now, r->second.second) > ttl() * 3600.0)
+                            db.erase(r++);
+                        else
+                            ++r;
+                    }
+
+                    if (lines > db.size()) {
+                        std::ofstream f(fname(), std::ios::trunc);
+                        for(auto r = db.begin(); r != db.end(); ++r)
+                            write(f, r->first, r->second);
+                    }
+                });
+            }
+        };
+
+        static state& get() {
+            static state s;
+            return s;
+        }
+
+        static std::string fname() {
+            return cache_path() + path_delim() + "device_weights";
+        }
+
+        static void write(std::ostream &f, const std::string &key, const record &r) {
+            f << key << " " << std::setprecision(17) << r.first << " "
+              << static_cast<long long>(r.second) << std::endl;
+        }
+
+        // Calls f() under the interprocess lock of the file. Should be
+        // called under the lock of the state (file locks do not synchronize
+        // threads of the same process).
+        template <class F>
+        static void locked(F &&f) {
+            namespace ip = boost::interprocess;
+
+            try {
+                boost::system::error_code ec;
+                boost::filesystem::create_directories(cache_path(), ec);
+
+                std::string lockfile = fname() + ".lock";
+                { std::ofstream l(lockfile, std::ios::app); }
+
+                ip::file_lock flock(lockfile.c_str());
+                ip::scoped_lock<ip::file_lock> lock(flock);
+
+                f();
+            } catch(...) {
+                // The weights may always be measured again.
+            }
+        }
+
+        static double ttl() {
+#ifdef _MSC_VER
+#  pragma warning(push)
+#  pragma warning(disable: 4996)
+#endif
+            static const char *env = getenv("VEXCL_DEVICE_WEIGHTS_TTL");
+#ifdef _MSC_VER
+#  pragma warning(pop)
+#endif
+            static const double hours = env ? atof(env) : 168.0;
+            return hours;
+        }
+};
+
+/// \endcond
+
+} // namespace vex
+
+#endif
@@ -0,0 +1,255 @@
+#ifndef VEXCL_BACKEND_KERNEL_PACK_HPP
+#define VEXCL_BACKEND_KERNEL_PACK_HPP
+
+/*
+The MIT License
+
+Copyright (c) 2012-2014 Denis Demidov <dennis.demidov@gmail.com>
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+/**
+ * \file   vexcl/backend/kernel_pack.hpp
+ * \author Denis Demidov <dennis.demidov@gmail.com>
+ * \brief  Single-file archive of compiled program binaries.
+ */
+
+#include <string>
+#include <vector>
+#include <map>
+#include <fstream>
+#include <sstream>
+#include <cstdlib>
+#include <cstring>
+
+#include <boost/filesystem.hpp>
+#include <boost/interprocess/file_mapping.hpp>
+#include <boost/interprocess/mapped_region.hpp>
+
+#include <vexcl/util.hpp>
+#include <vexcl/backend/common.hpp>
+#include <vexcl/detail/mutex.hpp>
+
+namespace vex {
+
+/// \cond INTERNAL
+
+/// Program binary stored in a kernel pack.
+struct kernel_pack_entry {
+    std::string hash;     ///< SHA1 hash of the program source (see build_sources()).
+    std::string device;   ///< Signature of the device the binary was built for.
+    const char *data;
+    size_t      size;
+};
+
+/// Memory-mapped kernel pack.
+/**
+ * Pack layout:
+ \verbatim
+ VEXCL-KERNEL-PACK-1
+ <number of entries>
+ <hash>\n<device>\n<size>\n<binary>\n   (repeated for each entry)
+ \endverbatim
+ */
+class kernel_pack_reader {
+    public:
+        explicit kernel_pack_reader(const std::string &fname)
+            : file(fname.c_str(), boost::interprocess::read_only),
+              region(file, boost::interprocess::read_only)
+        {
+            const char *pos = static_cast<const char*>(region.get_address());
+            const char *end = pos + region.get_size();
+
+            precondition(line(pos, end) == signature(), "Not a kernel pack: " + fname);
+
+            size_t n = to_size(line(pos, end));
+            entries.reserve(n);
+
+            for(size_t i = 0; i < n; ++i) {
+                kernel_pack_entry e;
+
+                e.hash   = line(pos, end);
+                e.device = line(pos, end);
+                e.size   = to_size(line(pos, end));
+                e.data   = pos;
+
+                precondition(static_cast<size_t>(end - pos) > e.size, "Truncated kernel pack: " + fname);
+                pos += e.size + 1;
+
+                entries.push_back(e);
+            }
+        }
+
+        const std::vector<kernel_pack_entry>& entry() const {
+            return entries;
+        }
+
+        static const char* signature() {
+            return "VEXCL-KERNEL-PACK-1";
+        }
+    private:
+        boost::interprocess::file_mapping  file;
+        boost::interprocess::mapped_region region;
+
+        std::vector<kernel_pack_entry> entries;
+
+        static std::string line(const char* &pos, const char *end) {
+            const char *eol = static_cast<const char*>(memchr(pos, '\n', end - pos));
+            precondition(eol != 0, "Corrupt kernel pack");
+
+            std::string s(pos, eol);
+            pos = eol + 1;
+            return s;
+        }
+
+        static size_t to_size(const std::string &s) {
+            std::istringstream is(s);
+            size_t n = 0;
+            is >> n;
+            return n;
+        }
+};
+
+/// Records program binaries built in the current process.
+/**
+ * Recording is enabled either with VEXCL_RECORD_KERNEL_PACK environment
+ * variable (in which case the pack is saved on process exit) or with
+ * record_kernel_pack().
+ */
+template <bool dummy = true>
+struct kernel_pack_recorder {
+    static_assert(dummy, "dummy parameter should be true");
+
+    static void start(const std::string &fname) {
+        state &s = get();
+
+        detail::lock_guard lock(s.mx);
+        s.fname = fname;
+    }
+
+    /// Returns true if the program with the given hash should be recorded.
+    static bool wants(const std::string &hash) {
+        state &s = get();
+
+        detail::lock_guard lock(s.mx);
+        return !s.fname.empty() && !s.binaries.count(hash);
+    }
+
+    static void add(const std::string &hash, const std::string &device,
+            const char *data, size_t size)
+    {
+        state &s = get();
+
+        detail::lock_guard lock(s.mx);
+        if (s.fname.empty()) return;
+
+        s.binaries[hash] = std::make_pair(device, std::vector<char>(data, data + size));
+        s.dirty = true;
+    }
+
+    static void save() {
+        get().save();
+    }
+    private:
+        struct state {
+            detail::mutex mx;
+            std::string   fname;
+            std::map<
+                std::string, std::pair< std::string, std::vector<char> >
+                > binaries;
+            bool dirty;
+
+            state() : dirty(false) {
+#ifdef _MSC_VER
+#  pragma warning(push)
+#  pragma warning(disable: 4996)
+#endif
+                const char *env = getenv("VEXCL_RECORD_KERNEL_PACK");
+#ifdef _MSC_VER
+#  pragma warning(pop)
+#endif
+                if (env) fname = env;
+            }
+
+            ~state() {
+                try {
+                    save();
+                } catch(...) {
+                }
+            }
+
+            void save() {
+                namespace fs = boost::filesystem;
+
+                detail::lock_guard lock(mx);
+                if (fname.empty() || !dirty) return;
+
+                std::string tmp = fname + "." + fs::unique_path().string();
+
+                {
+                    std::ofstream f(tmp, std::ios::binary);
+                    precondition(f.good(), "Can not write kernel pack " + fname);
+
+                    f << kernel_pack_reader::signature() << "\n"
+                      << binaries.size() << "\n";
+
+                    for(auto b = binaries.begin(); b != binaries.end(); ++b) {
+                        f << b->first << "\n"
+                          << b->second.first << "\n"
+                          << b->second.second.size() << "\n";
+                        f.write(b->second.second.data(), b->second.second.size());
+                        f << "\n";
+                    }
+                }
+
+                boost::system::error_code ec;
+                fs::rename(tmp, fname, ec);
+                if (ec) fs::remove(tmp, ec);
+                else dirty = false;
+            }
+        };
+
+        static state& get() {
+            static state s;
+            return s;
+        }
+};
+
+/// \endcond
+
+/// Starts recording program binaries into a kernel pack.
+/**
+ * Every program built (or loaded from the offline cache) from now on is
+ * stored in the pack. The pack is written by save_kernel_pack() or on process
+ * exit. The pack may later be loaded with load_kernel_pack() or with
+ * VEXCL_KERNEL_PACK environment variable.
+ */
+inline void record_kernel_pack(const std::string &fname) {
+    kernel_pack_recorder<>::start(fname);
+}
+
+/// Writes recorded program binaries to the kernel pack.
+inline void save_kernel_pack() {
+    kernel_pack_recorder<>::save();
+}
+
+} // namespace vex
+
+#endif
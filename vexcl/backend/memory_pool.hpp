@@ -0,0 +1,320 @@
+#ifndef VEXCL_BACKEND_MEMORY_POOL_HPP
+#define VEXCL_BACKEND_MEMORY_POOL_HPP
+
+/*
+The MIT License
+
+Copyright (c) 2012-2014 Denis Demidov <dennis.demidov@gmail.com>
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+
+/**
+ * \file   vexcl/backend/memory_pool.hpp
+ * \author Denis Demidov <dennis.demidov@gmail.com>
+ * \brief  Caching allocator for device buffers.
+ */
+
+#include <map>
+#include <list>
+#include <vector>
+#include <memory>
+#include <utility>
+#include <iterator>
+#include <algorithm>
+#include <cstdlib>
+
+#include <vexcl/detail/mutex.hpp>
+
+namespace vex {
+
+/// Device memory pool statistics.
+struct memory_pool_stats {
+    size_t requests;        ///< Number of allocation requests.
+    size_t hits;            ///< Requests served from the cache.
+    size_t allocations;     ///< Buffers allocated on the device.
+    size_t released;        ///< Cached buffers released by the trim policy.
+    size_t cached_buffers;  ///< Buffers currently held in the cache.
+    size_t cached_bytes;    ///< Bytes currently held in the cache.
+    size_t peak_bytes;      ///< Maximum number of bytes held in the cache.
+
+    memory_pool_stats()
+        : requests(0), hits(0), allocations(0), released(0),
+          cached_buffers(0), cached_bytes(0), peak_bytes(0)
+    {}
+};
+
+/// \cond INTERNAL
+
+/// Caching allocator for device buffers.
+/**
+ * Buffers released by device vectors are kept in buckets keyed by command
+ * queue, memory flags, and size class, and are handed out again to the
+ * following allocations with the same key. Since the queues are in-order,
+ * the commands of the new owner of a buffer can not overtake the pending
+ * commands of the previous one. Size classes are powers of two split into
+ * four steps, so that at most 25% of memory is wasted on rounding.
+ *
+ * The keys hold references to the queues, so that a queue handle can not be
+ * reused by another context while buffers are cached for it. Buffers of a
+ * context are freed by vex::purge_kernel_caches().
+ *
+ * When the cache grows over limit() bytes, the least recently released
+ * buffers are freed. The default limit is 256 MB; it may be changed with
+ * VEXCL_MEMORY_POOL_LIMIT environment variable (in megabytes) or with
+ * vex::memory_pool_limit(). When device allocation fails, the cache is
+ * emptied and the allocation is retried.
+ */
+template <class Key, class Buffer>
+class memory_pool {
+    public:
+        typedef std::shared_ptr<Buffer> lease;
+
+        static memory_pool& instance() {
+            // Never destroyed: device vectors with static storage duration
+            // may return their buffers after the exit of main().
+            static memory_pool *p = new memory_pool();
+            return *p;
+        }
+
+        static size_t size_class(size_t bytes) {
+            const size_t min_class = 256;
+            if (bytes <= min_class) return min_class;
+
+            size_t top = 1;
+            while(top <= bytes / 2) top *= 2;
+
+            size_t step = top / 4;
+            return (bytes + step - 1) / step * step;
+        }
+
+        /// Returns a buffer of at least the given size.
+        /**
+         * The buffer is returned to the pool when the last copy of the lease
+         * is destroyed. alloc(bytes) should allocate a new device buffer.
+         */
+        template <class Alloc>
+        lease get(const Key &key, size_t bytes, Alloc &&alloc) {
+            size_t cls = size_class(bytes);
+            bool pooled;
+
+            {
+                detail::lock_guard lock(mx);
+
+                ++stat.requests;
+
+                auto b = bucket.find(std::make_pair(key, cls));
+                if (b != bucket.end()) {
+                    auto e = b->second;
+                    bucket.erase(b);
+
+                    lease l(new Buffer(std::move(e->buf)), returner(key, cls));
+                    lru.erase(e);
+
+                    ++stat.hits;
+                    --stat.cached_buffers;
+                    stat.cached_bytes -= cls;
+                    return l;
+                }
+
+                ++stat.allocations;
+                pooled = on;
+            }
+
+            if (!pooled) return lease(new Buffer(alloc(bytes)));
+
+            Buffer *buf;
+            try {
+                buf = new Buffer(alloc(cls));
+            } catch(...) {
+                if (!trim(0)) throw;
+                buf = new Buffer(alloc(cls));
+            }
+
+            return lease(buf, returner(key, cls));
+        }
+
+        /// Frees cached buffers until at most keep bytes remain in the cache.
+        /** Returns number of freed bytes. */
+        size_t trim(size_t keep) {
+            std::list<entry> dead;
+            size_t freed = 0;
+
+            {
+                detail::lock_guard lock(mx);
+                freed = evict(keep, dead);
+            }
+
+            return freed;
+        }
+
+        /// Frees cached buffers with the keys satisfying the predicate.
+        /** Returns number of freed bytes. */
+        template <class Pred>
+        size_t purge(Pred &&pred) {
+            std::list<entry> dead;
+            size_t freed = 0;
+
+            detail::lock_guard lock(mx);
+
+            for(auto b = bucket.begin(); b != bucket.end(); ) {
+                if (pred(b->first.first)) {
+                    entry_ptr e = b->second;
+                    bucket.erase(b++);
+
+                    --stat.cached_buffers;
+                    stat.cached_bytes -= e->cls;
+                    ++stat.released;
+                    freed += e->cls;
+
+                    dead.splice(dead.end(), lru, e);
+                } else {
+                    ++b;
+                }
+            }
+
+            return freed;
+        }
+
+        memory_pool_stats statistics() const {
+            detail::lock_guard lock(mx);
+            return stat;
+        }
+
+        void limit(size_t bytes) {
+            std::list<entry> dead;
+
+            detail::lock_guard lock(mx);
+            max_bytes = bytes;
+            evict(max_bytes, dead);
+        }
+
+        void enable(bool enable) {
+            std::list<entry> dead;
+
+            detail::lock_guard lock(mx);
+            on = enable;
+            if (!on) evict(0, dead);
+        }
+    private:
+        struct entry {
+            Key    key;
+            size_t cls;
+            Buffer buf;
+
+            entry(const Key &key, size_t cls, Buffer &&buf)
+                : key(key), cls(cls), buf(std::move(buf)) {}
+        };
+
+        typedef typename std::list<entry>::iterator entry_ptr;
+
+        mutable detail::mutex mx;
+
+        bool   on;
+        size_t max_bytes;
+
+        // Cached buffers in the order of release (oldest first).
+        std::list<entry> lru;
+        std::multimap<std::pair<Key, size_t>, entry_ptr> bucket;
+
+        memory_pool_stats stat;
+
+        struct returner {
+            Key    key;
+            size_t cls;
+
+            returner(const Key &key, size_t cls) : key(key), cls(cls) {}
+
+            void operator()(Buffer *buf) const {
+                instance().put(key, cls, buf);
+            }
+        };
+
+        memory_pool() : on(true), max_bytes(default_limit()) {}
+
+        void put(const Key &key, size_t cls, Buffer *buf) {
+            // Buffers dropped from the cache are freed outside of the lock.
+            std::list<entry> dead;
+
+            {
+                std::unique_ptr<Buffer> b(buf);
+
+                detail::lock_guard lock(mx);
+
+                if (!on || cls > max_bytes) {
+                    dead.push_back(entry(key, cls, std::move(*b)));
+                    return;
+                }
+
+                lru.push_back(entry(key, cls, std::move(*b)));
+                bucket.insert(std::make_pair(std::make_pair(key, cls), std::prev(lru.end())));
+
+                ++stat.cached_buffers;
+                stat.cached_bytes += cls;
+                stat.peak_bytes = std::max(stat.peak_bytes, stat.cached_bytes);
+
+                evict(max_bytes, dead);
+            }
+        }
+
+        // Moves the oldest buffers to dead list. Should be called under lock.
+        size_t evict(size_t keep, std::list<entry> &dead) {
+            size_t freed = 0;
+
+            while(stat.cached_bytes > keep) {
+                entry_ptr e = lru.begin();
+
+                auto range = bucket.equal_range(std::make_pair(e->key, e->cls));
+                for(auto b = range.first; b != range.second; ++b) {
+                    if (b->second == e) {
+                        bucket.erase(b);
+                        break;
+                    }
+                }
+
+                --stat.cached_buffers;
+                stat.cached_bytes -= e->cls;
+                ++stat.released;
+                freed += e->cls;
+
+                dead.splice(dead.end(), lru, e);
+            }
+
+            return freed;
+        }
+
+        static size_t default_limit() {
+#ifdef _MSC_VER
+#  pragma warning(push)
+#  pragma warning(disable: 4996)
+#endif
+            const char *env = getenv("VEXCL_MEMORY_POOL_LIMIT");
+#ifdef _MSC_VER
+#  pragma warning(pop)
+#endif
+            return (env ? static_cast<size_t>(atol(env)) : 256) << 20;
+        }
+};
+
+/// \endcond
+
+} // namespace vex
+
+#endif
@@ -0,0 +1,237 @@
+#ifndef VEXCL_BACKEND_MEMORY_TRACKER_HPP
+#define VEXCL_BACKEND_MEMORY_TRACKER_HPP
+
+/*
+The MIT License
+
+Copyright (c) 2012-2014 Denis Demidov <dennis.demidov@gmail.com>
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+
+/**
+ * \file   vexcl/backend/memory_tracker.hpp
+ * \author Denis Demidov <dennis.demidov@gmail.com>
+ * \brief  Accounting of device memory allocations.
+ */
+
+#include <string>
+#include <map>
+#include <memory>
+#include <iostream>
+#include <iomanip>
+#include <algorithm>
+
+#include <boost/io/ios_state.hpp>
+
+#include <vexcl/detail/mutex.hpp>
+
+namespace vex {
+
+/// Device memory usage statistics.
+struct memory_usage {
+    size_t live_bytes;        ///< Bytes currently allocated.
+    size_t peak_bytes;        ///< Maximum number of bytes allocated at once.
+    size_t allocations;       ///< Total number of allocations.
+    size_t live_allocations;  ///< Number of allocations currently alive.
+
+    memory_usage()
+        : live_bytes(0), peak_bytes(0), allocations(0), live_allocations(0)
+    {}
+};
+
+/// Accounts device allocations made in the current scope to a category.
+/**
+ * The outermost scope of the calling thread wins, so that vectors allocated
+ * internally by e.g. a sparse matrix are accounted to the matrix.
+ * Allocations made outside of any scope are accounted to "other". The name
+ * should outlive all scopes (string literals are fine).
+ \code
+ {
+     vex::memory_category cat("solver");
+     vex::vector<double> r(ctx, n), p(ctx, n);
+ }
+ \endcode
+ */
+class memory_category {
+    public:
+        explicit memory_category(const char *category) : prev(current()) {
+            if (!prev) current() = category;
+        }
+
+        ~memory_category() {
+            current() = prev;
+        }
+
+        /// Category of the allocations made by the calling thread.
+        static const char* name() {
+            return current() ? current() : "other";
+        }
+    private:
+        const char *prev;
+
+        static const char*& current() {
+            static VEXCL_THREAD_LOCAL const char *c = 0;
+            return c;
+        }
+};
+
+/// \cond INTERNAL
+
+/// Per-device accounting of allocations made by device vectors.
+template <class Device>
+class memory_tracker {
+    public:
+        /// Releases the allocation record when the last copy is destroyed.
+        typedef std::shared_ptr<void> token;
+
+        static memory_tracker& instance() {
+            // Never destroyed: device vectors with static storage duration
+            // may be released after the exit of main().
+            static memory_tracker *p = new memory_tracker();
+            return *p;
+        }
+
+        /// Records allocation on the device.
+        /**
+         * device_name() is only called for the first allocation on the
+         * device.
+         */
+        template <class Name>
+        token allocate(const Device &dev, Name &&device_name, size_t bytes) {
+            const char *cat = memory_category::name();
+
+            {
+                detail::lock_guard lock(mx);
+
+                record &r = db[dev];
+                if (r.name.empty()) r.name = device_name();
+
+                add(r.total, bytes);
+                add(r.category[cat], bytes);
+            }
+
+            return std::make_shared<allocation>(dev, cat, bytes);
+        }
+
+        /// Usage of the device memory by the category (or total usage).
+        memory_usage usage(const Device &dev, const std::string &category = "") const {
+            detail::lock_guard lock(mx);
+
+            auto r = db.find(dev);
+            if (r == db.end()) return memory_usage();
+            if (category.empty()) return r->second.total;
+
+            auto c = r->second.category.find(category);
+            return c == r->second.category.end() ? memory_usage() : c->second;
+        }
+
+        /// Resets peak usage to the current one.
+        void reset_peaks() {
+            detail::lock_guard lock(mx);
+
+            for(auto r = db.begin(); r != db.end(); ++r) {
+                r->second.total.peak_bytes = r->second.total.live_bytes;
+                for(auto c = r->second.category.begin(); c != r->second.category.end(); ++c)
+                    c->second.peak_bytes = c->second.live_bytes;
+            }
+        }
+
+        void report(std::ostream &os) const {
+            boost::io::ios_all_saver stream_state(os);
+            detail::lock_guard lock(mx);
+
+            for(auto r = db.begin(); r != db.end(); ++r) {
+                os << r->second.name << "\n"
+                   << std::setw(20) << "category"
+                   << std::setw(14) << "live (MB)"
+                   << std::setw(14) << "peak (MB)"
+                   << std::setw(10) << "allocs"
+                   << std::setw(10) << "live"
+                   << "\n";
+
+                for(auto c = r->second.category.begin(); c != r->second.category.end(); ++c)
+                    report(os, c->first, c->second);
+
+                report(os, "total", r->second.total);
+                os << std::endl;
+            }
+        }
+    private:
+        struct record {
+            std::string name;
+            memory_usage total;
+            std::map<std::string, memory_usage> category;
+        };
+
+        struct allocation {
+            Device      dev;
+            const char *cat;
+            size_t      bytes;
+
+            allocation(const Device &dev, const char *cat, size_t bytes)
+                : dev(dev), cat(cat), bytes(bytes) {}
+
+            ~allocation() {
+                instance().release(dev, cat, bytes);
+            }
+        };
+
+        mutable detail::mutex mx;
+        std::map<Device, record> db;
+
+        memory_tracker() {}
+
+        void release(const Device &dev, const char *cat, size_t bytes) {
+            detail::lock_guard lock(mx);
+
+            record &r = db[dev];
+            sub(r.total, bytes);
+            sub(r.category[cat], bytes);
+        }
+
+        static void add(memory_usage &u, size_t bytes) {
+            u.live_bytes += bytes;
+            u.peak_bytes  = std::max(u.peak_bytes, u.live_bytes);
+            ++u.allocations;
+            ++u.live_allocations;
+        }
+
+        static void sub(memory_usage &u, size_t bytes) {
+            u.live_bytes -= bytes;
+            --u.live_allocations;
+        }
+
+        static void report(std::ostream &os, const std::string &name, const memory_usage &u) {
+            os << std::setw(20) << name
+               << std::fixed << std::setprecision(3)
+               << std::setw(14) << u.live_bytes / 1048576.0
+               << std::setw(14) << u.peak_bytes / 1048576.0
+               << std::setw(10) << u.allocations
+               << std::setw(10) << u.live_allocations
+               << "\n";
+        }
+};
+
+/// \endcond
+
+} // namespace vex
+
+#endif
@@ -32,7 +32,10 @@ THE SOFTWARE.
  */
 
 #include <cstdlib>
+#include <algorithm>
 #include <vexcl/backend/common.hpp>
+#include <vexcl/backend/binary_cache.hpp>
+#include <vexcl/backend/kernel_pack.hpp>
 
 #ifndef __CL_ENABLE_EXCEPTIONS
 #  define __CL_ENABLE_EXCEPTIONS
@@ -43,24 +46,21 @@ namespace vex {
 namespace backend {
 namespace opencl {
 
+/// Programs built in the current process.
+typedef program_table<cl::Program> program_cache;
+
 /// Saves program binaries for future reuse.
 inline void save_program_binaries(
         const std::string &hash, const cl::Program &program, const std::string &source
         )
 {
-    std::ofstream bfile(program_binaries_path(hash, true) + "kernel", std::ios::binary);
-    if (!bfile) return;
-
     std::vector<size_t> sizes    = program.getInfo<CL_PROGRAM_BINARY_SIZES>();
     std::vector<char*>  binaries = program.getInfo<CL_PROGRAM_BINARIES>();
 
     assert(sizes.size() == 1);
 
-    bfile.write((char*)&sizes[0], sizeof(size_t));
-    bfile.write(binaries[0], sizes[0]);
+    binary_cache<>::store(hash, binaries[0], sizes[0], source);
     delete[] binaries[0];
-
-    bfile << "\n" << source << "\n";
 }
 
 /// Tries to read program binaries from file cache.
@@ -69,18 +69,11 @@ inline boost::optional<cl::Program> load_program_binaries(
         const std::vector<cl::Device> &device
         )
 {
-    std::ifstream bfile(program_binaries_path(hash) + "kernel", std::ios::binary);
-    if (!bfile) return boost::optional<cl::Program>();
-
-    size_t n;
     std::vector<char> buf;
-
-    bfile.read((char*)&n, sizeof(size_t));
-    buf.resize(n);
-    bfile.read(buf.data(), n);
+    if (!binary_cache<>::load(hash, buf)) return boost::optional<cl::Program>();
 
     cl::Program program(context, device, cl::Program::Binaries(
-                1, std::make_pair(static_cast<const void*>(buf.data()), n)));
+                1, std::make_pair(static_cast<const void*>(buf.data()), buf.size())));
 
     try {
         program.build(device, "");
@@ -88,16 +81,100 @@ inline boost::optional<cl::Program> load_program_binaries(
         std::cerr << "Loading binaries failed:" << std::endl
             << program.getBuildInfo<CL_PROGRAM_BUILD_LOG>(device[0])
             << std::endl;
+
+        // The binary is unusable (e.g. after a driver update).
+        binary_cache<>::discard(hash);
         return boost::optional<cl::Program>();
     }
 
     return boost::optional<cl::Program>(program);
 }
 
+/// Identifies device and driver a program binary was built for.
+inline std::string device_signature(const cl::Device &device) {
+    std::ostringstream s;
+
+    s << cl::Platform(device.getInfo<CL_DEVICE_PLATFORM>()).getInfo<CL_PLATFORM_NAME>()
+      << " / " << device.getInfo<CL_DEVICE_NAME>()
+      << " / " << device.getInfo<CL_DRIVER_VERSION>();
+
+    // Signature is stored as a single line in kernel packs.
+    std::string sig = s.str();
+    std::replace(sig.begin(), sig.end(), '\n', ' ');
+    sig.erase(std::remove(sig.begin(), sig.end(), '\0'), sig.end());
+
+    return sig;
+}
+
+/// Identifies device and driver of the command queue.
+/**
+ * Includes the number of compute units, so that NUMA sub-devices (see
+ * vex::numa_fission()) are told from the whole device.
+ */
+inline std::string device_signature(const cl::CommandQueue &q) {
+    cl::Device d = q.getInfo<CL_QUEUE_DEVICE>();
+
+    std::ostringstream s;
+    s << device_signature(d) << " / " << d.getInfo<CL_DEVICE_MAX_COMPUTE_UNITS>();
+    return s.str();
+}
+
+/// Stores program binaries in the kernel pack being recorded.
+inline void record_program_binaries(
+        const std::string &hash, const cl::Device &device, const cl::Program &program
+        )
+{
+    std::vector<size_t> sizes    = program.getInfo<CL_PROGRAM_BINARY_SIZES>();
+    std::vector<char*>  binaries = program.getInfo<CL_PROGRAM_BINARIES>();
+
+    assert(sizes.size() == 1);
+
+    kernel_pack_recorder<>::add(hash, device_signature(device), binaries[0], sizes[0]);
+    delete[] binaries[0];
+}
+
+/// Creates programs from the kernel pack for each of the given queues.
+/**
+ * Only the binaries built for the matching device and driver are used.
+ * Returns the number of created programs.
+ */
+inline size_t load_kernel_pack(
+        const std::vector<cl::CommandQueue> &queue, const std::string &fname
+        )
+{
+    kernel_pack_reader pack(fname);
+
+    size_t loaded = 0;
+
+    for(auto q = queue.begin(); q != queue.end(); ++q) {
+        auto context = q->getInfo<CL_QUEUE_CONTEXT>();
+        auto device  = context.getInfo<CL_CONTEXT_DEVICES>();
+        auto sig     = device_signature(device[0]);
+
+        for(auto e = pack.entry().begin(); e != pack.entry().end(); ++e) {
+            if (e->device != sig) continue;
+
+            try {
+                cl::Program program(context, device, cl::Program::Binaries(
+                            1, std::make_pair(static_cast<const void*>(e->data), e->size)));
+
+                program.build(device, "");
+
+                program_cache::insert(cache_key(*q), e->hash, program);
+                ++loaded;
+            } catch(const cl::Error&) {
+                // The binary will be rebuilt from source on first use.
+            }
+        }
+    }
+
+    return loaded;
+}
+
 /// Create and build a program from source string.
 /**
  * If VEXCL_CACHE_KERNELS macro is defined, then program binaries are cached
- * in filesystem and reused in the following runs.
+ * in filesystem and reused in the following runs (see binary_cache_stats()).
  */
 inline cl::Program build_sources(
         const cl::CommandQueue &queue, const std::string &source,
@@ -123,7 +200,6 @@ inline cl::Program build_sources(
 
     std::string compile_options = options + " " + get_compile_options(queue);
 
-#ifdef VEXCL_CACHE_KERNELS
     // Get unique (hopefully) hash string for the kernel.
     std::ostringstream fullsrc;
 
@@ -145,35 +221,44 @@ inline cl::Program build_sources(
 
     std::string hash = sha1( fullsrc.str() );
 
-    // Try to get cached program binaries:
-    try {
-        if (boost::optional<cl::Program> program = load_program_binaries(hash, context, device))
-            return *program;
-    } catch (...) {
-        // Shit happens.
-    }
+    // Identical sources are only built once per context:
+    cl::Program program = program_cache::get(cache_key(queue), hash, [&]() -> cl::Program {
+#ifdef VEXCL_CACHE_KERNELS
+        // Try to get cached program binaries:
+        try {
+            if (boost::optional<cl::Program> program = load_program_binaries(hash, context, device))
+                return *program;
+        } catch (...) {
+            // Shit happens.
+        }
 #endif
 
-    // If cache is not available, just compile the sources.
-    cl::Program program(context, cl::Program::Sources(
-                1, std::make_pair(source.c_str(), source.size())
-                ));
-
-    try {
-        program.build(device, (options + " " + get_compile_options(queue)).c_str());
-    } catch(const cl::Error&) {
-        std::cerr << source
-                  << std::endl
-                  << program.getBuildInfo<CL_PROGRAM_BUILD_LOG>(device[0])
-                  << std::endl;
-        throw;
-    }
+        // If cache is not available, just compile the sources.
+        cl::Program program(context, cl::Program::Sources(
+                    1, std::make_pair(source.c_str(), source.size())
+                    ));
+
+        try {
+            program.build(device, compile_options.c_str());
+        } catch(const cl::Error&) {
+            std::cerr << source
+                      << std::endl
+                      << program.getBuildInfo<CL_PROGRAM_BUILD_LOG>(device[0])
+                      << std::endl;
+            throw;
+        }
 
 #ifdef VEXCL_CACHE_KERNELS
-    // Save program binaries for future reuse:
-    save_program_binaries(hash, program, fullsrc.str());
+        // Save program binaries for future reuse:
+        save_program_binaries(hash, program, fullsrc.str());
 #endif
 
+        return program;
+    });
+
+    if (kernel_pack_recorder<>::wants(hash))
+        record_program_binaries(hash, device[0], program);
+
     return program;
 }
 
@@ -33,6 +33,8 @@ THE SOFTWARE.
 
 #include <vector>
 #include <iostream>
+#include <type_traits>
+#include <cstdlib>
 
 #ifndef __CL_ENABLE_EXCEPTIONS
 #  define __CL_ENABLE_EXCEPTIONS
@@ -48,6 +50,7 @@ namespace opencl {
 typedef cl::Context                 context;
 typedef cl::Device                  device;
 typedef cl::CommandQueue            command_queue;
+typedef cl::Event                   event;
 typedef cl_command_queue_properties command_queue_properties;
 typedef cl_device_id                device_id;
 
@@ -72,6 +75,11 @@ inline kernel_cache_key cache_key(const command_queue &q) {
 }
 /// \endcond
 
+/// Checks if both objects refer to the same command queue.
+inline bool same_queue(const command_queue &a, const command_queue &b) {
+    return a() == b();
+}
+
 /// Create command queue on the same context and device as the given one.
 inline command_queue duplicate_queue(const command_queue &q) {
     return command_queue(
@@ -91,6 +99,81 @@ inline bool is_cpu(const command_queue &q) {
 #endif
 }
 
+/// Preferred width of native vector types on the compute device.
+/**
+ * Returns 1 for types other than float and double.
+ */
+template <typename T>
+inline unsigned preferred_vector_width(const command_queue &q) {
+    cl::Device d = q.getInfo<CL_QUEUE_DEVICE>();
+
+    if (std::is_same<T, cl_float>::value)
+        return d.getInfo<CL_DEVICE_PREFERRED_VECTOR_WIDTH_FLOAT>();
+
+    if (std::is_same<T, cl_double>::value)
+        return d.getInfo<CL_DEVICE_PREFERRED_VECTOR_WIDTH_DOUBLE>();
+
+    return 1;
+}
+
+/// \cond INTERNAL
+
+/// Splits CPU devices into NUMA nodes.
+/**
+ * When enabled (see vex::numa_fission()), each selected CPU device that
+ * supports partitioning by NUMA affinity domain is replaced with its
+ * sub-devices (clCreateSubDevices() with CL_DEVICE_AFFINITY_DOMAIN_NUMA), so
+ * that each vector partition is processed and first touched by the cores of
+ * a single NUMA node.
+ */
+template <bool dummy = true>
+struct device_fission {
+    static_assert(dummy, "dummy parameter should be true");
+
+    static bool& enabled() {
+#ifdef _MSC_VER
+#  pragma warning(push)
+#  pragma warning(disable: 4996)
+#endif
+        static bool on = getenv("VEXCL_NUMA_FISSION") != 0;
+#ifdef _MSC_VER
+#  pragma warning(pop)
+#endif
+        return on;
+    }
+
+    /// Returns NUMA sub-devices of the device, or the device itself.
+    static std::vector<cl::Device> split(const cl::Device &d) {
+        std::vector<cl::Device> sub;
+
+#if defined(CL_VERSION_1_2)
+        if (enabled() && (d.getInfo<CL_DEVICE_TYPE>() & CL_DEVICE_TYPE_CPU)) {
+            try {
+                // Throws on OpenCL 1.1 platforms.
+                if (d.getInfo<CL_DEVICE_PARTITION_AFFINITY_DOMAIN>() & CL_DEVICE_AFFINITY_DOMAIN_NUMA) {
+                    const cl_device_partition_property prop[] = {
+                        CL_DEVICE_PARTITION_BY_AFFINITY_DOMAIN,
+                        CL_DEVICE_AFFINITY_DOMAIN_NUMA,
+                        0
+                    };
+
+                    cl::Device(d).createSubDevices(prop, &sub);
+                }
+            } catch(const cl::Error&) {
+                sub.clear();
+            }
+        }
+#endif
+
+        // Single NUMA node is no better than the whole device.
+        if (sub.size() < 2) sub.assign(1, d);
+
+        return sub;
+    }
+};
+
+/// \endcond
+
 /// Select devices by given criteria.
 /**
  * \param filter  Device filter functor. Functors may be combined with logical
@@ -160,13 +243,17 @@ queue_list(DevFilter &&filter, cl_command_queue_properties properties = 0) {
 
         if (device.empty()) continue;
 
-        for(auto d = device.begin(); d != device.end(); d++)
-            try {
-                context.push_back(cl::Context(std::vector<cl::Device>(1, *d)));
-                queue.push_back(command_queue(context.back(), *d, properties));
-            } catch(const cl::Error&) {
-                // Something bad happened. Better skip this device.
-            }
+        for(auto d = device.begin(); d != device.end(); d++) {
+            std::vector<cl::Device> sub = device_fission<>::split(*d);
+
+            for(auto s = sub.begin(); s != sub.end(); s++)
+                try {
+                    context.push_back(cl::Context(std::vector<cl::Device>(1, *s)));
+                    queue.push_back(command_queue(context.back(), *s, properties));
+                } catch(const cl::Error&) {
+                    // Something bad happened. Better skip this device.
+                }
+        }
     }
 
     return std::make_pair(context, queue);
@@ -174,6 +261,19 @@ queue_list(DevFilter &&filter, cl_command_queue_properties properties = 0) {
 
 } // namespace opencl
 } // namespace backend
+
+/// Splits CPU devices into NUMA nodes when creating contexts.
+/**
+ * Affects contexts created afterwards. Each CPU device that supports
+ * partitioning by NUMA affinity domain is replaced with one sub-device per
+ * NUMA node, so that multi-device partitioning maps vector partitions to
+ * NUMA nodes. May also be enabled with VEXCL_NUMA_FISSION environment
+ * variable. Only available with the OpenCL backend.
+ */
+inline void numa_fission(bool enable = true) {
+    backend::opencl::device_fission<>::enabled() = enable;
+}
+
 } // namespace vex
 
 namespace std {
@@ -36,6 +36,12 @@ THE SOFTWARE.
 #endif
 #include <CL/cl.hpp>
 
+#include <atomic>
+
+#include <vexcl/backend/opencl/context.hpp>
+#include <vexcl/backend/memory_pool.hpp>
+#include <vexcl/backend/memory_tracker.hpp>
+
 namespace vex {
 namespace backend {
 namespace opencl {
@@ -46,49 +52,148 @@ static const mem_flags MEM_READ_ONLY  = CL_MEM_READ_ONLY;
 static const mem_flags MEM_WRITE_ONLY = CL_MEM_WRITE_ONLY;
 static const mem_flags MEM_READ_WRITE = CL_MEM_READ_WRITE;
 
+/// Checks if buffers created with the flags use host memory as storage.
+inline bool uses_host_ptr(mem_flags flags) {
+    return (flags & CL_MEM_USE_HOST_PTR) != 0;
+}
+
+/// \cond INTERNAL
+/// Page-locked host memory used for staging of host-device transfers.
+/**
+ * Allocated with CL_MEM_ALLOC_HOST_PTR and kept mapped for its lifetime.
+ */
+class pinned_buffer {
+    public:
+        pinned_buffer(const cl::CommandQueue &q, size_t bytes)
+            : q(q),
+              buf(q.getInfo<CL_QUEUE_CONTEXT>(),
+                      CL_MEM_READ_WRITE | CL_MEM_ALLOC_HOST_PTR, bytes),
+              ptr(static_cast<char*>(q.enqueueMapBuffer(buf, CL_TRUE,
+                              CL_MAP_READ | CL_MAP_WRITE, 0, bytes)))
+        {}
+
+        ~pinned_buffer() {
+            try {
+                q.enqueueUnmapMemObject(buf, ptr);
+            } catch(...) {
+            }
+        }
+
+        char* data() const {
+            return ptr;
+        }
+    private:
+        cl::CommandQueue q;
+        cl::Buffer buf;
+        char *ptr;
+
+        pinned_buffer(const pinned_buffer&);
+        pinned_buffer& operator=(const pinned_buffer&);
+};
+
+/// Key of the device memory pool buckets.
+struct memory_pool_key {
+    cl::CommandQueue queue;
+    mem_flags        flags;
+
+    memory_pool_key(const cl::CommandQueue &queue, mem_flags flags)
+        : queue(queue), flags(flags) {}
+
+    bool operator<(const memory_pool_key &k) const {
+        return queue() < k.queue() || (queue() == k.queue() && flags < k.flags);
+    }
+};
+
+/// Pool of device buffers (see vex::memory_pool).
+typedef vex::memory_pool<memory_pool_key, cl::Buffer> device_memory_pool;
+
+/// Accounting of device allocations (see vex::memory_tracker).
+typedef vex::memory_tracker<cl_device_id> device_memory_tracker;
+
+/// Returns unique id for a new device vector buffer.
+/**
+ * Kernels remember the arguments they were launched with by the memory
+ * handle and the id, since the handles of released buffers may be reused.
+ */
+inline size_t new_buffer_id() {
+    static std::atomic<size_t> last(0);
+    return ++last;
+}
+/// \endcond
+
 template <typename T>
 class device_vector {
     public:
         typedef T value_type;
         typedef cl_mem raw_type;
 
-        device_vector() {}
+        device_vector() : n(0), gen(0) {}
 
         device_vector(const cl::CommandQueue &q, size_t n,
                 const T *host = 0, mem_flags flags = MEM_READ_WRITE)
+            : n(n), gen(new_buffer_id())
         {
-            if (host)
+            if (!n) return;
+
+#ifndef VEXCL_DISABLE_MEMORY_TRACKING
+            usage = device_memory_tracker::instance().allocate(
+                    get_device_id(q),
+                    [&q]() { return q.getInfo<CL_QUEUE_DEVICE>().getInfo<CL_DEVICE_NAME>(); },
+                    n * sizeof(T));
+#endif
+
+            cl::Context ctx = q.getInfo<CL_QUEUE_CONTEXT>();
+
+#ifndef VEXCL_DISABLE_MEMORY_POOL
+            // Only plain access flags are pooled; buffers backed by host
+            // memory are allocated directly.
+            if (!(flags & ~(CL_MEM_READ_WRITE | CL_MEM_READ_ONLY | CL_MEM_WRITE_ONLY))) {
+                lease = device_memory_pool::instance().get(
+                        memory_pool_key(q, flags), n * sizeof(T),
+                        [&](size_t bytes) { return cl::Buffer(ctx, flags, bytes); }
+                        );
+                buffer = *lease;
+
+                if (host) write(q, 0, n, host, true);
+                return;
+            }
+#endif
+
+            if (host && !(flags & CL_MEM_USE_HOST_PTR))
                 flags |= CL_MEM_COPY_HOST_PTR;
 
-            if (n)
-                buffer = cl::Buffer(q.getInfo<CL_QUEUE_CONTEXT>(), flags,
-                        n * sizeof(T), static_cast<void*>(const_cast<T*>(host)));
+            buffer = cl::Buffer(ctx, flags, n * sizeof(T),
+                    static_cast<void*>(const_cast<T*>(host)));
         }
 
-        device_vector(cl::Buffer buffer) : buffer( std::move(buffer) ) {}
+        device_vector(cl::Buffer buffer)
+            : buffer( std::move(buffer) ),
+              n( this->buffer() ? this->buffer.getInfo<CL_MEM_SIZE>() / sizeof(T) : 0 ),
+              gen(new_buffer_id())
+        {}
 
         void write(const cl::CommandQueue &q, size_t offset, size_t size, const T *host,
-                bool blocking = false) const
+                bool blocking = false, cl::Event *event = 0) const
         {
             if (size)
                 q.enqueueWriteBuffer(
                         buffer, blocking ? CL_TRUE : CL_FALSE,
-                        sizeof(T) * offset, sizeof(T) * size, host
+                        sizeof(T) * offset, sizeof(T) * size, host, 0, event
                         );
         }
 
         void read(const cl::CommandQueue &q, size_t offset, size_t size, T *host,
-                bool blocking = false) const
+                bool blocking = false, cl::Event *event = 0) const
         {
             if (size)
                 q.enqueueReadBuffer(
                         buffer, blocking ? CL_TRUE : CL_FALSE,
-                        sizeof(T) * offset, sizeof(T) * size, host
+                        sizeof(T) * offset, sizeof(T) * size, host, 0, event
                         );
         }
 
         size_t size() const {
-            return buffer.getInfo<CL_MEM_SIZE>() / sizeof(T);
+            return n;
         }
 
         struct buffer_unmapper {
@@ -121,8 +226,21 @@ class device_vector {
         cl_mem raw() const {
             return buffer();
         }
+
+        /// Unique id of the buffer (shared by copies of the vector).
+        size_t id() const {
+            return gen;
+        }
     private:
         cl::Buffer buffer;
+        size_t     n;
+        size_t     gen;
+
+        // Returns pooled buffer to the pool when the last copy is destroyed.
+        std::shared_ptr<cl::Buffer> lease;
+
+        // Releases the allocation record when the last copy is destroyed.
+        device_memory_tracker::token usage;
 };
 
 } // namespace opencl
@@ -218,6 +218,8 @@ struct plan {
                 "FFT is only supported for single-device contexts."
                 );
 
+        memory_category cat("fft");
+
         auto queue   = queues[0];
 
         size_t total_n = std::accumulate(sizes.begin(), sizes.end(),
@@ -47,6 +47,7 @@ THE SOFTWARE.
 #endif
 #include <CL/cl.hpp>
 
+#include <vexcl/detail/mutex.hpp>
 
 namespace vex {
 
@@ -274,6 +275,9 @@ namespace Filter {
             bool operator()(const cl::Device &d) const {
                 static std::map<cl_device_id, std::string> dev_uids = get_uids();
                 static std::vector<std::unique_ptr<locker>> locks;
+                static vex::detail::mutex mx;
+
+                vex::detail::lock_guard lock(mx);
 
                 std::unique_ptr<locker> lck(new locker(dev_uids[d()]));
 
@@ -32,6 +32,10 @@ THE SOFTWARE.
  */
 
 #include <functional>
+#include <vector>
+#include <string>
+#include <algorithm>
+#include <type_traits>
 
 #ifndef __CL_ENABLE_EXCEPTIONS
 #  define __CL_ENABLE_EXCEPTIONS
@@ -39,6 +43,7 @@ THE SOFTWARE.
 #include <CL/cl.hpp>
 
 #include <vexcl/backend/opencl/compiler.hpp>
+#include <vexcl/backend/autotune.hpp>
 
 namespace vex {
 namespace backend {
@@ -49,7 +54,10 @@ namespace opencl {
 /// An abstraction over OpenCL compute kernel.
 class kernel {
     public:
-        kernel() : argpos(0), w_size(0), g_size(0) {}
+        kernel()
+            : argpos(0), w_size(0), g_size(0), def_w_size(0), def_g_size(0),
+              tuned_n(0), timed(-1)
+        {}
 
         /// Constructor. Creates a cl::Kernel instance from source.
         kernel(const cl::CommandQueue &queue,
@@ -57,7 +65,8 @@ class kernel {
                const std::string &name,
                size_t smem_per_thread = 0
                )
-            : argpos(0), K(build_sources(queue, src), name.c_str())
+            : argpos(0), K(build_sources(queue, src), name.c_str()),
+              tune_key(autotuner<>::enabled() ? tuning_key(src, name) : tuning_key()), tuned_n(0), timed(-1)
         {
             config(queue,
                     [smem_per_thread](size_t wgs){ return wgs * smem_per_thread; });
@@ -68,39 +77,78 @@ class kernel {
                const std::string &src, const std::string &name,
                std::function<size_t(size_t)> smem
                )
-            : argpos(0), K(build_sources(queue, src), name.c_str())
+            : argpos(0), K(build_sources(queue, src), name.c_str()),
+              tune_key(autotuner<>::enabled() ? tuning_key(src, name) : tuning_key()), tuned_n(0), timed(-1)
         {
             config(queue, smem);
         }
 
+        /// Creates an independent copy of the kernel.
+        /**
+         * The copy shares the compiled program, but has its own argument
+         * state, so that it may be launched concurrently with the original.
+         */
+        kernel clone() const {
+            kernel k(*this);
+
+            k.argpos = 0;
+            k.timed  = -1;
+            k.args.clear();
+            k.K = cl::Kernel(
+                    K.getInfo<CL_KERNEL_PROGRAM>(),
+                    K.getInfo<CL_KERNEL_FUNCTION_NAME>().c_str()
+                    );
+
+            return k;
+        }
+
         /// Adds an argument to the kernel.
+        /**
+         * Arguments that did not change since the previous launch of the
+         * kernel are not set again.
+         */
         template <class Arg>
-        void push_arg(Arg &&arg) {
-            K.setArg(argpos++, arg);
+        void push_arg(const Arg &arg) {
+            set_arg(arg, typename arg_kind<Arg>::type());
         }
 
         /// Adds an argument to the kernel.
         template <typename T>
-        void push_arg(device_vector<T> &&arg) {
-            K.setArg(argpos++, arg.raw());
+        void push_arg(const device_vector<T> &arg) {
+            set_mem_arg(arg.raw(), arg.id());
+        }
+
+        /// Adds local memory to the kernel.
+        void push_arg(const cl::LocalSpaceArg &arg) {
+            set_local_arg(arg.size_);
         }
 
         /// Adds local memory to the kernel.
         void set_smem(size_t smem_per_thread) {
-            cl::LocalSpaceArg smem = { smem_per_thread * w_size };
-            K.setArg(argpos++, smem);
+            set_local_arg(smem_per_thread * w_size);
         }
 
         /// Adds local memory to the kernel.
         template <class F>
         void set_smem(F &&f) {
-            cl::LocalSpaceArg smem = { f(w_size) };
-            K.setArg(argpos++, smem);
+            set_local_arg(f(w_size));
         }
 
         /// Enqueue the kernel to the specified command queue.
         void operator()(const cl::CommandQueue &q) {
-            q.enqueueNDRangeKernel(K, cl::NullRange, g_size, w_size);
+            if (timed >= 0) {
+                q.finish();
+                double t = autotuner<>::now();
+
+                q.enqueueNDRangeKernel(K, cl::NullRange, g_size, w_size);
+
+                q.finish();
+                autotuner<>::report(key(q), tuned_n, timed, autotuner<>::now() - t);
+
+                timed = -1;
+            } else {
+                q.enqueueNDRangeKernel(K, cl::NullRange, g_size, w_size);
+            }
             argpos = 0;
         }
 
@@ -119,6 +167,11 @@ class kernel {
             return w_size;
         }
 
+        /// Number of workgroups in the current launch configuration.
+        size_t num_groups() const {
+            return g_size / w_size;
+        }
+
         /// Standard number of workgroups to launch on a device.
         static inline size_t num_workgroups(const cl::CommandQueue &q) {
             // This is a simple heuristic-based estimate. More advanced technique may
@@ -145,6 +198,8 @@ class kernel {
         void config(const cl::CommandQueue &queue, std::function<size_t(size_t)> smem) {
             cl::Device dev = queue.getInfo<CL_QUEUE_DEVICE>();
 
+            smem_fn = smem;
+
             if ( is_cpu(queue) ) {
                 w_size = 1;
             } else {
@@ -160,6 +215,9 @@ class kernel {
             }
 
             g_size = w_size * num_workgroups(queue);
+
+            def_w_size = w_size;
+            def_g_size = g_size;
         }
 
         /// Set launch configuration.
@@ -167,13 +225,183 @@ class kernel {
             g_size = blocks * threads;
             w_size = threads;
         }
+
+        /// Lets the autotuner select launch configuration for the next launch.
+        /**
+         * Should only be called for kernels that give the same result with
+         * any launch configuration (e.g. kernels with grid-stride loops), and
+         * before the local memory is set. The default launch configuration is
+         * used unless autotuning is enabled (see vex::autotune()) and the
+         * kernel was built while it was enabled. Zero limits mean no limit.
+         */
+        void tune(const cl::CommandQueue &q, size_t n,
+                size_t max_groups = 0, size_t max_wgsize = 0)
+        {
+            // Configurations selected for earlier launches do not persist.
+            w_size = def_w_size;
+            g_size = def_g_size;
+
+            if (tune_key.empty() || !autotuner<>::enabled()) return;
+
+            launch_config c;
+            timed = autotuner<>::select(key(q), n, [&]() {
+                        return candidates(q, max_groups, max_wgsize);
+                    }, c);
+
+            if (c.groups && c.wgsize) config(c.groups, c.wgsize);
+
+            tuned_n = n;
+        }
     private:
         unsigned argpos;
 
         cl::Kernel K;
 
+        // Last value set for each of the kernel arguments. Memory objects
+        // are not retained (that would keep released buffers alive); since
+        // their handles may be reused, they are remembered together with the
+        // id of the device vector buffer. Memory objects with unknown id are
+        // always set.
+        struct arg_slot {
+            enum { unset, value, local, memory } kind;
+
+            std::vector<char> data;
+            size_t            size;
+            cl_mem            mem;
+            size_t            gen;
+
+            arg_slot() : kind(unset), size(0), mem(0), gen(0) {}
+        };
+
+        std::vector<arg_slot> args;
+
+        struct value_arg  {};
+        struct memory_arg {};
+
+        template <class Arg>
+        struct arg_kind {
+            typedef typename std::conditional<
+                std::is_base_of<cl::Memory, Arg>::value ||
+                std::is_same<Arg, cl_mem>::value,
+                memory_arg, value_arg
+                >::type type;
+        };
+
+        arg_slot& next_slot() {
+            if (args.size() <= argpos) args.resize(argpos + 1);
+            return args[argpos];
+        }
+
+        static cl_mem handle(cl_mem m) { return m; }
+        static cl_mem handle(const cl::Memory &m) { return m(); }
+
+        template <class Arg>
+        void set_arg(const Arg &arg, memory_arg) {
+            set_mem_arg(handle(arg), 0);
+        }
+
+        template <class Arg>
+        void set_arg(const Arg &arg, value_arg) {
+            arg_slot &s = next_slot();
+
+            const char *p = reinterpret_cast<const char*>(&arg);
+
+            if (s.kind != arg_slot::value || s.size != sizeof(Arg) ||
+                    !std::equal(p, p + sizeof(Arg), s.data.begin()))
+            {
+                K.setArg(argpos, sizeof(Arg), const_cast<char*>(p));
+
+                s.kind = arg_slot::value;
+                s.size = sizeof(Arg);
+                s.data.assign(p, p + sizeof(Arg));
+            }
+
+            ++argpos;
+        }
+
+        void set_mem_arg(cl_mem m, size_t gen) {
+            arg_slot &s = next_slot();
+
+            if (s.kind != arg_slot::memory || s.mem != m || !gen || s.gen != gen) {
+                K.setArg(argpos, sizeof(cl_mem), &m);
+
+                s.kind = arg_slot::memory;
+                s.mem  = m;
+                s.gen  = gen;
+            }
+
+            ++argpos;
+        }
+
+        void set_local_arg(size_t size) {
+            arg_slot &s = next_slot();
+
+            if (s.kind != arg_slot::local || s.size != size) {
+                K.setArg(argpos, size, 0);
+
+                s.kind = arg_slot::local;
+                s.size = size;
+            }
+
+            ++argpos;
+        }
+
         size_t   w_size;
         size_t   g_size;
+
+        // Launch configuration selected by config(queue, smem).
+        size_t   def_w_size;
+        size_t   def_g_size;
+
+        std::function<size_t(size_t)> smem_fn;
+
+        tuning_key  tune_key;
+        size_t      tuned_n;
+        int         timed;
+
+        const std::string& key(const cl::CommandQueue &q) const {
+            return tune_key.get([&]() {
+                    return device_signature(q.getInfo<CL_QUEUE_DEVICE>());
+                    });
+        }
+
+        // Launch configurations to try: workgroup sizes around the
+        // heuristic one, and grids of 1 to 32 workgroups per compute unit.
+        std::vector<launch_config> candidates(const cl::CommandQueue &q,
+                size_t max_groups, size_t max_wgsize) const
+        {
+            cl::Device dev = q.getInfo<CL_QUEUE_DEVICE>();
+
+            size_t cu       = dev.getInfo<CL_DEVICE_MAX_COMPUTE_UNITS>();
+            size_t max_ws   = max_threads_per_block(q);
+            size_t max_smem = max_shared_memory_per_block(q);
+
+            std::vector<size_t> ws;
+            if (is_cpu(q)) {
+                size_t w[] = {1, 4, 16, 64};
+                ws.assign(w, w + 4);
+            } else {
+                size_t w0 = dev.getInfo<CL_DEVICE_MAX_WORK_ITEM_SIZES>()[0] / 2;
+                size_t w[] = {w0 / 4, w0 / 2, w0, w0 * 2};
+                ws.assign(w, w + 4);
+            }
+
+            std::vector<launch_config> c;
+            for(auto w = ws.begin(); w != ws.end(); ++w) {
+                if (!*w || *w > max_ws) continue;
+                if (smem_fn && smem_fn(*w) > max_smem) continue;
+                if (max_wgsize && *w > max_wgsize) continue;
+
+                for(size_t g = cu; g <= 32 * cu; g *= 2) {
+                    if (max_groups && g > max_groups) break;
+
+                    launch_config cfg = {g, *w};
+                    c.push_back(cfg);
+                }
+            }
+
+            return c;
+        }
 };
 
 /// \endcond
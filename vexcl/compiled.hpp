@@ -0,0 +1,381 @@
+#ifndef VEXCL_COMPILED_HPP
+#define VEXCL_COMPILED_HPP
+
+/*
+The MIT License
+
+Copyright (c) 2012-2014 Denis Demidov <dennis.demidov@gmail.com>
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+/**
+ * \file   vexcl/compiled.hpp
+ * \author Denis Demidov <dennis.demidov@gmail.com>
+ * \brief  Vector expressions compiled into reusable launch handles.
+ */
+
+#include <vector>
+#include <memory>
+#include <functional>
+#include <type_traits>
+
+#include <vexcl/operations.hpp>
+#include <vexcl/fusion.hpp>
+#include <vexcl/vector.hpp>
+
+namespace vex {
+
+/// \cond INTERNAL
+struct parameter_terminal {};
+/// \endcond
+
+/// Scalar whose value is read each time an expression is launched.
+/**
+ * Copies of a parameter (including the ones stored inside expressions) share
+ * the same value. This allows to change scalar coefficients of compiled
+ * expressions (see vex::compile()) between launches:
+ \code
+ vex::parameter<double> alpha(0.5);
+ auto axpy = vex::compile(y, alpha * x + y);
+
+ for(int i = 0; i < n; ++i) {
+     alpha = 1.0 / (i + 1);
+     axpy();
+ }
+ \endcode
+ */
+template <typename T>
+class parameter
+    : public vector_expression< typename boost::proto::terminal< parameter_terminal >::type >
+{
+    public:
+        typedef T value_type;
+
+        parameter(T value = T()) : v(std::make_shared<T>(value)) {}
+
+        /// Sets new value (visible to all copies of the parameter).
+        const parameter& operator=(T value) {
+            *v = value;
+            return *this;
+        }
+
+        /// Copies value of another parameter.
+        const parameter& operator=(const parameter &p) {
+            *v = *p.v;
+            return *this;
+        }
+
+        /// Current value.
+        T value() const {
+            return *v;
+        }
+    private:
+        std::shared_ptr<T> v;
+};
+
+namespace traits {
+
+template <>
+struct is_vector_expr_terminal< parameter_terminal > : std::true_type {};
+
+template <>
+struct is_multivector_expr_terminal< parameter_terminal > : std::true_type {};
+
+template <>
+struct proto_terminal_is_value< parameter_terminal > : std::true_type {};
+
+template <typename T>
+struct kernel_param_declaration< parameter<T> >
+{
+    static void get(backend::source_generator &src,
+            const parameter<T>&,
+            const backend::command_queue&, const std::string &prm_name,
+            detail::kernel_generator_state_ptr)
+    {
+        src.parameter<T>(prm_name);
+    }
+};
+
+template <typename T>
+struct partial_vector_expr< parameter<T> >
+{
+    static void get(backend::source_generator &src,
+            const parameter<T>&,
+            const backend::command_queue&, const std::string &prm_name,
+            detail::kernel_generator_state_ptr)
+    {
+        src << prm_name;
+    }
+};
+
+template <typename T>
+struct kernel_arg_setter< parameter<T> >
+{
+    static void set(const parameter<T> &term,
+            backend::kernel &kernel, unsigned/*part*/, size_t/*index_offset*/,
+            detail::kernel_generator_state_ptr)
+    {
+        kernel.push_arg(term.value());
+    }
+};
+
+} // namespace traits
+
+/// \cond INTERNAL
+namespace detail {
+
+typedef std::function<void(backend::kernel&, kernel_generator_state_ptr)>
+    argument_setter;
+
+// Records kernel argument setters for each terminal of an expression, so that
+// the arguments may be set later without traversing the expression.
+struct record_expression_argument {
+    std::vector<argument_setter> &args;
+    unsigned part;
+    size_t part_start;
+
+    record_expression_argument(std::vector<argument_setter> &args,
+            unsigned part, size_t part_start)
+        : args(args), part(part), part_start(part_start)
+    {}
+
+    template <typename Term>
+    typename std::enable_if<traits::terminal_is_value<Term>::value, void>::type
+    operator()(const Term &term) const {
+        record(term);
+    }
+
+    template <typename Term>
+    typename std::enable_if<!traits::terminal_is_value<Term>::value, void>::type
+    operator()(const Term &term) const {
+        record(boost::proto::value(term));
+    }
+
+    template <typename Term>
+    void record(const Term &term) const {
+        const Term *t = std::addressof(term);
+        unsigned    d = part;
+        size_t      s = part_start;
+
+        args.push_back([t, d, s](backend::kernel &krn, kernel_generator_state_ptr state) {
+                traits::set_kernel_args(*t, krn, d, s, state);
+                });
+    }
+};
+
+struct compiled_statement {
+    virtual ~compiled_statement() {}
+    virtual void launch() = 0;
+};
+
+template <class OP, class LHS, class RHS>
+struct compiled_assignment : compiled_statement {
+    // Expressions store everything except vectors by value, so the copies
+    // outlive the expressions the statement was compiled from.
+    typename std::conditional<
+        traits::hold_terminal_by_reference<LHS>::value, const LHS&, const LHS
+        >::type lhs;
+
+    typename std::conditional<
+        traits::hold_terminal_by_reference<RHS>::value, const RHS&, const RHS
+        >::type rhs;
+
+    std::vector<backend::command_queue> queue;
+    std::vector<size_t>                 part;
+    size_t                              generation;
+
+    struct device_launch {
+        unsigned d;
+        size_t   psize;
+        bool     specialized, fixed_n;
+
+        backend::kernel krn;
+        std::vector<argument_setter> args;
+
+        device_launch(unsigned d, size_t psize, bool specialized,
+                bool fixed_n, const backend::kernel &krn)
+            : d(d), psize(psize), specialized(specialized), fixed_n(fixed_n),
+              krn(krn)
+        {}
+    };
+
+    std::vector<device_launch> dev;
+
+    compiled_assignment(const LHS &lhs_expr, const RHS &rhs_expr,
+            const std::vector<backend::command_queue> &q,
+            const std::vector<size_t> &part
+            ) : lhs(lhs_expr), rhs(rhs_expr), queue(q), part(part),
+                generation(partition_generation<>::value)
+    {
+        build();
+    }
+
+    void build() {
+        check_assignment(lhs, rhs, queue, part);
+
+        dev.clear();
+
+        std::string values;
+        {
+            get_specialization_key key(values);
+            extract_terminals()(boost::proto::as_child(lhs), key);
+            extract_terminals()(boost::proto::as_child(rhs), key);
+        }
+
+        const std::string alias = terminal_aliasing::key(rhs);
+
+        for(unsigned d = 0; d < queue.size(); d++) {
+            const size_t psize = part[d + 1] - part[d];
+            if (!psize) continue;
+
+            backend::select_context(queue[d]);
+
+            bool specialized, fixed_n;
+            backend::kernel &krn = assignment_kernel<OP>(lhs, rhs, queue[d],
+                    psize, values, alias, specialized, fixed_n);
+
+            // The handle owns a clone of the cached kernel, so that its
+            // arguments are not disturbed by other launches.
+            dev.push_back(device_launch(d, psize, specialized, fixed_n, krn.clone()));
+
+            record_expression_argument rec(dev.back().args, d, part[d]);
+            extract_terminals()(boost::proto::as_child(lhs), rec);
+            extract_terminals()(boost::proto::as_child(rhs), rec);
+        }
+    }
+
+    void launch() {
+        fusion_barrier();
+
+        // Rebuild the launches if the vectors were repartitioned since the
+        // expression was compiled.
+        size_t g = partition_generation<>::value;
+        if (g != generation) {
+            get_expression_properties prop;
+            extract_terminals()(boost::proto::as_child(lhs), prop);
+
+            if (prop.part != part) {
+                part = prop.part;
+                build();
+            }
+
+            generation = g;
+        }
+
+        for(auto l = dev.begin(); l != dev.end(); ++l) {
+            const backend::command_queue &q = queue[l->d];
+
+            backend::select_context(q);
+
+            l->krn.tune(q, l->psize);
+            if (!l->fixed_n) l->krn.push_arg(l->psize);
+
+            kernel_generator_state_ptr state = variant_state(l->specialized);
+            for(auto a = l->args.begin(); a != l->args.end(); ++a)
+                (*a)(l->krn, state);
+
+            l->krn(q);
+        }
+    }
+};
+
+} // namespace detail
+/// \endcond
+
+/// Handle to a compiled vector expression.
+/**
+ * Holds the kernels built for the expression together with its partitioning
+ * and the kernel argument setters, so that each launch only sets the kernel
+ * arguments and enqueues the kernels. Handles are cheap to copy; the copies
+ * share the compiled expression.
+ */
+class compiled_expression {
+    public:
+        compiled_expression() {}
+
+        /// Launches the compiled expression.
+        void operator()() const {
+            precondition(bool(stmt), "Empty compiled expression");
+            stmt->launch();
+        }
+
+        /// Checks if the handle holds a compiled expression.
+        explicit operator bool() const {
+            return bool(stmt);
+        }
+
+        /// \cond INTERNAL
+        explicit compiled_expression(std::shared_ptr<detail::compiled_statement> s)
+            : stmt(s) {}
+        /// \endcond
+    private:
+        std::shared_ptr<detail::compiled_statement> stmt;
+};
+
+/// Compiles element-wise assignment of rhs to lhs into a reusable handle.
+/**
+ * The kernel is built (or taken from the kernel cache) once, and the handle
+ * may then be launched any number of times without traversing the expression
+ * or looking up the kernel cache. Plain scalars in the expression are
+ * captured by value at compilation time; use vex::parameter for the values
+ * that should be changed between launches. Vectors are captured by
+ * reference, so the handle sees their current contents (including the
+ * effects of vex::vector::swap()), but the vectors should keep their sizes.
+ * Vectors repartitioned with vex::vector::repartition() are detected at the
+ * next launch, and the kernels are set up for the new partitioning.
+ * The assignment operation may be changed with the template parameter:
+ \code
+ vex::parameter<double> alpha;
+ auto update = vex::compile<vex::assign::ADD>(x, alpha * p);
+ \endcode
+ */
+template <class OP = assign::SET, class LHS, class RHS>
+#ifdef DOXYGEN
+compiled_expression
+#else
+typename std::enable_if<
+    boost::proto::matches<
+        typename boost::proto::result_of::as_expr<LHS>::type,
+        vector_expr_grammar
+    >::value &&
+    boost::proto::matches<
+        typename boost::proto::result_of::as_expr<RHS>::type,
+        vector_expr_grammar
+    >::value,
+    compiled_expression
+>::type
+#endif
+compile(const LHS &lhs, const RHS &rhs) {
+    detail::get_expression_properties prop;
+    detail::extract_terminals()(boost::proto::as_child(lhs), prop);
+
+    precondition(!prop.queue.empty() && !prop.part.empty(),
+            "Can not determine expression size and queue list"
+            );
+
+    return compiled_expression(
+            std::make_shared< detail::compiled_assignment<OP, LHS, RHS> >(
+                lhs, rhs, prop.queue, prop.part)
+            );
+}
+
+} // namespace vex
+
+#endif
@@ -0,0 +1,117 @@
+#ifndef VEXCL_DETAIL_MUTEX_HPP
+#define VEXCL_DETAIL_MUTEX_HPP
+
+/*
+The MIT License
+
+Copyright (c) 2012-2014 Denis Demidov <dennis.demidov@gmail.com>
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+/**
+ * \file   vexcl/detail/mutex.hpp
+ * \author Denis Demidov <dennis.demidov@gmail.com>
+ * \brief  Threading primitives used to protect global VexCL state.
+ */
+
+#if defined(_MSC_VER) && (_MSC_VER < 1700)
+#  define VEXCL_USE_BOOST_THREAD
+#  include <boost/thread/mutex.hpp>
+#  include <boost/thread/locks.hpp>
+#  include <boost/thread/thread.hpp>
+#  include <boost/thread/tss.hpp>
+#  include <boost/functional/hash.hpp>
+#else
+#  include <mutex>
+#  include <thread>
+#  include <functional>
+#endif
+
+// Storage class for thread-local POD variables.
+#ifdef _MSC_VER
+#  define VEXCL_THREAD_LOCAL __declspec(thread)
+#else
+#  define VEXCL_THREAD_LOCAL __thread
+#endif
+
+namespace vex {
+namespace detail {
+
+/// \cond INTERNAL
+
+#ifdef VEXCL_USE_BOOST_THREAD
+typedef boost::mutex               mutex;
+typedef boost::lock_guard<mutex>   lock_guard;
+typedef boost::thread              thread;
+typedef boost::thread::id          thread_id;
+
+inline thread_id this_thread_id() {
+    return boost::this_thread::get_id();
+}
+
+inline size_t thread_hash(const thread_id &id) {
+    return boost::hash<thread_id>()(id);
+}
+
+inline unsigned hardware_concurrency() {
+    return boost::thread::hardware_concurrency();
+}
+#else
+typedef std::mutex                 mutex;
+typedef std::lock_guard<mutex>     lock_guard;
+typedef std::thread                thread;
+typedef std::thread::id            thread_id;
+
+inline thread_id this_thread_id() {
+    return std::this_thread::get_id();
+}
+
+inline size_t thread_hash(const thread_id &id) {
+    return std::hash<thread_id>()(id);
+}
+
+inline unsigned hardware_concurrency() {
+    return std::thread::hardware_concurrency();
+}
+#endif
+
+/// Returns the instance of T that belongs to the current thread.
+/**
+ * The instance is default-constructed on first use and is destroyed when the
+ * thread exits.
+ */
+template <class T>
+T& thread_local_instance() {
+#ifdef VEXCL_USE_BOOST_THREAD
+    static boost::thread_specific_ptr<T> p;
+    if (!p.get()) p.reset(new T());
+    return *p;
+#else
+    static thread_local T t;
+    return t;
+#endif
+}
+
+/// \endcond
+
+} // namespace detail
+} // namespace vex
+
+#endif
@@ -34,10 +34,16 @@ THE SOFTWARE.
 #include <vector>
 #include <functional>
 #include <string>
+#include <memory>
+#include <exception>
+#include <utility>
 #include <cstdlib>
 
+#include <boost/filesystem.hpp>
+
 #include <vexcl/backend.hpp>
 #include <vexcl/util.hpp>
+#include <vexcl/detail/mutex.hpp>
 
 #ifdef __GNUC__
 #  ifndef _GLIBCXX_USE_NANOSLEEP
@@ -267,6 +273,158 @@ inline const Context& current_context() {
     return StaticContext<>::get();
 }
 
+/// Task that is run in background on each newly created vex::Context.
+typedef
+    std::function<void(const std::vector<backend::command_queue>&)>
+    precompile_task;
+
+/// \cond INTERNAL
+namespace detail {
+
+template <bool dummy = true>
+struct precompile_registry {
+    static_assert(dummy, "dummy parameter should be true");
+
+    static void add(precompile_task task) {
+        lock_guard lock(mx);
+        tasks.push_back(task);
+    }
+
+    static std::vector<precompile_task> get() {
+        lock_guard lock(mx);
+        return tasks;
+    }
+
+    private:
+        static std::vector<precompile_task> tasks;
+        static mutex mx;
+};
+
+template <bool dummy>
+std::vector<precompile_task> precompile_registry<dummy>::tasks;
+
+template <bool dummy>
+mutex precompile_registry<dummy>::mx;
+
+// Runs registered tasks on a pool of threads.
+class precompile_pool {
+    public:
+        precompile_pool(
+                const std::vector<backend::command_queue> &queue,
+                const std::vector<precompile_task> &tasks
+                ) : queue(queue), tasks(tasks), next(0)
+        {
+            unsigned nt = std::max(1U, hardware_concurrency());
+            if (nt > tasks.size()) nt = static_cast<unsigned>(tasks.size());
+
+            for(unsigned i = 0; i < nt; ++i)
+                workers.push_back(std::unique_ptr<thread>(
+                            new thread([this]() { work(); })
+                            ));
+        }
+
+        ~precompile_pool() {
+            join();
+        }
+
+        // Waits for the tasks to complete, and rethrows the first error
+        // thrown by a task (once).
+        void wait() {
+            join();
+
+            std::exception_ptr e;
+            {
+                lock_guard lock(next_mx);
+                std::swap(e, error);
+            }
+
+            if (e) std::rethrow_exception(e);
+        }
+    private:
+        std::vector<backend::command_queue> queue;
+        std::vector<precompile_task>        tasks;
+        size_t                              next;
+        std::exception_ptr                  error;
+
+        mutex next_mx, wait_mx;
+        std::vector< std::unique_ptr<thread> > workers;
+
+        void join() {
+            lock_guard lock(wait_mx);
+
+            for(auto w = workers.begin(); w != workers.end(); ++w)
+                if ((*w)->joinable()) (*w)->join();
+        }
+
+        void work() {
+            while(true) {
+                size_t t;
+                {
+                    lock_guard lock(next_mx);
+                    if (next == tasks.size()) return;
+                    t = next++;
+                }
+
+                // The remaining tasks are still run after an error; a failed
+                // build will be retried on the first use of the kernel.
+                try {
+                    tasks[t](queue);
+                } catch(...) {
+                    lock_guard lock(next_mx);
+                    if (!error) error = std::current_exception();
+                }
+            }
+        }
+};
+
+} // namespace detail
+/// \endcond
+
+/// Registers a task for background kernel compilation.
+/**
+ * Each task is run on a pool of host threads whenever a vex::Context is
+ * created, and receives the list of command queues of the new context.
+ * The tasks should exercise the expressions and primitives used by the
+ * application (assignments, reductions, sorts, scans, FFT plans) on small
+ * vectors, so that the required compute kernels are compiled ahead of time.
+ * Compute kernels are compiled once per context, so the first real use of an
+ * expression either finds its kernel ready or waits for the background build
+ * to complete. Independent tasks are compiled in parallel:
+ \code
+ vex::precompile([](const std::vector<vex::backend::command_queue> &q) {
+     vex::vector<double> x(q, 1), y(q, 1);
+     y = 2 * x + sin(x);
+ });
+
+ vex::precompile([](const std::vector<vex::backend::command_queue> &q) {
+     vex::vector<double> x(q, 1);
+     vex::sort(x);
+ });
+
+ vex::Context ctx( vex::Filter::Env );
+ \endcode
+ */
+inline void precompile(precompile_task task) {
+    detail::precompile_registry<>::add(task);
+}
+
+/// Preloads program binaries from a kernel pack.
+/**
+ * The pack is a single file recorded with vex::record_kernel_pack() (or with
+ * VEXCL_RECORD_KERNEL_PACK environment variable) during a representative run.
+ * The file is memory-mapped, and programs for all matching devices are
+ * created at once. Returns the number of created programs.
+ *
+ * A vex::Context loads the pack named by VEXCL_KERNEL_PACK environment
+ * variable automatically.
+ */
+inline size_t load_kernel_pack(
+        const std::vector<backend::command_queue> &queue,
+        const std::string &fname)
+{
+    return backend::load_kernel_pack(queue, fname);
+}
+
 /// VexCL context holder.
 /**
  * Holds vectors of backend::contexts and backend::command_queues returned by queue_list.
@@ -285,6 +443,8 @@ class Context {
 #endif
 
             StaticContext<>::set(*this);
+            preload_kernels();
+            start_precompile();
         }
 
         /// Initializes context from user-supplied list of backend::contexts and backend::command_queues.
@@ -297,6 +457,8 @@ class Context {
             }
 
             StaticContext<>::set(*this);
+            preload_kernels();
+            start_precompile();
         }
 
         const std::vector<backend::context>& context() const {
@@ -339,9 +501,48 @@ class Context {
             for(auto queue = q.begin(); queue != q.end(); ++queue)
                 queue->finish();
         }
+
+        /// Blocks until all background compilation tasks are complete.
+        /**
+         * Rethrows the first exception thrown by a task. The error is only
+         * reported once; it is ignored if this is never called.
+         *
+         * \sa vex::precompile()
+         */
+        void wait_precompiled() const {
+            if (pool) pool->wait();
+        }
     private:
         std::vector<backend::context>       c;
         std::vector<backend::command_queue> q;
+
+        std::shared_ptr<detail::precompile_pool> pool;
+
+        // Loads kernel pack set with VEXCL_KERNEL_PACK environment variable.
+        void preload_kernels() {
+#ifdef _MSC_VER
+#  pragma warning(push)
+#  pragma warning(disable: 4996)
+#endif
+            const char *pack = getenv("VEXCL_KERNEL_PACK");
+#ifdef _MSC_VER
+#  pragma warning(pop)
+#endif
+            if (!pack || q.empty() || !boost::filesystem::exists(pack)) return;
+
+            try {
+                backend::load_kernel_pack(q, pack);
+            } catch(...) {
+                // Missing kernels are compiled from source.
+            }
+        }
+
+        void start_precompile() {
+            auto tasks = detail::precompile_registry<>::get();
+
+            if (!q.empty() && !tasks.empty())
+                pool = std::make_shared<detail::precompile_pool>(q, tasks);
+        }
 };
 
 } // namespace vex
@@ -70,6 +70,9 @@ struct is_vector_expr_terminal< elem_index > : std::true_type {};
 template <>
 struct is_multivector_expr_terminal< elem_index > : std::true_type {};
 
+template <>
+struct is_fusable_terminal< elem_index > : std::true_type {};
+
 template <>
 struct kernel_param_declaration< elem_index >
 {
@@ -0,0 +1,282 @@
+#ifndef VEXCL_FILE_IO_HPP
+#define VEXCL_FILE_IO_HPP
+
+/*
+The MIT License
+
+Copyright (c) 2012-2014 Denis Demidov <dennis.demidov@gmail.com>
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+
+/**
+ * \file   vexcl/file_io.hpp
+ * \author Denis Demidov <dennis.demidov@gmail.com>
+ * \brief  Loading and saving vectors with memory-mapped files.
+ */
+
+#include <string>
+#include <fstream>
+#include <cstring>
+#include <algorithm>
+
+#include <boost/filesystem.hpp>
+#include <boost/interprocess/file_mapping.hpp>
+#include <boost/interprocess/mapped_region.hpp>
+
+#include <vexcl/vector.hpp>
+#include <vexcl/types.hpp>
+
+namespace vex {
+
+/// \cond INTERNAL
+
+namespace detail {
+
+/// Memory-mapped transfers between files and device vectors.
+/**
+ * Files are either raw arrays of values, or arrays preceded with a header:
+ \verbatim
+ VEXCL-ARRAY-1
+ <value type name>
+ <number of values>
+ \endverbatim
+ * padded to a multiple of 64 bytes. Each partition of a vector is mapped to
+ * the corresponding file range and is transferred in chunks. The next chunk
+ * is mapped (and read ahead by the OS) while the current one is in flight.
+ */
+template <bool dummy = true>
+struct mapped_file_io {
+    static_assert(dummy, "dummy parameter should be true");
+
+    static const char* signature() {
+        return "VEXCL-ARRAY-1\n";
+    }
+
+    static size_t chunk_bytes() {
+        return 16 << 20;
+    }
+
+    /// Returns number of values stored in the file and offset of the data.
+    template <typename T>
+    static size_t data_size(const std::string &fname, size_t &offset) {
+        std::ifstream f(fname, std::ios::binary);
+        precondition(f.good(), "Can not open " + fname);
+
+        f.seekg(0, std::ios::end);
+        size_t fsize = static_cast<size_t>(f.tellg());
+        f.seekg(0);
+
+        const size_t siglen = strlen(signature());
+        std::string sig(siglen, ' ');
+
+        if (fsize >= siglen && f.read(&sig[0], siglen) && sig == signature()) {
+            std::string type;
+            size_t n = 0;
+
+            std::getline(f, type);
+            f >> n;
+
+            precondition(f.get() == '\n', "Corrupt header in " + fname);
+            precondition(type == type_name<T>(),
+                    "Wrong value type in " + fname + ": " + type);
+
+            offset = header_size(static_cast<size_t>(f.tellg()));
+
+            precondition(offset + n * sizeof(T) <= fsize, "Truncated file " + fname);
+            return n;
+        }
+
+        precondition(fsize % sizeof(T) == 0,
+                "File size is not a multiple of value size: " + fname);
+
+        offset = 0;
+        return fsize / sizeof(T);
+    }
+
+    /// Writes header for the array of n values; returns data offset.
+    template <typename T>
+    static size_t write_header(std::ofstream &f, size_t n) {
+        f << signature() << type_name<T>() << "\n" << n << "\n";
+
+        size_t len = static_cast<size_t>(f.tellp());
+        size_t offset = header_size(len);
+
+        f << std::string(offset - len, '\n');
+        return offset;
+    }
+
+    template <typename T>
+    static void load(const boost::interprocess::file_mapping &file, size_t offset,
+            const backend::command_queue &q, const backend::device_vector<T> &buf,
+            size_t size)
+    {
+        namespace ip = boost::interprocess;
+
+        const size_t chunk = chunk_bytes() / sizeof(T);
+
+        ip::mapped_region region[2];
+        backend::event    e[2];
+        bool              busy[2] = {false, false};
+
+        map(region[0], file, ip::read_only, offset, std::min(chunk, size) * sizeof(T));
+
+        for(size_t pos = 0, k = 0; pos < size; pos += chunk, k ^= 1) {
+            size_t n = std::min(chunk, size - pos);
+
+            buf.write(q, pos, n, static_cast<const T*>(region[k].get_address()),
+                    false, &e[k]);
+            busy[k] = true;
+
+            release(region[k ^ 1], e[k ^ 1], busy[k ^ 1]);
+
+            if (pos + n < size)
+                map(region[k ^ 1], file, ip::read_only, offset + (pos + n) * sizeof(T),
+                        std::min(chunk, size - pos - n) * sizeof(T));
+        }
+
+        for(int k = 0; k < 2; ++k) release(region[k], e[k], busy[k]);
+    }
+
+    template <typename T>
+    static void save(const boost::interprocess::file_mapping &file, size_t offset,
+            const backend::command_queue &q, const backend::device_vector<T> &buf,
+            size_t size)
+    {
+        namespace ip = boost::interprocess;
+
+        const size_t chunk = chunk_bytes() / sizeof(T);
+
+        ip::mapped_region region[2];
+        backend::event    e[2];
+        bool              busy[2] = {false, false};
+
+        for(size_t pos = 0, k = 0; pos < size; pos += chunk, k ^= 1) {
+            size_t n = std::min(chunk, size - pos);
+
+            // Unmapping lets the OS write the chunk back while the next one
+            // is being read from the device.
+            release(region[k], e[k], busy[k]);
+            map(region[k], file, ip::read_write, offset + pos * sizeof(T), n * sizeof(T));
+
+            buf.read(q, pos, n, static_cast<T*>(region[k].get_address()), false, &e[k]);
+            busy[k] = true;
+        }
+
+        for(int k = 0; k < 2; ++k) release(region[k], e[k], busy[k]);
+    }
+
+    private:
+        static size_t header_size(size_t len) {
+            return (len + 63) / 64 * 64;
+        }
+
+        static void map(boost::interprocess::mapped_region &region,
+                const boost::interprocess::file_mapping &file,
+                boost::interprocess::mode_t mode, size_t offset, size_t bytes)
+        {
+            boost::interprocess::mapped_region r(file, mode, offset, bytes);
+            r.advise(boost::interprocess::mapped_region::advice_willneed);
+            region.swap(r);
+        }
+
+        static void release(boost::interprocess::mapped_region &region,
+                backend::event &e, bool &busy)
+        {
+            if (!busy) return;
+
+            e.wait();
+            boost::interprocess::mapped_region().swap(region);
+            busy = false;
+        }
+};
+
+} // namespace detail
+
+/// \endcond
+
+/// Loads vector from a file.
+/**
+ * The file should either contain raw values of type T, or be written by
+ * vex::save() with a header, in which case the value type is checked. The
+ * file size should match the vector size. The file is memory-mapped, and
+ * each partition of the vector is streamed from the corresponding file range
+ * in chunks, without intermediate host copy of the whole vector.
+ */
+template <typename T>
+void load(const std::string &fname, vector<T> &x) {
+    size_t offset;
+    size_t n = detail::mapped_file_io<>::data_size<T>(fname, offset);
+
+    precondition(n == x.size(), "File size does not match vector size: " + fname);
+    if (!n) return;
+
+    boost::interprocess::file_mapping file(fname.c_str(), boost::interprocess::read_only);
+
+    for(unsigned d = 0; d < x.nparts(); ++d)
+        if (x.part_size(d))
+            detail::mapped_file_io<>::load(file, offset + x.part_start(d) * sizeof(T),
+                    x.queue_list()[d], x(d), x.part_size(d));
+}
+
+/// Creates vector with the contents of the file.
+/**
+ * The vector size is determined from the file. See vex::load(fname, x).
+ */
+template <typename T>
+vector<T> load(const std::vector<backend::command_queue> &queue, const std::string &fname) {
+    size_t offset;
+    vector<T> x(queue, detail::mapped_file_io<>::data_size<T>(fname, offset));
+
+    load(fname, x);
+    return x;
+}
+
+/// Saves vector to a file.
+/**
+ * When header is true, the file starts with a short header storing the value
+ * type and the vector size. Otherwise raw values are written.
+ */
+template <typename T>
+void save(const std::string &fname, const vector<T> &x, bool header = true) {
+    size_t offset = 0;
+
+    {
+        std::ofstream f(fname, std::ios::binary | std::ios::trunc);
+        precondition(f.good(), "Can not write " + fname);
+
+        if (header) offset = detail::mapped_file_io<>::write_header<T>(f, x.size());
+    }
+
+    if (!x.size()) return;
+
+    boost::filesystem::resize_file(fname, offset + x.size() * sizeof(T));
+
+    boost::interprocess::file_mapping file(fname.c_str(), boost::interprocess::read_write);
+
+    for(unsigned d = 0; d < x.nparts(); ++d)
+        if (x.part_size(d))
+            detail::mapped_file_io<>::save(file, offset + x.part_start(d) * sizeof(T),
+                    x.queue_list()[d], x(d), x.part_size(d));
+}
+
+} // namespace vex
+
+#endif
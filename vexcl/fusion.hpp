@@ -0,0 +1,625 @@
+#ifndef VEXCL_FUSION_HPP
+#define VEXCL_FUSION_HPP
+
+/*
+The MIT License
+
+Copyright (c) 2012-2014 Denis Demidov <dennis.demidov@gmail.com>
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+/**
+ * \file   vexcl/fusion.hpp
+ * \author Denis Demidov <dennis.demidov@gmail.com>
+ * \brief  Deferred assignments fused into a single kernel.
+ */
+
+#include <string>
+#include <vector>
+#include <map>
+#include <memory>
+#include <sstream>
+#include <functional>
+#include <algorithm>
+#include <typeinfo>
+#include <exception>
+
+#include <boost/config.hpp>
+
+#include <vexcl/operations.hpp>
+#include <vexcl/detail/mutex.hpp>
+
+namespace vex {
+
+/// \cond INTERNAL
+
+namespace traits {
+
+// Vectors that are read into (and written from) private variables in fused
+// kernels. Specializations should provide type(), declare(), set(), id() and
+// bind(). id() identifies the memory of the vector, and bind() returns a
+// functor that sets the memory as a kernel argument, so that the vector
+// object itself may be swapped or moved before a recorded statement is
+// launched.
+template <class Term, class Enable = void>
+struct fused_vector : std::false_type {};
+
+} // namespace traits
+
+namespace detail {
+
+// Names of private variables holding fused vectors. When present in the
+// kernel generator state, vectors are not passed as separate parameters of
+// each statement, but are accessed through these variables.
+typedef std::map<const void*, std::string> fused_vector_names;
+
+// Returns name of the private variable holding the given vector, or null if
+// the vector is accessed through its own kernel parameter.
+inline const std::string* fused_vector_name(
+        const kernel_generator_state_ptr &state, const void *v)
+{
+    auto f = state->find("fused_vectors");
+    if (f == state->end()) return 0;
+
+    const fused_vector_names &names = boost::any_cast<const fused_vector_names&>(f->second);
+
+    auto n = names.find(v);
+    return n == names.end() ? 0 : &n->second;
+}
+
+struct fused_vector_info {
+    const void *ptr;    // Address of the vector object.
+    const void *id;     // Identity of the vector memory.
+    std::string type;
+
+    void (*declare)(backend::source_generator&, const std::string&);
+    std::function<void(backend::kernel&, unsigned)> set;
+};
+
+// Collects vectors referenced by an expression.
+struct collect_fused_vectors {
+    std::vector<fused_vector_info> &vec;
+
+    collect_fused_vectors(std::vector<fused_vector_info> &vec) : vec(vec) {}
+
+    template <typename Term>
+    typename std::enable_if<traits::terminal_is_value<Term>::value, void>::type
+    operator()(const Term &term) const {
+        add(term);
+    }
+
+    template <typename Term>
+    typename std::enable_if<!traits::terminal_is_value<Term>::value, void>::type
+    operator()(const Term &term) const {
+        add(boost::proto::value(term));
+    }
+
+    template <typename T>
+    typename std::enable_if<traits::fused_vector<T>::value, void>::type
+    add(const T &v) const {
+        fused_vector_info i;
+
+        i.ptr     = &v;
+        i.id      = traits::fused_vector<T>::id(v);
+        i.type    = traits::fused_vector<T>::type();
+        i.declare = &traits::fused_vector<T>::declare;
+        i.set     = traits::fused_vector<T>::bind(v);
+
+        vec.push_back(i);
+    }
+
+    template <typename T>
+    typename std::enable_if<!traits::fused_vector<T>::value, void>::type
+    add(const T&) const {}
+};
+
+// Checks whether all terminals of an expression may be fused.
+struct check_fusable {
+    bool &ok;
+
+    check_fusable(bool &ok) : ok(ok) {}
+
+    template <typename Term>
+    typename std::enable_if<traits::terminal_is_value<Term>::value, void>::type
+    operator()(const Term&) const {
+        ok = ok && traits::is_fusable_terminal<Term>::value;
+    }
+
+    template <typename Term>
+    typename std::enable_if<!traits::terminal_is_value<Term>::value, void>::type
+    operator()(const Term&) const {
+        ok = ok && traits::is_fusable_terminal<
+            typename std::decay<typename boost::proto::result_of::value<Term>::type>::type
+            >::value;
+    }
+};
+
+// Element-wise assignment recorded for later execution.
+struct fused_statement {
+    // Vectors referenced by the statement, collected when it is recorded.
+    std::vector<fused_vector_info> lhs_vec, rhs_vec;
+
+    virtual ~fused_statement() {}
+
+    // Uniquely identifies the generated code.
+    virtual const char* signature() const = 0;
+
+    virtual bool reads_lhs() const = 0;
+
+    virtual void vectors(
+            std::vector<fused_vector_info> &lhs,
+            std::vector<fused_vector_info> &rhs) const = 0;
+
+    virtual void preamble(backend::source_generator &src,
+            const backend::command_queue &q, const std::string &prefix,
+            kernel_generator_state_ptr state) const = 0;
+
+    virtual void declare(backend::source_generator &src,
+            const backend::command_queue &q, const std::string &prefix,
+            kernel_generator_state_ptr state) const = 0;
+
+    virtual void assign(backend::source_generator &src,
+            const backend::command_queue &q, const std::string &prefix,
+            kernel_generator_state_ptr loc_state,
+            kernel_generator_state_ptr expr_state) const = 0;
+
+    virtual void set_args(backend::kernel &kernel, unsigned d, size_t part_start,
+            kernel_generator_state_ptr state) const = 0;
+};
+
+template <class OP, class LHS, class RHS>
+struct fused_assignment : fused_statement {
+    LHS &lhs;
+
+    // Expressions store everything except vectors by value, so a copy
+    // outlives the statement it was recorded from.
+    typename std::conditional<
+        traits::hold_terminal_by_reference<RHS>::value, const RHS&, const RHS
+        >::type rhs;
+
+    fused_assignment(LHS &lhs, const RHS &rhs) : lhs(lhs), rhs(rhs) {}
+
+    const char* signature() const {
+        return typeid(fused_assignment).name();
+    }
+
+    bool reads_lhs() const {
+        return !std::is_same<OP, assign::SET>::value;
+    }
+
+    void vectors(std::vector<fused_vector_info> &l,
+            std::vector<fused_vector_info> &r) const
+    {
+        extract_terminals()(boost::proto::as_child(lhs), collect_fused_vectors(l));
+        extract_terminals()(boost::proto::as_child(rhs), collect_fused_vectors(r));
+    }
+
+    void preamble(backend::source_generator &src,
+            const backend::command_queue &q, const std::string &prefix,
+            kernel_generator_state_ptr state) const
+    {
+        output_terminal_preamble termpream(src, q, prefix, state);
+
+        boost::proto::eval(boost::proto::as_child(lhs), termpream);
+        boost::proto::eval(boost::proto::as_child(rhs), termpream);
+    }
+
+    void declare(backend::source_generator &src,
+            const backend::command_queue &q, const std::string &prefix,
+            kernel_generator_state_ptr state) const
+    {
+        declare_expression_parameter declare(src, q, prefix, state);
+
+        extract_terminals()(boost::proto::as_child(lhs), declare);
+        extract_terminals()(boost::proto::as_child(rhs), declare);
+    }
+
+    void assign(backend::source_generator &src,
+            const backend::command_queue &q, const std::string &prefix,
+            kernel_generator_state_ptr loc_state,
+            kernel_generator_state_ptr expr_state) const
+    {
+        output_local_preamble loc_init(src, q, prefix, loc_state);
+
+        boost::proto::eval(boost::proto::as_child(lhs), loc_init);
+        boost::proto::eval(boost::proto::as_child(rhs), loc_init);
+
+        vector_expr_context expr_ctx(src, q, prefix, expr_state);
+
+        src.new_line();
+        boost::proto::eval(boost::proto::as_child(lhs), expr_ctx);
+        src << " " << OP::string() << " ";
+        boost::proto::eval(boost::proto::as_child(rhs), expr_ctx);
+        src << ";";
+    }
+
+    void set_args(backend::kernel &kernel, unsigned d, size_t part_start,
+            kernel_generator_state_ptr state) const
+    {
+        set_expression_argument setarg(kernel, d, part_start, state);
+
+        extract_terminals()(boost::proto::as_child(lhs), setarg);
+        extract_terminals()(boost::proto::as_child(rhs), setarg);
+    }
+};
+
+// Statements recorded by a fusion scope.
+/**
+ * All statements share queue list and partitioning. When flushed, the
+ * statements are emitted into a single kernel, in which each vector is read
+ * at most once (and only when its value is used before it is overwritten) and
+ * written at most once, at the end of the kernel.
+ */
+class fused_sequence {
+    public:
+        // Maximum number of statements in a single fused kernel.
+        static const size_t max_statements = 16;
+
+        ~fused_sequence() {
+            try {
+                flush();
+            } catch(...) {
+                // Only reached when the fusion scope is left because of an
+                // exception; otherwise the scope flushes the sequence first.
+            }
+        }
+
+        // Innermost active sequence of the current thread.
+        static fused_sequence*& active() {
+            static VEXCL_THREAD_LOCAL fused_sequence *s = 0;
+            return s;
+        }
+
+        template <class OP, class LHS, class RHS>
+        void record(LHS &lhs, const RHS &rhs,
+                const std::vector<backend::command_queue> &q,
+                const std::vector<size_t> &p)
+        {
+            if (!stmt.empty() && !compatible(q, p)) flush();
+
+            std::unique_ptr<fused_statement> s(
+                    new fused_assignment<OP, LHS, RHS>(lhs, rhs));
+
+            s->vectors(s->lhs_vec, s->rhs_vec);
+
+            touch(s->lhs_vec);
+            touch(s->rhs_vec);
+
+            if (stmt.empty()) {
+                queue = q;
+                part  = p;
+            }
+
+            stmt.push_back(std::move(s));
+
+            if (stmt.size() >= max_statements) flush();
+        }
+
+        // Whether a recorded statement references the given vector object
+        // or memory.
+        bool references(const void *ptr, const void *id) const {
+            return std::find(touched.begin(), touched.end(), ptr) != touched.end()
+                || std::find(touched.begin(), touched.end(), id)  != touched.end();
+        }
+
+        bool empty() const {
+            return stmt.empty();
+        }
+
+        void flush() {
+            if (stmt.empty()) return;
+
+            // Detach the statements first: vectors accessed while setting
+            // kernel arguments should not trigger the flush again.
+            std::vector< std::unique_ptr<fused_statement> > s;
+            s.swap(stmt);
+            touched.clear();
+
+            // Distinct vectors, and whether each of them should be loaded
+            // before and stored after the statements.
+            std::vector<fused_vector_info> vec;
+            std::vector<char> load, store;
+            std::map<const void*, size_t> index;
+
+            std::ostringstream key;
+
+            // Vectors are told apart by their memory: an object that was
+            // swapped between the statements refers to different memory in
+            // each of them.
+            auto id = [&](const fused_vector_info &v) -> size_t {
+                auto i = index.insert(std::make_pair(v.id, vec.size()));
+
+                if (i.second) {
+                    vec.push_back(v);
+                    load.push_back(false);
+                    store.push_back(false);
+                }
+
+                return i.first->second;
+            };
+
+            // Names of the private variables, by vector object, for each
+            // of the statements.
+            std::vector<fused_vector_names> names(s.size());
+
+            auto name = [&](size_t i, const fused_vector_info &v, size_t k) {
+                std::ostringstream n;
+                n << "val_" << k + 1;
+                names[i][v.ptr] = n.str();
+            };
+
+            for(size_t i = 0; i < s.size(); ++i) {
+                const std::vector<fused_vector_info> &l = s[i]->lhs_vec;
+                const std::vector<fused_vector_info> &r = s[i]->rhs_vec;
+
+                key << s[i]->signature() << ":";
+
+                for(auto v = r.begin(); v != r.end(); ++v) {
+                    size_t k = id(*v);
+                    if (!store[k]) load[k] = true;
+                    name(i, *v, k);
+                    key << " " << k;
+                }
+
+                size_t k = id(l.front());
+                if (s[i]->reads_lhs() && !store[k]) load[k] = true;
+                store[k] = true;
+                name(i, l.front(), k);
+                key << " " << k << ";";
+            }
+
+            // Generator state for the i-th statement.
+            auto state = [&](kernel_generator_state_ptr st, size_t i) {
+                (*st)["fused_vectors"] = names[i];
+                return st;
+            };
+
+            auto prefix = [](size_t i) -> std::string {
+                std::ostringstream p;
+                p << "prm" << i + 1;
+                return p.str();
+            };
+
+            kernel_cache &cache = get_cache(key.str());
+
+            for(unsigned d = 0; d < queue.size(); d++) {
+                backend::select_context(queue[d]);
+
+                auto &kernel = cache.get(queue[d], [&]() -> backend::kernel {
+                    backend::source_generator source(queue[d]);
+
+                    auto pre = empty_state();
+                    for(size_t i = 0; i < s.size(); ++i)
+                        s[i]->preamble(source, queue[d], prefix(i), state(pre, i));
+
+                    source.kernel("vexcl_fused_kernel")
+                        .open("(")
+                            .parameter<size_t>("n");
+
+                    for(size_t k = 0; k < vec.size(); ++k) {
+                        std::ostringstream name;
+                        name << "vec_" << k + 1;
+                        vec[k].declare(source, name.str());
+                    }
+
+                    auto decl = empty_state();
+                    for(size_t i = 0; i < s.size(); ++i)
+                        s[i]->declare(source, queue[d], prefix(i), state(decl, i));
+
+                    source.close(")").open("{");
+                    source.grid_stride_loop().open("{");
+
+                    for(size_t k = 0; k < vec.size(); ++k) {
+                        source.new_line() << vec[k].type << " val_" << k + 1;
+                        if (load[k]) source << " = vec_" << k + 1 << "[idx]";
+                        source << ";";
+                    }
+
+                    auto loc  = empty_state();
+                    auto expr = empty_state();
+                    for(size_t i = 0; i < s.size(); ++i)
+                        s[i]->assign(source, queue[d], prefix(i),
+                                state(loc, i), state(expr, i));
+
+                    for(size_t k = 0; k < vec.size(); ++k)
+                        if (store[k])
+                            source.new_line() << "vec_" << k + 1 << "[idx] = val_" << k + 1 << ";";
+
+                    source.close("}").close("}");
+
+                    return backend::kernel(queue[d], source.str(), "vexcl_fused_kernel");
+                });
+
+                if (size_t psize = part[d + 1] - part[d]) {
+                    kernel.tune(queue[d], psize);
+                    kernel.push_arg(psize);
+
+                    for(size_t k = 0; k < vec.size(); ++k)
+                        vec[k].set(kernel, d);
+
+                    auto setarg = empty_state();
+                    for(size_t i = 0; i < s.size(); ++i)
+                        s[i]->set_args(kernel, d, part[d], state(setarg, i));
+
+                    kernel(queue[d]);
+                }
+            }
+        }
+    private:
+        std::vector< std::unique_ptr<fused_statement> > stmt;
+        std::vector<const void*> touched;
+
+        std::vector<backend::command_queue> queue;
+        std::vector<size_t> part;
+
+        void touch(const std::vector<fused_vector_info> &v) {
+            for(auto i = v.begin(); i != v.end(); ++i) {
+                touched.push_back(i->ptr);
+                touched.push_back(i->id);
+            }
+        }
+
+        bool compatible(const std::vector<backend::command_queue> &q,
+                const std::vector<size_t> &p) const
+        {
+            if (p != part || q.size() != queue.size()) return false;
+
+            for(size_t i = 0; i < q.size(); ++i)
+                if (!backend::same_queue(q[i], queue[i])) return false;
+
+            return true;
+        }
+
+        // One kernel cache per sequence of statement types.
+        static kernel_cache& get_cache(const std::string &key) {
+            static detail::mutex mx;
+            static std::map< std::string, std::unique_ptr<kernel_cache> > caches;
+
+            detail::lock_guard lock(mx);
+
+            auto &c = caches[key];
+            if (!c) c.reset(new kernel_cache);
+            return *c;
+        }
+};
+
+// Launches all recorded statements.
+inline void fusion_barrier() {
+    fused_sequence *s = fused_sequence::active();
+    if (s && !s->empty()) s->flush();
+}
+
+// Launches the recorded statements that reference the given vector or its
+// memory.
+template <class V>
+void fusion_barrier(const V &v) {
+    fused_sequence *s = fused_sequence::active();
+    if (s && !s->empty() && s->references(&v, traits::fused_vector<V>::id(v)))
+        s->flush();
+}
+
+// Records the assignment when a fusion scope is active and the expression is
+// element-wise. Otherwise, assigns the expression immediately.
+template <class OP, class LHS, class RHS>
+void assign_or_fuse(LHS &lhs, const RHS &rhs,
+        const std::vector<backend::command_queue> &queue,
+        const std::vector<size_t> &part
+        )
+{
+    if (fused_sequence *s = fused_sequence::active()) {
+        bool ok = true;
+        extract_terminals()(boost::proto::as_child(rhs), check_fusable(ok));
+
+        if (ok) {
+#if (VEXCL_CHECK_SIZES > 0)
+            get_expression_properties prop;
+            extract_terminals()(boost::proto::as_child(rhs), prop);
+
+            precondition(
+                    prop.queue.empty() || prop.queue.size() == queue.size(),
+                    "Incompatible queue lists"
+                    );
+
+            precondition(
+                    prop.size == 0 || prop.size == part.back(),
+                    "Incompatible expression sizes"
+                    );
+#endif
+            s->record<OP>(lhs, rhs, queue, part);
+            return;
+        }
+    }
+
+    assign_expression<OP>(lhs, rhs, queue, part);
+}
+
+} // namespace detail
+
+/// \endcond
+
+/// Fuses element-wise vector assignments made in its lifetime.
+/**
+ * While a fusion scope is alive, element-wise assignments to vectors (whose
+ * right-hand sides only consist of vectors, scalars, constants, and element
+ * indices) are recorded instead of being executed. Consecutive recorded
+ * assignments with the same partitioning are emitted as a single kernel when
+ * the scope is destroyed or flushed, which saves memory traffic for vectors
+ * that are shared between the statements:
+ \code
+ {
+     vex::fusion_scope fuse;
+     r = b - y;
+     p = r + beta * p;
+     x += alpha * p;
+ } // One kernel is launched here.
+ \endcode
+ * The recorded statements are also launched before any other operation that
+ * touches their vectors (another kernel, a reduction, or a host transfer).
+ */
+class fusion_scope {
+    public:
+        fusion_scope()
+            : prev(detail::fused_sequence::active()),
+              unwinding(uncaught_exceptions())
+        {
+            if (prev) prev->flush();
+            detail::fused_sequence::active() = &seq;
+        }
+
+        /// Launches the recorded statements.
+        /**
+         * Errors are thrown, unless the scope itself is left because of an
+         * exception (the statements are still launched then, but their
+         * errors are ignored). Call flush() before the end of the scope to
+         * handle the errors without relying on a throwing destructor.
+         */
+        ~fusion_scope() BOOST_NOEXCEPT_IF(false) {
+            detail::fused_sequence::active() = prev;
+
+            if (uncaught_exceptions() > unwinding) return;
+
+            seq.flush();
+        }
+
+        /// Launches the recorded statements.
+        void flush() {
+            seq.flush();
+        }
+    private:
+        detail::fused_sequence  seq;
+        detail::fused_sequence *prev;
+        int                     unwinding;
+
+        // Number of exceptions in flight.
+        static int uncaught_exceptions() {
+#ifdef __cpp_lib_uncaught_exceptions
+            return std::uncaught_exceptions();
+#else
+            return std::uncaught_exception() ? 1 : 0;
+#endif
+        }
+
+        fusion_scope(const fusion_scope&);
+        fusion_scope& operator=(const fusion_scope&);
+};
+
+} // namespace vex
+
+#endif
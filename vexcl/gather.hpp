@@ -51,6 +51,8 @@ class gather {
             : queue(queue), ptr(queue.size() + 1, 0),
               idx(queue.size()), val(queue.size())
         {
+            memory_category cat("gather");
+
             assert(std::is_sorted(indices.begin(), indices.end()));
 
             std::vector<size_t> part = partition(src_size, queue);
@@ -490,7 +490,8 @@ class Kernel {
                 const std::vector<backend::command_queue> &queue,
                 const std::string &name, const std::string &body,
                 const ArgTuple& args
-              ) : queue(queue)
+              ) : queue(queue), name(name),
+                  cache(std::make_shared<vex::detail::kernel_cache>())
         {
             static_assert(
                     boost::tuples::length<ArgTuple>::value == NP,
@@ -517,11 +518,10 @@ class Kernel {
 
                 source.close("}").close("}");
 
+                src.push_back(source.str());
+
                 backend::select_context(*q);
-                cache.insert(std::make_pair(
-                            backend::cache_key(*q),
-                            backend::kernel(*q, source.str(), name.c_str())
-                            ));
+                build(*q, src.back());
             }
         }
 
@@ -558,18 +558,23 @@ BOOST_PP_REPEAT_FROM_TO(1, VEXCL_MAX_ARITY, VEXCL_FUNCALL_OPERATOR, ~)
 
             for(unsigned d = 0; d < queue.size(); d++) {
                 if (size_t psize = boost::fusion::fold(param, 0, param_size(d))) {
-                    auto key = backend::cache_key(queue[d]);
-                    auto krn = cache.find(key);
-                    krn->second.push_arg(psize);
+                    auto &krn = build(queue[d], src[d]);
+                    krn.push_arg(psize);
 
-                    set_params setprm(krn->second, d);
+                    set_params setprm(krn, d);
                     boost::fusion::for_each(param, setprm);
 
-                    krn->second(queue[d]);
+                    krn(queue[d]);
                 }
             }
         }
 
+        backend::kernel& build(const backend::command_queue &q, const std::string &source) {
+            return cache->get(q, [&]() {
+                    return backend::kernel(q, source, name.c_str());
+                    });
+        }
+
         struct declare_params {
             backend::source_generator &src;
 
@@ -622,7 +627,10 @@ BOOST_PP_REPEAT_FROM_TO(1, VEXCL_MAX_ARITY, VEXCL_FUNCALL_OPERATOR, ~)
 
         std::vector<backend::command_queue> queue;
 
-        vex::detail::kernel_cache cache;
+        std::string                         name;
+        std::vector<std::string>            src;
+
+        std::shared_ptr<vex::detail::kernel_cache> cache;
 
         struct param_size {
             unsigned device;
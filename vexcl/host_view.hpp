@@ -0,0 +1,117 @@
+#ifndef VEXCL_HOST_VIEW_HPP
+#define VEXCL_HOST_VIEW_HPP
+
+/*
+The MIT License
+
+Copyright (c) 2012-2014 Denis Demidov <dennis.demidov@gmail.com>
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+
+/**
+ * \file   vexcl/host_view.hpp
+ * \author Denis Demidov <dennis.demidov@gmail.com>
+ * \brief  Vectors using host memory as storage, and mapped host access.
+ */
+
+#include <vector>
+#include <algorithm>
+#include <type_traits>
+
+#include <vexcl/vector.hpp>
+
+namespace vex {
+
+/// Creates vector that uses the given host memory as its storage.
+/**
+ * The memory is wrapped with CL_MEM_USE_HOST_PTR, so that on CPU devices
+ * the kernels operate on the application memory in place, without copies
+ * (the memory should be aligned to 4096 bytes for the zero-copy path to be
+ * taken by all OpenCL implementations). Other devices may cache the data in
+ * device memory.
+ *
+ * The host memory should outlive the vector, and its contents are only
+ * guaranteed to be consistent with the vector while it is mapped (see
+ * vex::mapped_view).
+ *
+ * \note Only supported by the OpenCL backend.
+ */
+template <typename T>
+vector<T> host_view(const std::vector<backend::command_queue> &queue,
+        T *host, size_t size)
+{
+#ifdef VEXCL_BACKEND_CUDA
+    static_assert(!std::is_same<T, T>::value,
+            "Host views are only supported by OpenCL backend");
+    return vector<T>();
+#else
+    return vector<T>(queue, size, host, CL_MEM_READ_WRITE | CL_MEM_USE_HOST_PTR);
+#endif
+}
+
+/// Creates vector that uses the given host vector as its storage.
+template <typename T, class Alloc>
+vector<T> host_view(const std::vector<backend::command_queue> &queue,
+        std::vector<T, Alloc> &host)
+{
+    return host_view(queue, host.data(), host.size());
+}
+
+/// Host access to all partitions of a vector.
+/**
+ * Maps every partition of the vector to host memory on construction and
+ * unmaps them on destruction. For vectors created with vex::host_view() on
+ * CPU devices the mapping does not copy any data, and the mapped memory is
+ * the original host memory. Kernels should not access the vector while it
+ * is mapped.
+ */
+template <typename T>
+class mapped_view {
+    public:
+        explicit mapped_view(vector<T> &v) : v(v) {
+            ptr.reserve(v.nparts());
+            for(unsigned d = 0; d < v.nparts(); ++d) ptr.push_back(v.map(d));
+        }
+
+        /// Returns size of the vector.
+        size_t size() const {
+            return v.size();
+        }
+
+        /// Returns pointer to the mapped partition of the given device.
+        T* part(unsigned d) const {
+            return ptr[d].get();
+        }
+
+        /// Returns reference to the element of the vector.
+        T& operator[](size_t i) const {
+            unsigned d = 0;
+            while(i >= v.part_start(d) + v.part_size(d)) ++d;
+            return ptr[d][i - v.part_start(d)];
+        }
+    private:
+        vector<T> &v;
+        std::vector<typename backend::device_vector<T>::mapped_array> ptr;
+};
+
+} // namespace vex
+
+#endif
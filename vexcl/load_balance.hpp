@@ -0,0 +1,203 @@
+#ifndef VEXCL_LOAD_BALANCE_HPP
+#define VEXCL_LOAD_BALANCE_HPP
+
+/*
+The MIT License
+
+Copyright (c) 2012-2014 Denis Demidov <dennis.demidov@gmail.com>
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+
+/**
+ * \file   vexcl/load_balance.hpp
+ * \author Denis Demidov <dennis.demidov@gmail.com>
+ * \brief  Measurement of device performance for adaptive partitioning.
+ */
+
+#include <vector>
+#include <map>
+#include <atomic>
+#include <cstdlib>
+
+#include <vexcl/backend.hpp>
+#include <vexcl/detail/mutex.hpp>
+
+namespace vex {
+
+/// \cond INTERNAL
+
+/// Collects relative device performance from real multi-device launches.
+/**
+ * Every interval-th multi-device element-wise assignment or sparse
+ * matrix-vector product of at least min_size elements is timed on each
+ * device separately (the devices are synchronized around the launch). The
+ * rate of each device (elements per second) relative to the mean rate of the
+ * launch is smoothed with exponential moving average. The measured weights
+ * are only used for partitioning after rebalance_partitioning() is called.
+ */
+template <bool dummy = true>
+struct load_balancer {
+    static_assert(dummy, "dummy parameter should be true");
+
+    static const size_t interval = 16;
+    static const size_t min_size = 65536;
+
+    static void enable(bool on, double smoothing) {
+        state &s = get();
+        detail::lock_guard lock(s.mx);
+
+        s.alpha = smoothing;
+        s.on.store(on);
+    }
+
+    /// Returns true if the launch on the given queues should be timed.
+    /**
+     * Called for every large multi-device launch, so it does not lock.
+     */
+    static bool sample(size_t ndev, size_t n) {
+        if (ndev < 2 || n < min_size) return false;
+
+        state &s = get();
+        if (!s.on.load(std::memory_order_relaxed)) return false;
+
+        size_t k = s.launches.fetch_add(1, std::memory_order_relaxed) + 1;
+        return k % interval == 0;
+    }
+
+    /// Reports per-device times of a timed launch.
+    static void report(const std::vector<backend::command_queue> &queue,
+            const std::vector<size_t> &part, const std::vector<double> &time)
+    {
+        std::vector<double> rate(queue.size());
+        double mean = 0;
+
+        for(unsigned d = 0; d < queue.size(); d++) {
+            size_t n = part[d + 1] - part[d];
+
+            // Idle devices can not be measured.
+            if (!n || time[d] <= 0) return;
+
+            rate[d] = n / time[d];
+            mean += rate[d] / queue.size();
+        }
+
+        state &s = get();
+        detail::lock_guard lock(s.mx);
+
+        for(unsigned d = 0; d < queue.size(); d++) {
+            double w = rate[d] / mean;
+
+            auto m = s.weight.insert(std::make_pair(backend::get_device_id(queue[d]), w));
+            if (!m.second) m.first->second += s.alpha * (w - m.first->second);
+        }
+    }
+
+    /// Measured relative weights of the devices.
+    /**
+     * Returns false if some of the devices have not been measured yet.
+     */
+    static bool weights(const std::vector<backend::command_queue> &queue,
+            std::vector<double> &w)
+    {
+        state &s = get();
+        detail::lock_guard lock(s.mx);
+
+        w.resize(queue.size());
+        for(unsigned d = 0; d < queue.size(); d++) {
+            auto m = s.weight.find(backend::get_device_id(queue[d]));
+            if (m == s.weight.end()) return false;
+            w[d] = m->second;
+        }
+
+        return true;
+    }
+
+    private:
+        struct state {
+            detail::mutex mx;
+            std::atomic<bool>   on;
+            double              alpha;
+            std::atomic<size_t> launches;
+            std::map<backend::device_id, double> weight;
+
+            state() : on(false), alpha(0.25), launches(0) {
+#ifdef _MSC_VER
+#  pragma warning(push)
+#  pragma warning(disable: 4996)
+#endif
+                on = getenv("VEXCL_ADAPTIVE_PARTITIONING") != 0;
+#ifdef _MSC_VER
+#  pragma warning(pop)
+#endif
+            }
+        };
+
+        static state& get() {
+            static state s;
+            return s;
+        }
+};
+
+/// Times per-device launches of a multi-device operation.
+class load_sample {
+    public:
+        load_sample(const std::vector<backend::command_queue> &queue,
+                const std::vector<size_t> &part)
+            : queue(queue), part(part),
+              active(load_balancer<>::sample(queue.size(), part.back())),
+              t0(0)
+        {
+            if (active) time.resize(queue.size(), 0.0);
+        }
+
+        /// Should be called before the launch on the d-th device.
+        void start(unsigned d) {
+            if (!active) return;
+
+            queue[d].finish();
+            t0 = autotuner<>::now();
+        }
+
+        /// Should be called after the launch on the d-th device.
+        void stop(unsigned d) {
+            if (!active) return;
+
+            queue[d].finish();
+            time[d] = autotuner<>::now() - t0;
+        }
+
+        /// Reports the measured times to the load balancer.
+        void report() {
+            if (active) load_balancer<>::report(queue, part, time);
+        }
+    private:
+        const std::vector<backend::command_queue> &queue;
+        const std::vector<size_t> &part;
+        bool active;
+        double t0;
+        std::vector<double> time;
+};
+
+/// \endcond
+
+} // namespace vex
+
+#endif
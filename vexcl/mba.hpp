@@ -276,6 +276,8 @@ BOOST_PP_REPEAT_FROM_TO(1, VEXCL_MAX_ARITY, VEXCL_FUNCALL_OPERATOR, ~)
                 std::array<size_t, NDIM> grid, size_t levels = 8, real tol = 1e-8
                 )
         {
+            memory_category cat("mba");
+
             for(size_t k = 0; k < NDIM; ++k)
                 assert(grid[k] > 1);
 
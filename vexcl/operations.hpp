@@ -32,17 +32,26 @@ THE SOFTWARE.
  */
 
 #include <array>
+#include <map>
 #include <tuple>
 #include <deque>
+#include <set>
 #include <memory>
+#include <atomic>
+#include <algorithm>
+#include <typeinfo>
+#include <cstdlib>
 
 #include <boost/proto/proto.hpp>
 #include <boost/mpl/max.hpp>
 #include <boost/any.hpp>
+#include <boost/optional.hpp>
 
 #include <vexcl/backend.hpp>
 #include <vexcl/types.hpp>
 #include <vexcl/util.hpp>
+#include <vexcl/detail/mutex.hpp>
+#include <vexcl/load_balance.hpp>
 
 // Include boost.preprocessor header if variadic templates are not available.
 // Also include it if we use gcc v4.6.
@@ -389,6 +398,48 @@ struct terminal_is_value :
  */
 template <class T> struct is_scalable : std::false_type {};
 
+// Terminals that may take part in vectorized (SIMD) assignments of
+// T-valued expressions on CPU devices.
+template <class Term, class T, class Enable = void>
+struct simd_terminal : std::false_type {};
+
+// Values a terminal wants the generated kernel to be specialized for (see
+// vex::specialize()).
+template <class Term, class Enable = void>
+struct specialization_key {
+    static void get(std::string&, const Term&) {}
+};
+
+// Terminals with a specialization_key. Expressions without such terminals
+// are not searched for the values.
+template <class Term, class Enable = void>
+struct is_specialized_terminal : std::false_type {};
+
+// Terminals that only depend on the current element index, and so may be used
+// in fused assignments (see vex::fusion_scope).
+template <class Term, class Enable = void>
+struct is_fusable_terminal : is_cl_native<Term> {};
+
+// Lhs terminals that may be assigned with vector stores. Specializations
+// should define value_type.
+template <class Term>
+struct simd_lhs : std::false_type {};
+
+// Lhs terminals that can not be assigned with plain assignment operator (e.g.
+// vectors with reduced precision storage). Specializations should define
+// static void store(src, prm_name, op, rhs) that outputs the statement.
+template <class Term, class Enable = void>
+struct converting_store : std::false_type {};
+
+// Scalars are broadcast to all vector components:
+template <class Term, class T>
+struct simd_terminal<Term, T,
+    typename std::enable_if<
+        std::is_same<Term, T>::value || std::is_integral<Term>::value
+    >::type
+    > : std::true_type
+{};
+
 } // namespace traits
 
 //---------------------------------------------------------------------------
@@ -1473,7 +1524,8 @@ struct vector_expr_context : public expression_context {
 #define VEXCL_BINARY_OPERATION(the_tag, the_op)                                \
   template <typename Expr> struct eval<Expr, boost::proto::tag::the_tag> {     \
     typedef void result_type;                                                  \
-    void operator()(const Expr &expr, vector_expr_context &ctx) const {        \
+    template <class Context>                                                   \
+    void operator()(const Expr &expr, Context &ctx) const {                    \
       ctx.src << "( ";                                                         \
       boost::proto::eval(boost::proto::left(expr), ctx);                       \
       ctx.src << " " #the_op " ";                                              \
@@ -1506,7 +1558,8 @@ struct vector_expr_context : public expression_context {
 #define VEXCL_UNARY_PRE_OPERATION(the_tag, the_op)                             \
   template <typename Expr> struct eval<Expr, boost::proto::tag::the_tag> {     \
     typedef void result_type;                                                  \
-    void operator()(const Expr &expr, vector_expr_context &ctx) const {        \
+    template <class Context>                                                   \
+    void operator()(const Expr &expr, Context &ctx) const {                    \
       ctx.src << "( " #the_op "( ";                                            \
       boost::proto::eval(boost::proto::child(expr), ctx);                      \
       ctx.src << " ) )";                                                       \
@@ -1526,7 +1579,8 @@ struct vector_expr_context : public expression_context {
 #define VEXCL_UNARY_POST_OPERATION(the_tag, the_op)                            \
   template <typename Expr> struct eval<Expr, boost::proto::tag::the_tag> {     \
     typedef void result_type;                                                  \
-    void operator()(const Expr &expr, vector_expr_context &ctx) const {        \
+    template <class Context>                                                   \
+    void operator()(const Expr &expr, Context &ctx) const {                    \
       ctx.src << "( ( ";                                                       \
       boost::proto::eval(boost::proto::child(expr), ctx);                      \
       ctx.src << " )" #the_op " )";                                            \
@@ -1541,7 +1595,8 @@ struct vector_expr_context : public expression_context {
     template <typename Expr>
     struct eval<Expr, boost::proto::tag::if_else_> {
         typedef void result_type;
-        void operator()(const Expr &expr, vector_expr_context &ctx) const {
+        template <class Context>
+        void operator()(const Expr &expr, Context &ctx) const {
             ctx.src << "( ";
             boost::proto::eval(boost::proto::child_c<0>(expr), ctx);
             ctx.src << " ? ";
@@ -1556,11 +1611,12 @@ struct vector_expr_context : public expression_context {
     struct eval<Expr, boost::proto::tag::function> {
         typedef void result_type;
 
+        template <class Context>
         struct do_eval {
             mutable int pos;
-            vector_expr_context &ctx;
+            Context &ctx;
 
-            do_eval(vector_expr_context &ctx) : pos(0), ctx(ctx) {}
+            do_eval(Context &ctx) : pos(0), ctx(ctx) {}
 
             template <typename Arg>
             void operator()(const Arg &arg) const {
@@ -1569,7 +1625,7 @@ struct vector_expr_context : public expression_context {
             }
         };
 
-        template <class FunCall>
+        template <class FunCall, class Context>
         typename std::enable_if<
             std::is_base_of<
                 builtin_function,
@@ -1579,15 +1635,15 @@ struct vector_expr_context : public expression_context {
             >::value,
         void
         >::type
-        operator()(const FunCall &expr, vector_expr_context &ctx) const {
+        operator()(const FunCall &expr, Context &ctx) const {
             ctx.src << boost::proto::value(boost::proto::child_c<0>(expr)).name() << "( ";
             boost::fusion::for_each(
-                    boost::fusion::pop_front(expr), do_eval(ctx)
+                    boost::fusion::pop_front(expr), do_eval<Context>(ctx)
                     );
             ctx.src << " )";
         }
 
-        template <class FunCall>
+        template <class FunCall, class Context>
         typename std::enable_if<
             std::is_base_of<
                 user_function,
@@ -1597,10 +1653,10 @@ struct vector_expr_context : public expression_context {
             >::value,
         void
         >::type
-        operator()(const FunCall &expr, vector_expr_context &ctx) const {
+        operator()(const FunCall &expr, Context &ctx) const {
             ctx.src << ctx.prefix << "_func_" << ++ctx.fun_idx << "( ";
             boost::fusion::for_each(
-                    boost::fusion::pop_front(expr), do_eval(ctx)
+                    boost::fusion::pop_front(expr), do_eval<Context>(ctx)
                     );
             ctx.src << " )";
         }
@@ -1610,9 +1666,9 @@ struct vector_expr_context : public expression_context {
     struct eval<Expr, boost::proto::tag::terminal> {
         typedef void result_type;
 
-        template <typename Term>
+        template <typename Term, class Context>
         typename std::enable_if<traits::terminal_is_value<Term>::value, void>::type
-        operator()(const Term &term, vector_expr_context &ctx) const {
+        operator()(const Term &term, Context &ctx) const {
             std::ostringstream prm_name;
             prm_name << ctx.prefix << "_" << ++ctx.prm_idx;
 
@@ -1620,9 +1676,9 @@ struct vector_expr_context : public expression_context {
                     prm_name.str(), ctx.state);
         }
 
-        template <typename Term>
+        template <typename Term, class Context>
         typename std::enable_if<!traits::terminal_is_value<Term>::value, void>::type
-        operator()(const Term &term, vector_expr_context &ctx) const {
+        operator()(const Term &term, Context &ctx) const {
             std::ostringstream prm_name;
             prm_name << ctx.prefix << "_" << ++ctx.prm_idx;
 
@@ -1632,6 +1688,443 @@ struct vector_expr_context : public expression_context {
     };
 };
 
+// Common subexpression elimination.
+//
+// The expression is evaluated twice with cse_context. The first pass records
+// text of each subexpression and counts the occurrences outside of
+// conditionally evaluated operands. The second pass replaces subexpressions
+// that occur more than once with local variables. Vector terminals referring
+// to the same object are given the same text, so that they are loaded once
+// and subexpressions depending on them are recognized as identical. The same
+// holds for calls to the same user-defined function.
+template <class Tag>
+struct cse_candidate : std::false_type {};
+
+#define VEXCL_CSE_CANDIDATE(the_tag)                                           \
+  template <> struct cse_candidate<boost::proto::tag::the_tag>                 \
+    : std::true_type {}
+
+VEXCL_CSE_CANDIDATE(plus);
+VEXCL_CSE_CANDIDATE(minus);
+VEXCL_CSE_CANDIDATE(multiplies);
+VEXCL_CSE_CANDIDATE(divides);
+VEXCL_CSE_CANDIDATE(modulus);
+VEXCL_CSE_CANDIDATE(shift_left);
+VEXCL_CSE_CANDIDATE(shift_right);
+VEXCL_CSE_CANDIDATE(less);
+VEXCL_CSE_CANDIDATE(greater);
+VEXCL_CSE_CANDIDATE(less_equal);
+VEXCL_CSE_CANDIDATE(greater_equal);
+VEXCL_CSE_CANDIDATE(equal_to);
+VEXCL_CSE_CANDIDATE(not_equal_to);
+VEXCL_CSE_CANDIDATE(logical_and);
+VEXCL_CSE_CANDIDATE(logical_or);
+VEXCL_CSE_CANDIDATE(bitwise_and);
+VEXCL_CSE_CANDIDATE(bitwise_or);
+VEXCL_CSE_CANDIDATE(bitwise_xor);
+VEXCL_CSE_CANDIDATE(unary_plus);
+VEXCL_CSE_CANDIDATE(negate);
+VEXCL_CSE_CANDIDATE(logical_not);
+VEXCL_CSE_CANDIDATE(if_else_);
+VEXCL_CSE_CANDIDATE(function);
+
+#undef VEXCL_CSE_CANDIDATE
+
+// Only scalar subexpressions are hoisted, since deduced types of builtin
+// functions of vector arguments may be wrong.
+template <class Expr, bool = cse_candidate<typename Expr::proto_tag>::value>
+struct cse_hoistable : std::false_type {};
+
+template <class Expr>
+struct cse_hoistable<Expr, true>
+    : std::is_arithmetic<typename return_type<Expr>::type>
+{};
+
+struct cse_table {
+    struct node {
+        std::string text;
+        int  parent;
+        bool cond;
+        bool replaced;  // Refers to a local variable defined elsewhere.
+    };
+
+    bool   emit;
+    int    open;        // Innermost subexpression being evaluated.
+    size_t next;
+
+    std::vector<node>                  nodes; // Subexpressions in pre-order.
+    std::set<std::string>              hoist; // Texts of the hoisted subexpressions.
+    std::map<const void*, std::string> term;  // Texts of vector terminals.
+    std::map<std::string, std::string> func;  // Names of user functions.
+    std::map<std::string, std::string> local; // Names of the local variables.
+    std::vector<std::string>           decl;  // Declarations of the local variables.
+
+    cse_table() : emit(false), open(-1), next(0) {}
+
+    // Selects subexpressions to hoist. Outer subexpressions are considered
+    // first; occurrences inside replaced subexpressions are not counted.
+    void select() {
+        std::map<std::string, std::vector<size_t> > occ;
+        for(size_t i = 0; i < nodes.size(); ++i)
+            occ[nodes[i].text].push_back(i);
+
+        std::vector<std::string> keys;
+        for(auto o = occ.begin(); o != occ.end(); ++o)
+            if (o->second.size() > 1) keys.push_back(o->first);
+
+        std::stable_sort(keys.begin(), keys.end(), longer);
+
+        for(auto k = keys.begin(); k != keys.end(); ++k) {
+            std::vector<size_t> live;
+            int uses = 0;
+
+            const std::vector<size_t> &o = occ[*k];
+            for(auto i = o.begin(); i != o.end(); ++i) {
+                if (inside_replaced(*i)) continue;
+                live.push_back(*i);
+                if (!nodes[*i].cond) ++uses;
+            }
+
+            if (uses < 2) continue;
+
+            hoist.insert(*k);
+            for(size_t i = 1; i < live.size(); ++i)
+                nodes[live[i]].replaced = true;
+        }
+    }
+
+    bool inside_replaced(size_t i) const {
+        for(int p = nodes[i].parent; p >= 0; p = nodes[p].parent)
+            if (nodes[p].replaced) return true;
+        return false;
+    }
+
+    static bool longer(const std::string &a, const std::string &b) {
+        return a.size() > b.size();
+    }
+};
+
+struct cse_context : public vector_expr_context {
+    cse_table &cse;
+    int cond;
+
+    cse_context(
+            backend::source_generator &src, const backend::command_queue &queue,
+            const std::string &prefix, kernel_generator_state_ptr state,
+            cse_table &cse
+            )
+        : vector_expr_context(src, queue, prefix, state), cse(cse), cond(0)
+    {}
+
+    // Outputs subexpression into a string.
+    template <class Format>
+    std::string text(Format &&format) {
+        backend::source_generator s;
+        cse_context sub(s, queue, prefix, state, cse);
+
+        sub.prm_idx = prm_idx;
+        sub.fun_idx = fun_idx;
+        sub.cond    = cond;
+
+        format(sub);
+
+        prm_idx = sub.prm_idx;
+        fun_idx = sub.fun_idx;
+
+        return s.str();
+    }
+
+    template <class Expr, class Format>
+    void subexpression(Format &&format) {
+        subexpression<Expr>(std::forward<Format>(format),
+                std::integral_constant<bool, cse_hoistable<Expr>::value>());
+    }
+
+    template <class Expr, class Format>
+    void subexpression(Format &&format, std::false_type) {
+        src << text(std::forward<Format>(format));
+    }
+
+    template <class Expr, class Format>
+    void subexpression(Format &&format, std::true_type) {
+        size_t id = cse.next++;
+
+        if (!cse.emit) {
+            cse_table::node n = {std::string(), cse.open, cond > 0, false};
+            cse.nodes.push_back(n);
+        }
+
+        int parent = cse.open;
+        cse.open = static_cast<int>(id);
+        std::string out = text(std::forward<Format>(format));
+        cse.open = parent;
+
+        if (!cse.emit) {
+            cse.nodes[id].text = out;
+            src << out;
+            return;
+        }
+
+        const std::string &key = cse.nodes[id].text;
+
+        if (!cse.hoist.count(key)) {
+            src << out;
+            return;
+        }
+
+        auto l = cse.local.find(key);
+        if (l == cse.local.end()) {
+            std::ostringstream name;
+            name << prefix << "_cse_" << cse.local.size() + 1;
+
+            cse.decl.push_back("const " +
+                    type_name<typename return_type<Expr>::type>() + " " +
+                    name.str() + " = " + out + ";");
+
+            l = cse.local.insert(std::make_pair(key, name.str())).first;
+        }
+
+        src << l->second;
+    }
+
+    template <typename Expr, typename Tag = typename Expr::proto_tag>
+    struct eval {
+        typedef void result_type;
+
+        void operator()(const Expr &expr, cse_context &ctx) const {
+            ctx.subexpression<Expr>([&](cse_context &c) {
+                    vector_expr_context::eval<Expr>()(expr, c);
+                    });
+        }
+    };
+
+    // Operands that are evaluated conditionally are not hoisted.
+    template <typename Expr>
+    struct eval<Expr, boost::proto::tag::if_else_> {
+        typedef void result_type;
+
+        void operator()(const Expr &expr, cse_context &ctx) const {
+            ctx.subexpression<Expr>([&](cse_context &c) {
+                    c.src << "( ";
+                    boost::proto::eval(boost::proto::child_c<0>(expr), c);
+                    ++c.cond;
+                    c.src << " ? ";
+                    boost::proto::eval(boost::proto::child_c<1>(expr), c);
+                    c.src << " : ";
+                    boost::proto::eval(boost::proto::child_c<2>(expr), c);
+                    --c.cond;
+                    c.src << " )";
+                    });
+        }
+    };
+
+#define VEXCL_CSE_SHORT_CIRCUIT(the_tag, the_op)                               \
+  template <typename Expr> struct eval<Expr, boost::proto::tag::the_tag> {     \
+    typedef void result_type;                                                  \
+    void operator()(const Expr &expr, cse_context &ctx) const {                \
+      ctx.subexpression<Expr>([&](cse_context &c) {                            \
+          c.src << "( ";                                                       \
+          boost::proto::eval(boost::proto::left(expr), c);                     \
+          c.src << " " #the_op " ";                                            \
+          ++c.cond;                                                            \
+          boost::proto::eval(boost::proto::right(expr), c);                    \
+          --c.cond;                                                            \
+          c.src << " )";                                                       \
+          });                                                                  \
+    }                                                                          \
+  }
+
+    VEXCL_CSE_SHORT_CIRCUIT(logical_and, &&);
+    VEXCL_CSE_SHORT_CIRCUIT(logical_or,  ||);
+
+#undef VEXCL_CSE_SHORT_CIRCUIT
+
+    template <typename Expr>
+    struct eval<Expr, boost::proto::tag::function> {
+        typedef void result_type;
+
+        struct do_eval {
+            mutable int pos;
+            cse_context &ctx;
+
+            do_eval(cse_context &ctx) : pos(0), ctx(ctx) {}
+
+            template <typename Arg>
+            void operator()(const Arg &arg) const {
+                if (pos++) ctx.src << ", ";
+                boost::proto::eval(arg, ctx);
+            }
+        };
+
+        template <class FunCall>
+        typename std::enable_if<
+            !std::is_base_of<
+                user_function,
+                typename boost::proto::result_of::value<
+                    typename boost::proto::result_of::child_c<FunCall,0>::type
+                >::type
+            >::value,
+        void
+        >::type
+        call(const FunCall &expr, cse_context &ctx) const {
+            vector_expr_context::eval<FunCall>()(expr, ctx);
+        }
+
+        // Calls to the same user function refer to the first definition.
+        template <class FunCall>
+        typename std::enable_if<
+            std::is_base_of<
+                user_function,
+                typename boost::proto::result_of::value<
+                    typename boost::proto::result_of::child_c<FunCall,0>::type
+                >::type
+            >::value,
+        void
+        >::type
+        call(const FunCall &expr, cse_context &ctx) const {
+            typedef typename boost::proto::result_of::value<
+                typename boost::proto::result_of::child_c<FunCall,0>::type
+                >::type fun;
+
+            std::ostringstream name;
+            name << ctx.prefix << "_func_" << ++ctx.fun_idx;
+
+            ctx.src << ctx.cse.func.insert(
+                    std::make_pair(std::string(typeid(fun).name()), name.str())
+                    ).first->second << "( ";
+            boost::fusion::for_each(
+                    boost::fusion::pop_front(expr), do_eval(ctx)
+                    );
+            ctx.src << " )";
+        }
+
+        void operator()(const Expr &expr, cse_context &ctx) const {
+            ctx.subexpression<Expr>([&](cse_context &c) { call(expr, c); });
+        }
+    };
+
+    // Terminals held by reference are identified by the object address.
+    template <class Term>
+    static typename std::enable_if<traits::terminal_is_value<Term>::value, const void*>::type
+    terminal_object(const Term &term) {
+        return traits::hold_terminal_by_reference<Term>::value ? std::addressof(term) : 0;
+    }
+
+    template <class Term>
+    static typename std::enable_if<!traits::terminal_is_value<Term>::value, const void*>::type
+    terminal_object(const Term &term) {
+        return traits::hold_terminal_by_reference<
+            typename std::decay<typename boost::proto::result_of::value<Term>::type>::type
+            >::value ? std::addressof(boost::proto::value(term)) : 0;
+    }
+
+    template <typename Expr>
+    struct eval<Expr, boost::proto::tag::terminal> {
+        typedef void result_type;
+
+        void operator()(const Expr &term, cse_context &ctx) const {
+            const void *obj = terminal_object(term);
+
+            if (!obj) {
+                vector_expr_context::eval<Expr>()(term, ctx);
+                return;
+            }
+
+            std::string out = ctx.text([&](cse_context &c) {
+                    vector_expr_context::eval<Expr>()(term, c);
+                    });
+
+            ctx.src << ctx.cse.term.insert(std::make_pair(obj, out)).first->second;
+        }
+    };
+};
+
+// Outputs declarations of the subexpressions of expr that occur more than
+// once, and returns text of expr referring to them.
+template <class Expr>
+std::string eliminate_common_subexpressions(backend::source_generator &src,
+        const Expr &expr, expression_context &ctx)
+{
+    backend::source_generator out;
+
+#ifdef VEXCL_DISABLE_CSE
+    (void)src;
+
+    vector_expr_context c(out, ctx.queue, ctx.prefix, ctx.state);
+
+    c.prm_idx = ctx.prm_idx;
+    c.fun_idx = ctx.fun_idx;
+
+    boost::proto::eval(boost::proto::as_child(expr), c);
+
+    ctx.prm_idx = c.prm_idx;
+    ctx.fun_idx = c.fun_idx;
+#else
+    cse_table cse;
+
+    for(int pass = 0; pass < 2; ++pass) {
+        if (pass) cse.select();
+
+        cse.emit = (pass > 0);
+        cse.next = 0;
+
+        backend::source_generator s;
+        cse_context c(cse.emit ? out : s, ctx.queue, ctx.prefix, ctx.state, cse);
+
+        c.prm_idx = ctx.prm_idx;
+        c.fun_idx = ctx.fun_idx;
+
+        boost::proto::eval(boost::proto::as_child(expr), c);
+
+        if (cse.emit) {
+            ctx.prm_idx = c.prm_idx;
+            ctx.fun_idx = c.fun_idx;
+        }
+    }
+
+    for(auto d = cse.decl.begin(); d != cse.decl.end(); ++d)
+        src.new_line() << *d;
+#endif
+
+    return out.str();
+}
+
+// Describes which of the vector terminals of an expression refer to the same
+// object. Kernels with common subexpressions eliminated depend on this.
+struct terminal_aliasing {
+    std::vector<const void*> &ptr;
+
+    terminal_aliasing(std::vector<const void*> &ptr) : ptr(ptr) {}
+
+    template <typename Term>
+    void operator()(const Term &term) const {
+        if (const void *obj = cse_context::terminal_object(term))
+            ptr.push_back(obj);
+    }
+
+    template <class Expr>
+    static std::string key(const Expr &expr) {
+#ifdef VEXCL_DISABLE_CSE
+        (void)expr;
+        return std::string();
+#else
+        std::vector<const void*> ptr;
+        extract_terminals()(boost::proto::as_child(expr), terminal_aliasing(ptr));
+
+        std::ostringstream s;
+        bool aliased = false;
+
+        for(size_t i = 0; i < ptr.size(); ++i) {
+            size_t j = std::find(ptr.begin(), ptr.end(), ptr[i]) - ptr.begin();
+            if (j < i) aliased = true;
+            s << j << ",";
+        }
+
+        return aliased ? "cse=" + s.str() : std::string();
+#endif
+    }
+};
+
 struct declare_expression_parameter : expression_context {
 
     declare_expression_parameter(backend::source_generator &src,
@@ -1687,6 +2180,34 @@ struct set_expression_argument {
     }
 };
 
+// Collects values the kernel may be specialized for.
+struct get_specialization_key {
+    std::string &key;
+
+    get_specialization_key(std::string &key) : key(key) {}
+
+    template <typename Term>
+    typename std::enable_if<traits::terminal_is_value<Term>::value, void>::type
+    operator()(const Term &term) const {
+        traits::specialization_key<Term>::get(key, term);
+    }
+
+    template <typename Term>
+    typename std::enable_if<!traits::terminal_is_value<Term>::value, void>::type
+    operator()(const Term &term) const {
+        traits::specialization_key<
+            typename std::decay<typename boost::proto::result_of::value<Term>::type>::type
+            >::get(key, boost::proto::value(term));
+    }
+};
+
+// State for generation of the given kernel variant.
+inline kernel_generator_state_ptr variant_state(bool specialized) {
+    auto state = empty_state();
+    if (specialized) (*state)["specialize"] = true;
+    return state;
+}
+
 struct get_expression_properties {
     mutable std::vector<backend::command_queue> queue;
     mutable std::vector<size_t> part;
@@ -2100,11 +2621,18 @@ struct cache_register {
     static_assert(dummy, "Dummy parameter should be true");
 
     static std::deque<kernel_cache*> caches;
+    static detail::mutex mx;
 
     static void add(kernel_cache *cache) {
+        detail::lock_guard lock(mx);
         caches.push_back(cache);
     }
 
+    static void remove(kernel_cache *cache) {
+        detail::lock_guard lock(mx);
+        caches.erase(std::remove(caches.begin(), caches.end(), cache), caches.end());
+    }
+
     static void clear();
     static void erase(backend::kernel_cache_key key);
 };
@@ -2112,136 +2640,628 @@ struct cache_register {
 template <bool dummy>
 std::deque<kernel_cache*> cache_register<dummy>::caches;
 
-struct kernel_cache {
-    typedef std::map<backend::kernel_cache_key, kernel_cache_entry> store_type;
+template <bool dummy>
+detail::mutex cache_register<dummy>::mx;
 
-    store_type store;
+/// Settings of kernel specialization for runtime values.
+/**
+ * \sa vex::specialize(), vex::specialize_sizes()
+ */
+template <bool dummy = true>
+struct jit_specialization {
+    static_assert(dummy, "dummy parameter should be true");
+
+    /// Whether vector sizes are baked into the generated kernels.
+    static bool& sizes() {
+#ifdef _MSC_VER
+#  pragma warning(push)
+#  pragma warning(disable: 4996)
+#endif
+        static bool on = getenv("VEXCL_SPECIALIZE_SIZES") != 0;
+#ifdef _MSC_VER
+#  pragma warning(pop)
+#endif
+        return on;
+    }
+
+    /// Number of specialized variants of a kernel after which the generic
+    /// kernel is used for new values.
+    static size_t& max_variants() {
+        static size_t n = 8;
+        return n;
+    }
+};
 
-    kernel_cache() {
+/// Thread-safe kernel cache.
+/**
+ * A kernel is compiled once per context. Each host thread receives its own
+ * kernel object (sharing the compiled program), so that kernel arguments may
+ * be set concurrently. The per-thread kernels are held in thread-local
+ * storage: lookups do not lock, and the kernels are released when the thread
+ * exits.
+ *
+ * clear() and erase() release the kernels of the calling thread at once.
+ * Other threads replace their kernels on the next lookup (in place, so that
+ * references obtained before stay valid), or release them on exit.
+ *
+ * A cache may also hold variants of the kernel specialized for runtime
+ * values (see variant()).
+ */
+struct kernel_cache {
+    kernel_cache() : uid(new_uid()), gen(0) {
         cache_register<>::add(this);
     }
 
-    template <typename T>
-    std::pair<store_type::iterator, bool> insert(T&& item) {
-        return store.insert(std::forward<T>(item));
+    ~kernel_cache() {
+        cache_register<>::remove(this);
     }
 
-    store_type::const_iterator end() const {
-        return store.end();
+    /// Returns kernel for the given queue, building it on first use.
+    /**
+     * \param build Functor that returns a newly built backend::kernel. It is
+     *              called at most once per context.
+     */
+    template <class Builder>
+    kernel_cache_entry& get(const backend::command_queue &q, Builder &&build) {
+        return get(q, std::string(), std::forward<Builder>(build));
     }
 
-    template <typename T>
-    store_type::iterator find(T&& key) {
-        return store.find( std::forward<T>(key) );
+    /// Returns the given variant of the kernel, building it on first use.
+    template <class Builder>
+    kernel_cache_entry& get(const backend::command_queue &q,
+            const std::string &variant, Builder &&build)
+    {
+        auto key = std::make_pair(backend::cache_key(q), variant);
+        size_t g = gen.load(std::memory_order_acquire);
+
+        thread_slot &t = local()[std::make_pair(uid, key)];
+        if (t.kernel && t.gen == g) return *t.kernel;
+
+        std::shared_ptr<program_slot> p;
+        {
+            detail::lock_guard lock(mx);
+            auto &slot = programs[key];
+            if (!slot) slot = std::make_shared<program_slot>();
+            p = slot;
+        }
+
+        kernel_cache_entry krn;
+        {
+            detail::lock_guard lock(p->mx);
+            if (p->proto) {
+                krn = p->proto->clone();
+            } else {
+                p->proto = build();
+                krn = *p->proto;
+            }
+        }
+
+        // Stale kernels are replaced in place.
+        if (t.kernel)
+            *t.kernel = krn;
+        else
+            t.kernel = krn;
+
+        t.gen = g;
+        return *t.kernel;
+    }
+
+    /// Selects kernel variant for the given specialization values.
+    /**
+     * Returns the values when a kernel specialized for them exists or may
+     * still be built, and an empty string (the generic kernel) when the
+     * values changed too often.
+     */
+    std::string variant(const backend::command_queue &q, const std::string &values) {
+        if (values.empty()) return values;
+
+        auto ctx = backend::cache_key(q);
+        size_t g = gen.load(std::memory_order_acquire);
+
+        // The decisions are remembered by each thread, so that the lock is
+        // only taken for values the thread has not seen yet.
+        known_variants &k = local_variants()[std::make_pair(uid, ctx)];
+
+        if (k.gen != g) {
+            k.gen  = g;
+            k.full = false;
+            k.values.clear();
+        }
+
+        if (k.values.count(values)) return values;
+        if (k.full) return std::string();
+
+        detail::lock_guard lock(mx);
+
+        auto &v = variants[ctx];
+
+        if (!v.count(values) && v.size() < jit_specialization<>::max_variants())
+            v.insert(values);
+
+        // Once the set is full, it does not change until the cache is
+        // cleared.
+        if (v.size() >= jit_specialization<>::max_variants()) {
+            k.values = v;
+            k.full   = true;
+        } else {
+            k.values.insert(values);
+        }
+
+        return v.count(values) ? values : std::string();
     }
 
     void clear() {
-        store.clear();
+        {
+            detail::lock_guard lock(mx);
+            programs.clear();
+            variants.clear();
+            ++gen;
+        }
+
+        forget([](const variant_key&) { return true; });
     }
 
     void erase(backend::kernel_cache_key key) {
-        store.erase(key);
+        {
+            detail::lock_guard lock(mx);
+            for(auto p = programs.begin(); p != programs.end(); ) {
+                if (p->first.first == key)
+                    programs.erase(p++);
+                else
+                    ++p;
+            }
+            variants.erase(key);
+            ++gen;
+        }
+
+        forget([key](const variant_key &k) { return k.first == key; });
     }
+
+    private:
+        typedef std::pair<backend::kernel_cache_key, std::string> variant_key;
+
+        struct program_slot {
+            detail::mutex mx;
+            boost::optional<kernel_cache_entry> proto;
+        };
+
+        // Kernel of a thread, with the generation of the cache it was
+        // cloned in.
+        struct thread_slot {
+            size_t gen;
+            boost::optional<kernel_cache_entry> kernel;
+
+            thread_slot() : gen(0) {}
+        };
+
+        // Kernels of the current thread, by cache id, context and variant.
+        typedef std::map<std::pair<size_t, variant_key>, thread_slot> thread_store;
+
+        // Specialization variants known to the current thread.
+        struct known_variants {
+            size_t gen;
+            bool   full;
+            std::set<std::string> values;
+
+            known_variants() : gen(0), full(false) {}
+        };
+
+        typedef std::map<
+            std::pair<size_t, backend::kernel_cache_key>, known_variants
+            > variant_store;
+
+        const size_t uid;
+
+        // Incremented by clear() and erase(), so that the threads replace
+        // their kernels.
+        std::atomic<size_t> gen;
+
+        detail::mutex mx;
+        std::map<variant_key, std::shared_ptr<program_slot> > programs;
+        std::map<backend::kernel_cache_key, std::set<std::string> > variants;
+
+        static thread_store& local() {
+            return detail::thread_local_instance<thread_store>();
+        }
+
+        static variant_store& local_variants() {
+            return detail::thread_local_instance<variant_store>();
+        }
+
+        static size_t new_uid() {
+            static std::atomic<size_t> last(0);
+            return ++last;
+        }
+
+        // Releases the kernels of the calling thread.
+        template <class Pred>
+        void forget(Pred &&pred) {
+            thread_store &store = local();
+
+            auto k = store.lower_bound(std::make_pair(uid, variant_key()));
+            while(k != store.end() && k->first.first == uid) {
+                if (pred(k->first.second))
+                    store.erase(k++);
+                else
+                    ++k;
+            }
+        }
 };
 
 template <bool dummy>
 void cache_register<dummy>::clear() {
+    detail::lock_guard lock(mx);
     for(auto c = caches.begin(); c != caches.end(); ++c)
         (*c)->clear();
+
+    backend::program_cache::clear();
+    backend::device_memory_pool::instance().trim(0);
 }
 
 template <bool dummy>
 void cache_register<dummy>::erase(backend::kernel_cache_key key) {
+    detail::lock_guard lock(mx);
     for(auto c = caches.begin(); c != caches.end(); ++c)
         (*c)->erase(key);
+
+    backend::program_cache::erase(key);
+    backend::device_memory_pool::instance().purge(
+            [key](const backend::memory_pool_key &k) {
+                return backend::cache_key(k.queue) == key;
+            });
 }
 
 //---------------------------------------------------------------------------
 // Assign expression to lhs
 //---------------------------------------------------------------------------
+// Checks if expression only consists of SIMD terminals and arithmetic
+// operations.
+template <class Expr, class T,
+          class Tag = typename boost::proto::tag_of<Expr>::type>
+struct simd_expression : std::false_type {};
+
+template <class Term, class T, class Enable = void>
+struct simd_terminal_expression
+    : traits::simd_terminal<
+        typename std::decay<
+            typename boost::proto::result_of::value<Term>::type
+            >::type,
+        T>
+{};
+
+template <class Term, class T>
+struct simd_terminal_expression<Term, T,
+    typename std::enable_if<traits::terminal_is_value<Term>::value>::type
+    > : traits::simd_terminal<Term, T>
+{};
+
+template <class Expr, class T>
+struct simd_expression<Expr, T, boost::proto::tag::terminal>
+    : simd_terminal_expression<Expr, T>
+{};
+
+template <class Expr, int N>
+struct simd_child {
+    typedef typename std::decay<
+        typename boost::proto::result_of::child_c<Expr, N>::type
+        >::type type;
+};
+
+#define VEXCL_SIMD_BINARY_OPERATION(the_tag)                                   \
+  template <class Expr, class T>                                               \
+  struct simd_expression<Expr, T, boost::proto::tag::the_tag>                  \
+      : std::integral_constant<bool,                                           \
+          simd_expression<typename simd_child<Expr, 0>::type, T>::value &&     \
+          simd_expression<typename simd_child<Expr, 1>::type, T>::value>       \
+  {}
+
+#define VEXCL_SIMD_UNARY_OPERATION(the_tag)                                    \
+  template <class Expr, class T>                                               \
+  struct simd_expression<Expr, T, boost::proto::tag::the_tag>                  \
+      : simd_expression<typename simd_child<Expr, 0>::type, T>                 \
+  {}
+
+VEXCL_SIMD_BINARY_OPERATION(plus);
+VEXCL_SIMD_BINARY_OPERATION(minus);
+VEXCL_SIMD_BINARY_OPERATION(multiplies);
+VEXCL_SIMD_BINARY_OPERATION(divides);
+VEXCL_SIMD_UNARY_OPERATION(unary_plus);
+VEXCL_SIMD_UNARY_OPERATION(negate);
+
+#undef VEXCL_SIMD_UNARY_OPERATION
+#undef VEXCL_SIMD_BINARY_OPERATION
+
+// Assignment may be vectorized when lhs is a plain vector of floating point
+// values, and rhs is an arithmetic expression of vectors and scalars.
+template <class OP, class LHS, class RHS,
+          bool = traits::simd_lhs<LHS>::value>
+struct simd_assignment : std::false_type {};
+
 template <class OP, class LHS, class RHS>
-void assign_expression(LHS &lhs, const RHS &rhs,
-        const std::vector<backend::command_queue> &queue,
-        const std::vector<size_t> &part
-        )
-{
-#if (VEXCL_CHECK_SIZES > 0)
-    {
-        get_expression_properties prop;
-        extract_terminals()(boost::proto::as_child(lhs), prop);
-        extract_terminals()(boost::proto::as_child(rhs), prop);
+struct simd_assignment<OP, LHS, RHS, true> : std::integral_constant<bool,
+    (
+        std::is_same<OP, assign::SET>::value ||
+        std::is_same<OP, assign::ADD>::value ||
+        std::is_same<OP, assign::SUB>::value ||
+        std::is_same<OP, assign::MUL>::value ||
+        std::is_same<OP, assign::DIV>::value
+    ) &&
+    simd_expression<
+        typename std::decay<
+            typename boost::proto::result_of::as_child<const RHS>::type
+            >::type,
+        typename traits::simd_lhs<LHS>::value_type
+        >::value
+    >
+{};
 
-        precondition(
-                prop.queue.empty() || prop.queue.size() == queue.size(),
-                "Incompatible queue lists"
-                );
+// Vector width to use for the assignment on the given device (1 means the
+// assignment is not vectorized).
+template <class OP, class LHS, class RHS>
+typename std::enable_if<simd_assignment<OP, LHS, RHS>::value, unsigned>::type
+simd_width(const backend::command_queue &q) {
+#ifdef VEXCL_DISABLE_SIMD
+    return 1;
+#else
+    if (!backend::is_cpu(q)) return 1;
 
-        precondition(
-                prop.size == 0 || prop.size == part.back(),
-                "Incompatible expression sizes"
-                );
-    }
+    unsigned w = backend::preferred_vector_width<
+        typename traits::simd_lhs<LHS>::value_type
+        >(q);
+
+    return (w == 2 || w == 4 || w == 8 || w == 16) ? w : 1;
 #endif
+}
+
+template <class OP, class LHS, class RHS>
+typename std::enable_if<!simd_assignment<OP, LHS, RHS>::value, unsigned>::type
+simd_width(const backend::command_queue&) {
+    return 1;
+}
+
+// Outputs the statement assigning rhs to lhs. prm_name is the name of the
+// kernel parameter holding lhs.
+template <class OP, class LHS>
+typename std::enable_if<!traits::converting_store<LHS>::value>::type
+output_store(backend::source_generator &src, const LHS&,
+        const std::string &lhs, const std::string&/*prm_name*/,
+        const std::string &rhs)
+{
+    src.new_line() << lhs << " " << OP::string() << " " << rhs << ";";
+}
+
+template <class OP, class LHS>
+typename std::enable_if<traits::converting_store<LHS>::value>::type
+output_store(backend::source_generator &src, const LHS&,
+        const std::string&/*lhs*/, const std::string &prm_name,
+        const std::string &rhs)
+{
+    traits::converting_store<LHS>::store(src, prm_name, OP::string(), rhs);
+}
+
+// Returns the kernel that assigns rhs to lhs on the given device. The kernel
+// is specialized for the given values (and for the partition size, when
+// enabled) unless the cache has seen too many variants already.
+template <class OP, class LHS, class RHS>
+backend::kernel& assignment_kernel(const LHS &lhs, const RHS &rhs,
+        const backend::command_queue &q, size_t psize,
+        const std::string &values, const std::string &alias,
+        bool &specialized, bool &fixed_n
+        )
+{
     static kernel_cache cache;
 
-    for(unsigned d = 0; d < queue.size(); d++) {
-        auto key    = backend::cache_key(queue[d]);
-        auto kernel = cache.find(key);
+    fixed_n = psize && jit_specialization<>::sizes();
 
-        backend::select_context(queue[d]);
+    const std::string variant = cache.variant(q,
+            fixed_n ? "n=" + std::to_string(psize) + ";" + values : values);
 
-        if (kernel == cache.end()) {
-            backend::source_generator source(queue[d]);
+    specialized = !variant.empty();
+    fixed_n = fixed_n && specialized;
 
-            output_terminal_preamble termpream(source, queue[d], "prm", empty_state());
+    return cache.get(q, variant + alias, [&]() -> backend::kernel {
+        backend::source_generator source(q);
 
-            boost::proto::eval(boost::proto::as_child(lhs), termpream);
-            boost::proto::eval(boost::proto::as_child(rhs), termpream);
+        output_terminal_preamble termpream(source, q, "prm", variant_state(specialized));
 
-            source.kernel("vexcl_vector_kernel")
-                .open("(")
-                    .parameter<size_t>("n");
+        boost::proto::eval(boost::proto::as_child(lhs), termpream);
+        boost::proto::eval(boost::proto::as_child(rhs), termpream);
+
+        source.kernel("vexcl_vector_kernel").open("(");
 
-            declare_expression_parameter declare(source, queue[d], "prm", empty_state());
+        if (!fixed_n) source.parameter<size_t>("n");
 
-            extract_terminals()(boost::proto::as_child(lhs), declare);
-            extract_terminals()(boost::proto::as_child(rhs), declare);
+        declare_expression_parameter declare(source, q, "prm", variant_state(specialized));
 
-            source.close(")")
-                .open("{")
-                    .grid_stride_loop()
-                    .open("{");
+        extract_terminals()(boost::proto::as_child(lhs), declare);
+        extract_terminals()(boost::proto::as_child(rhs), declare);
 
-            output_local_preamble loc_init(source, queue[d], "prm", empty_state());
+        source.close(")").open("{");
+
+        if (fixed_n)
+            source.new_line() << "const " << type_name<size_t>() << " n = " << psize << ";";
+
+        auto scalar_body = [&]() {
+            output_local_preamble loc_init(source, q, "prm", variant_state(specialized));
             boost::proto::eval(boost::proto::as_child(lhs), loc_init);
             boost::proto::eval(boost::proto::as_child(rhs), loc_init);
 
-            vector_expr_context expr_ctx(source, queue[d], "prm", empty_state());
-
-            source.new_line();
+            backend::source_generator lhs_src;
+            vector_expr_context expr_ctx(lhs_src, q, "prm", variant_state(specialized));
             boost::proto::eval(boost::proto::as_child(lhs), expr_ctx);
-            source << " " << OP::string() << " ";
+
+            std::string rhs_src = eliminate_common_subexpressions(source, rhs, expr_ctx);
+
+            output_store<OP>(source, lhs, lhs_src.str(), "prm_1", rhs_src);
+        };
+
+        const unsigned w = simd_width<OP, LHS, RHS>(q);
+
+        if (w > 1) {
+            // Process w elements at a time with explicit vector loads and
+            // stores, then the remaining elements one by one.
+            typedef typename traits::simd_lhs<LHS>::value_type T;
+
+            auto state = variant_state(specialized);
+            (*state)["simd_width"] = w;
+
+            source.new_line() << type_name<size_t>() << " nv = n / " << w << ";";
+            source.grid_stride_loop("idx", "nv").open("{");
+
+            vector_expr_context expr_ctx(source, q, "prm", state);
+
+            source.new_line() << "vstore" << w << "(";
+
+            if (std::is_same<OP, assign::SET>::value) {
+                // Skip lhs (prm_1).
+                expr_ctx.prm_idx = 1;
+            } else {
+                std::string op = OP::string();
+                boost::proto::eval(boost::proto::as_child(lhs), expr_ctx);
+                source << " " << op.substr(0, op.size() - 1) << " ";
+            }
+
+            source << "(" << type_name<T>() << w << ")(";
             boost::proto::eval(boost::proto::as_child(rhs), expr_ctx);
+            source << "), idx, prm_1);";
+
+            source.close("}");
 
-            source << ";";
+            source.new_line() << "if (" << source.global_id(0) << " == 0)";
+            source.open("{");
+            source.new_line() << "for(" << type_name<size_t>() << " idx = nv * "
+                << w << "; idx < n; ++idx)";
+            source.open("{");
+            scalar_body();
             source.close("}").close("}");
+        } else {
+            source.grid_stride_loop().open("{");
+            scalar_body();
+            source.close("}");
+        }
 
-            backend::kernel krn(queue[d], source.str(), "vexcl_vector_kernel");
+        source.close("}");
 
-            kernel = cache.insert(std::make_pair(key, krn)).first;
-        }
+        return backend::kernel(q, source.str(), "vexcl_vector_kernel");
+    });
+}
 
-        if (size_t psize = part[d + 1] - part[d]) {
-            kernel->second.push_arg(psize);
+template <class LHS, class RHS>
+void check_assignment(const LHS &lhs, const RHS &rhs,
+        const std::vector<backend::command_queue> &queue,
+        const std::vector<size_t> &part
+        )
+{
+#if (VEXCL_CHECK_SIZES > 0)
+    get_expression_properties prop;
+    extract_terminals()(boost::proto::as_child(lhs), prop);
+    extract_terminals()(boost::proto::as_child(rhs), prop);
+
+    precondition(
+            prop.queue.empty() || prop.queue.size() == queue.size(),
+            "Incompatible queue lists"
+            );
+
+    precondition(
+            prop.size == 0 || prop.size == part.back(),
+            "Incompatible expression sizes"
+            );
+#else
+    (void)lhs; (void)rhs; (void)queue; (void)part;
+#endif
+}
+
+// Checks if any terminal of the expression is specialized (see
+// vex::specialize()).
+template <class Expr, class Enable = void>
+struct has_specialized_terminals;
+
+template <class Expr, long N = boost::proto::arity_of<Expr>::value>
+struct has_specialized_children
+    : std::integral_constant<bool,
+        has_specialized_terminals<typename simd_child<Expr, N - 1>::type>::value ||
+        has_specialized_children<Expr, N - 1>::value>
+{};
+
+template <class Expr>
+struct has_specialized_children<Expr, 0> : std::false_type {};
+
+template <class Expr, class Enable>
+struct has_specialized_terminals : has_specialized_children<Expr> {};
+
+template <class Expr>
+struct has_specialized_terminals<Expr,
+    typename std::enable_if<traits::terminal_is_value<Expr>::value>::type
+    > : traits::is_specialized_terminal<Expr>
+{};
+
+template <class Expr>
+struct has_specialized_terminals<Expr,
+    typename std::enable_if<
+        !traits::terminal_is_value<Expr>::value &&
+        std::is_same<
+            typename boost::proto::tag_of<Expr>::type,
+            boost::proto::tag::terminal
+            >::value
+        >::type
+    > : traits::is_specialized_terminal<
+            typename std::decay<
+                typename boost::proto::result_of::value<Expr>::type
+                >::type
+            >
+{};
+
+template <class OP, class LHS, class RHS>
+void assign_expression(LHS &lhs, const RHS &rhs,
+        const std::vector<backend::command_queue> &queue,
+        const std::vector<size_t> &part
+        )
+{
+    check_assignment(lhs, rhs, queue, part);
+
+    typedef typename std::decay<decltype(boost::proto::as_child(lhs))>::type lhs_expr;
+    typedef typename std::decay<decltype(boost::proto::as_child(rhs))>::type rhs_expr;
+
+    // Values the kernel may be specialized for (see vex::specialize()).
+    std::string values;
+    if (has_specialized_terminals<lhs_expr>::value ||
+        has_specialized_terminals<rhs_expr>::value)
+    {
+        get_specialization_key key(values);
+        extract_terminals()(boost::proto::as_child(lhs), key);
+        extract_terminals()(boost::proto::as_child(rhs), key);
+    }
+
+    // Common subexpressions depend on which vectors are the same.
+    const std::string alias = terminal_aliasing::key(rhs);
+
+    load_sample sample(queue, part);
+
+    for(unsigned d = 0; d < queue.size(); d++) {
+        backend::select_context(queue[d]);
 
-            set_expression_argument setarg(kernel->second, d, part[d], empty_state());
+        const size_t psize = part[d + 1] - part[d];
+
+        bool specialized, fixed_n;
+        auto &kernel = assignment_kernel<OP>(lhs, rhs, queue[d], psize,
+                values, alias, specialized, fixed_n);
+
+        if (psize) {
+            kernel.tune(queue[d], psize);
+            if (!fixed_n) kernel.push_arg(psize);
+
+            set_expression_argument setarg(kernel, d, part[d], variant_state(specialized));
 
             extract_terminals()( boost::proto::as_child(lhs), setarg);
             extract_terminals()( boost::proto::as_child(rhs), setarg);
 
-            kernel->second(queue[d]);
+            sample.start(d);
+            kernel(queue[d]);
+            sample.stop(d);
         }
     }
+
+    sample.report();
 }
 
 template <class OP, class LHS, class RHS>
@@ -2321,7 +3341,7 @@ struct preamble_constructor {
     template <size_t I>
     void apply() const {
         boost::proto::eval(subexpression<I>::get(lhs), lhs_ctx);
-        boost::proto::eval(subexpression<I>::get(rhs), rhs_ctx);
+        boost::proto::eval(boost::proto::as_child(subexpression<I>::get(rhs)), rhs_ctx);
     }
 };
 
@@ -2344,7 +3364,7 @@ struct parameter_declarator {
     template <size_t I>
     void apply() const {
         extract_terminals()(subexpression<I>::get(lhs), lhs_ctx);
-        extract_terminals()(subexpression<I>::get(rhs), rhs_ctx);
+        extract_terminals()(boost::proto::as_child(subexpression<I>::get(rhs)), rhs_ctx);
     }
 };
 
@@ -2368,7 +3388,7 @@ struct expression_init {
 
     template <size_t I>
     void apply() const {
-        boost::proto::eval(subexpression<I>::get(rhs), rhs_pre);
+        boost::proto::eval(boost::proto::as_child(subexpression<I>::get(rhs)), rhs_pre);
 
         typedef
             typename return_type<decltype(subexpression<I>::get(lhs))>::type
@@ -2376,7 +3396,7 @@ struct expression_init {
 
         source.new_line() << type_name<RT>() << " buf_" << I + 1 << " = ";
 
-        boost::proto::eval(subexpression<I>::get(rhs), rhs_ctx);
+        boost::proto::eval(boost::proto::as_child(subexpression<I>::get(rhs)), rhs_ctx);
         source << ";";
     }
 };
@@ -2401,9 +3421,22 @@ struct expression_finalize {
     template <size_t I>
     void apply() const {
         boost::proto::eval(subexpression<I>::get(lhs), lhs_pre);
-        source.new_line();
-        boost::proto::eval(subexpression<I>::get(lhs), lhs_ctx);
-        source << " " << OP::string() << " buf_" << I + 1 << ";";
+
+        std::ostringstream prm, buf;
+        prm << "lhs_" << lhs_ctx.prm_idx + 1;
+        buf << "buf_" << I + 1;
+
+        backend::source_generator lhs_src;
+        vector_expr_context ctx(lhs_src, lhs_ctx.queue, "lhs", state);
+        ctx.prm_idx = lhs_ctx.prm_idx;
+        ctx.fun_idx = lhs_ctx.fun_idx;
+
+        boost::proto::eval(subexpression<I>::get(lhs), ctx);
+
+        lhs_ctx.prm_idx = ctx.prm_idx;
+        lhs_ctx.fun_idx = ctx.fun_idx;
+
+        output_store<OP>(source, subexpression<I>::get(lhs), lhs_src.str(), prm.str(), buf.str());
     }
 };
 
@@ -2422,7 +3455,7 @@ struct kernel_arg_setter {
     template <size_t I>
     void apply() const {
         detail::extract_terminals()(subexpression<I>::get(lhs), ctx);
-        detail::extract_terminals()(subexpression<I>::get(rhs), ctx);
+        detail::extract_terminals()(boost::proto::as_child(subexpression<I>::get(rhs)), ctx);
     }
 };
 
@@ -2477,12 +3510,9 @@ void assign_multiexpression( LHS &lhs, const RHS &rhs,
     }
 
     for(unsigned d = 0; d < queue.size(); d++) {
-        auto key    = backend::cache_key(queue[d]);
-        auto kernel = cache.find(key);
-
         backend::select_context(queue[d]);
 
-        if (kernel == cache.end()) {
+        auto &kernel = cache.get(queue[d], [&]() -> backend::kernel {
             backend::source_generator source(queue[d]);
 
             static_for<0, N::value>::loop(
@@ -2505,19 +3535,18 @@ void assign_multiexpression( LHS &lhs, const RHS &rhs,
 
             source.close("}").close("}");
 
-            backend::kernel krn(queue[d], source.str(), "vexcl_multivector_kernel");
-
-            kernel = cache.insert(std::make_pair(key, krn)).first;
-        }
+            return backend::kernel(queue[d], source.str(), "vexcl_multivector_kernel");
+        });
 
         if (size_t psize = part[d + 1] - part[d]) {
-            kernel->second.push_arg(psize);
+            kernel.tune(queue[d], psize);
+            kernel.push_arg(psize);
 
             static_for<0, N::value>::loop(
-                    kernel_arg_setter<LHS, RHS>(lhs, rhs, kernel->second, d, part[d])
+                    kernel_arg_setter<LHS, RHS>(lhs, rhs, kernel, d, part[d])
                     );
 
-            kernel->second(queue[d]);
+            kernel(queue[d]);
         }
     }
 }
@@ -2627,17 +3656,17 @@ BOOST_PP_REPEAT_FROM_TO(1, VEXCL_MAX_ARITY, VEXCL_TIE_VECTORS, ~)
 
 #endif
 
-/// Clears cached OpenCL kernels, allowing to release OpenCL contexts.
+/// Clears cached OpenCL kernels and pooled buffers, allowing to release OpenCL contexts.
 inline void purge_kernel_caches() {
     detail::cache_register<>::clear();
 }
 
-/// Clears cached OpenCL kernels, allowing to release OpenCL contexts.
+/// Clears cached OpenCL kernels and pooled buffers, allowing to release OpenCL contexts.
 inline void purge_kernel_caches(backend::kernel_cache_key key) {
     detail::cache_register<>::erase(key);
 }
 
-/// Clears cached OpenCL kernels, allowing to release OpenCL contexts.
+/// Clears cached OpenCL kernels and pooled buffers, allowing to release OpenCL contexts.
 inline void purge_kernel_caches(const std::vector<backend::command_queue> &queue) {
     for(auto q = queue.begin(); q != queue.end(); ++q)
         detail::cache_register<>::erase( backend::cache_key(*q) );
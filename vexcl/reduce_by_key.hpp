@@ -64,10 +64,7 @@ template <typename T, class Comp>
 backend::kernel offset_calculation(const backend::command_queue &queue) {
     static detail::kernel_cache cache;
 
-    auto cache_key = backend::cache_key(queue);
-    auto kernel    = cache.find(cache_key);
-
-    if (kernel == cache.end()) {
+    return cache.get(queue, [&]() -> backend::kernel {
         backend::source_generator src(queue);
 
         Comp::define(src, "comp");
@@ -94,11 +91,8 @@ backend::kernel offset_calculation(const backend::command_queue &queue) {
         src.close("}");
         src.close("}");
 
-        backend::kernel krn(queue, src.str(), "offset_calculation");
-        kernel = cache.insert(std::make_pair(cache_key, krn)).first;
-    }
-
-    return kernel->second;
+        return backend::kernel(queue, src.str(), "offset_calculation");
+    });
 }
 
 //---------------------------------------------------------------------------
@@ -106,10 +100,7 @@ template <int NT, typename T, class Oper>
 backend::kernel block_scan_by_key(const backend::command_queue &queue) {
     static detail::kernel_cache cache;
 
-    auto cache_key = backend::cache_key(queue);
-    auto kernel    = cache.find(cache_key);
-
-    if (kernel == cache.end()) {
+    return cache.get(queue, [&]() -> backend::kernel {
         backend::source_generator src(queue);
 
         Oper::define(src, "oper");
@@ -178,11 +169,8 @@ backend::kernel block_scan_by_key(const backend::command_queue &queue) {
 
         src.close("}");
 
-        backend::kernel krn(queue, src.str(), "block_scan_by_key");
-        kernel = cache.insert(std::make_pair(cache_key, krn)).first;
-    }
-
-    return kernel->second;
+        return backend::kernel(queue, src.str(), "block_scan_by_key");
+    });
 }
 
 //---------------------------------------------------------------------------
@@ -191,10 +179,7 @@ backend::kernel block_inclusive_scan_by_key(const backend::command_queue &queue)
 {
     static detail::kernel_cache cache;
 
-    auto cache_key = backend::cache_key(queue);
-    auto kernel    = cache.find(cache_key);
-
-    if (kernel == cache.end()) {
+    return cache.get(queue, [&]() -> backend::kernel {
         backend::source_generator src(queue);
 
         Oper::define(src, "oper");
@@ -304,11 +289,8 @@ backend::kernel block_inclusive_scan_by_key(const backend::command_queue &queue)
 
         src.close("}");
 
-        backend::kernel krn(queue, src.str(), "block_inclusive_scan_by_key");
-        kernel = cache.insert(std::make_pair(cache_key, krn)).first;
-    }
-
-    return kernel->second;
+        return backend::kernel(queue, src.str(), "block_inclusive_scan_by_key");
+    });
 }
 
 //---------------------------------------------------------------------------
@@ -316,10 +298,7 @@ template <typename T, class Oper>
 backend::kernel block_sum_by_key(const backend::command_queue &queue) {
     static detail::kernel_cache cache;
 
-    auto cache_key = backend::cache_key(queue);
-    auto kernel    = cache.find(cache_key);
-
-    if (kernel == cache.end()) {
+    return cache.get(queue, [&]() -> backend::kernel {
         backend::source_generator src(queue);
 
         Oper::define(src, "oper");
@@ -352,11 +331,8 @@ backend::kernel block_sum_by_key(const backend::command_queue &queue) {
 
         src.close("}");
 
-        backend::kernel krn(queue, src.str(), "block_sum_by_key");
-        kernel = cache.insert(std::make_pair(cache_key, krn)).first;
-    }
-
-    return kernel->second;
+        return backend::kernel(queue, src.str(), "block_sum_by_key");
+    });
 }
 
 //---------------------------------------------------------------------------
@@ -364,10 +340,7 @@ template <typename K, typename V>
 backend::kernel key_value_mapping(const backend::command_queue &queue) {
     static detail::kernel_cache cache;
 
-    auto cache_key = backend::cache_key(queue);
-    auto kernel    = cache.find(cache_key);
-
-    if (kernel == cache.end()) {
+    return cache.get(queue, [&]() -> backend::kernel {
         backend::source_generator src(queue);
 
         src.kernel("key_value_mapping")
@@ -405,11 +378,8 @@ backend::kernel key_value_mapping(const backend::command_queue &queue) {
 
         src.close("}");
 
-        backend::kernel krn(queue, src.str(), "key_value_mapping");
-        kernel = cache.insert(std::make_pair(cache_key, krn)).first;
-    }
-
-    return kernel->second;
+        return backend::kernel(queue, src.str(), "key_value_mapping");
+    });
 }
 
 struct do_vex_resize {
@@ -462,6 +432,8 @@ int reduce_by_key_sink(
     const auto &queue = fusion::at_c<0>(ikeys).queue_list();
     backend::select_context(queue[0]);
 
+    memory_category cat("reduce_by_key");
+
     const int NT_cpu = 1;
     const int NT_gpu = 256;
     const int NT = is_cpu(queue[0]) ? NT_cpu : NT_gpu;
@@ -37,8 +37,10 @@ THE SOFTWARE.
 #include <sstream>
 #include <numeric>
 #include <limits>
+#include <tuple>
 
 #include <vexcl/operations.hpp>
+#include <vexcl/fusion.hpp>
 
 namespace vex {
 
@@ -164,6 +166,29 @@ class Reductor {
         >::type
 #endif
         operator()(const Expr &expr) const;
+
+        /// Assigns expression to a vector and reduces another expression in the same kernel.
+        /**
+         * The reduced expression may refer to the assigned vector, in which
+         * case the freshly computed values are used without reading them back
+         * from memory:
+         \code
+         double yy = sum.assign_and_reduce(y, a * x + y, y * y);
+         \endcode
+         */
+        template <class LHS, class RHS, class Expr>
+        real assign_and_reduce(LHS &lhs, const RHS &rhs, const Expr &expr) const {
+            return fused_reduce(lhs, rhs, expr)[0];
+        }
+
+        /// Assigns expression to a vector and computes several reductions in the same kernel.
+        template <class LHS, class RHS, class Expr1, class Expr2, class... Expr>
+        std::array<real, 2 + sizeof...(Expr)>
+        assign_and_reduce(LHS &lhs, const RHS &rhs,
+                const Expr1 &expr1, const Expr2 &expr2, const Expr&... expr) const
+        {
+            return fused_reduce(lhs, rhs, expr1, expr2, expr...);
+        }
     private:
         const std::vector<backend::command_queue> &queue;
         std::vector<size_t> idx;
@@ -184,13 +209,393 @@ class Reductor {
 
             assign_subexpressions<I + 1, N, Expr>(result, expr);
         }
+
+        template <class LHS, class RHS, class... Expr>
+        std::array<real, sizeof...(Expr)>
+        fused_reduce(LHS &lhs, const RHS &rhs, const Expr&... expr) const;
+};
+
+/// \cond INTERNAL
+namespace detail {
+
+template <class F>
+void for_each_arg(F&&) {}
+
+template <class F, class Head, class... Tail>
+void for_each_arg(F &&f, const Head &head, const Tail&... tail) {
+    f(head);
+    for_each_arg(std::forward<F>(f), tail...);
+}
+
+// Code generation for the reduced expressions of Reductor::assign_and_reduce().
+// Expressions are numbered from 1 and use "red<k>" prefixes.
+struct reduced_preamble {
+    backend::source_generator &src;
+    const backend::command_queue &queue;
+    kernel_generator_state_ptr state;
+    mutable int k;
+
+    reduced_preamble(backend::source_generator &src,
+            const backend::command_queue &queue, kernel_generator_state_ptr state)
+        : src(src), queue(queue), state(state), k(0) {}
+
+    template <class Expr>
+    void operator()(const Expr &expr) const {
+        output_terminal_preamble ctx(src, queue, prefix(++k), state);
+        boost::proto::eval(boost::proto::as_child(expr), ctx);
+    }
+
+    static std::string prefix(int k) {
+        std::ostringstream s;
+        s << "red" << k;
+        return s.str();
+    }
+};
+
+struct reduced_parameters : reduced_preamble {
+    reduced_parameters(backend::source_generator &src,
+            const backend::command_queue &queue, kernel_generator_state_ptr state)
+        : reduced_preamble(src, queue, state) {}
+
+    template <class Expr>
+    void operator()(const Expr &expr) const {
+        extract_terminals()(boost::proto::as_child(expr),
+                declare_expression_parameter(src, queue, prefix(++k), state));
+    }
+};
+
+struct reduced_increment : reduced_preamble {
+    kernel_generator_state_ptr expr_state;
+
+    reduced_increment(backend::source_generator &src,
+            const backend::command_queue &queue,
+            kernel_generator_state_ptr loc_state,
+            kernel_generator_state_ptr expr_state)
+        : reduced_preamble(src, queue, loc_state), expr_state(expr_state) {}
+
+    template <class Expr>
+    void operator()(const Expr &expr) const {
+        std::string p = prefix(++k);
+
+        output_local_preamble loc_init(src, queue, p, state);
+        boost::proto::eval(boost::proto::as_child(expr), loc_init);
+
+        vector_expr_context expr_ctx(src, queue, p, expr_state);
+        src.new_line() << "mySum" << k << " = reduce_operation" << k << "(mySum" << k << ", ";
+        boost::proto::eval(boost::proto::as_child(expr), expr_ctx);
+        src << ");";
+    }
+};
+
+struct reduced_vectors {
+    std::vector<fused_vector_info> &vec;
+
+    reduced_vectors(std::vector<fused_vector_info> &vec) : vec(vec) {}
+
+    template <class Expr>
+    void operator()(const Expr &expr) const {
+        extract_terminals()(boost::proto::as_child(expr), collect_fused_vectors(vec));
+    }
+};
+
+struct reduced_arguments {
+    backend::kernel &kernel;
+    unsigned d;
+    size_t part_start;
+    kernel_generator_state_ptr state;
+
+    reduced_arguments(backend::kernel &kernel, unsigned d, size_t part_start,
+            kernel_generator_state_ptr state)
+        : kernel(kernel), d(d), part_start(part_start), state(state) {}
+
+    template <class Expr>
+    void operator()(const Expr &expr) const {
+        extract_terminals()(boost::proto::as_child(expr),
+                set_expression_argument(kernel, d, part_start, state));
+    }
+};
+
+struct reduced_properties {
+    get_expression_properties &prop;
+
+    reduced_properties(get_expression_properties &prop) : prop(prop) {}
+
+    template <class Expr>
+    void operator()(const Expr &expr) const {
+        extract_terminals()(boost::proto::as_child(expr), prop);
+    }
+};
+
+// Applies the functor to each component of a multivector expression (or of
+// a tuple of vector expressions).
+template <size_t I, size_t N>
+struct for_each_component {
+    template <class F, class Expr>
+    static void apply(const F &f, const Expr &expr) {
+        f(subexpression<I>::get(expr));
+        for_each_component<I + 1, N>::apply(f, expr);
+    }
+};
+
+template <size_t N>
+struct for_each_component<N, N> {
+    template <class F, class Expr>
+    static void apply(const F&, const Expr&) {}
+};
+
+template <typename real, class RDC>
+struct reduction_result {
+    typedef real type;
 };
 
+template <size_t I, size_t N>
+struct copy_to_tuple {
+    template <class T, class Tuple>
+    static void apply(const std::array<T, N> &a, Tuple &t) {
+        std::get<I>(t) = a[I];
+        copy_to_tuple<I + 1, N>::apply(a, t);
+    }
+};
+
+template <size_t N>
+struct copy_to_tuple<N, N> {
+    template <class T, class Tuple>
+    static void apply(const std::array<T, N>&, Tuple&) {}
+};
+
+// Reduction kind with the type erased, so that reductions of different kinds
+// may share a kernel.
+template <typename real>
+struct reduction_kind {
+    typedef typename std::vector<real>::iterator iterator;
+
+    void (*define)(backend::source_generator&, const std::string&);
+    real (*reduce)(iterator, iterator);
+    real initial;
+
+    template <class RDC>
+    static reduction_kind get() {
+        reduction_kind k = {
+            &RDC::template function<real>::define,
+            &RDC::template reduce<iterator>,
+            RDC::template initial<real>()
+        };
+        return k;
+    }
+};
+
+// Defines reduce_operation<k> device functions, declares mySum<k>
+// accumulators, and opens the loop over the partition.
+template <typename real, size_t N>
+void open_reduction_loop(backend::source_generator &source, bool cpu,
+        const std::array<reduction_kind<real>, N> &kind)
+{
+    source.open("{");
+    source.smem_declaration<real>();
+    source.new_line() << type_name< shared_ptr<real> >() << " sdata = smem;";
+
+    for(size_t k = 1; k <= N; ++k)
+        source.new_line() << type_name<real>() << " mySum" << k << " = ("
+            << type_name<real>() << ")" << kind[k - 1].initial << ";";
+
+    if (cpu) {
+        source.new_line() << "size_t grid_size  = " << source.global_size(0) << ";";
+        source.new_line() << "size_t chunk_size = (n + grid_size - 1) / grid_size;";
+        source.new_line() << "size_t chunk_id   = " << source.global_id(0) << ";";
+        source.new_line() << "size_t start      = min(n, chunk_size * chunk_id);";
+        source.new_line() << "size_t stop       = min(n, chunk_size * (chunk_id + 1));";
+        source.new_line() << "for (size_t idx = start; idx < stop; idx++)";
+        source.open("{");
+    } else {
+        source.new_line() << "size_t tid = " << source.local_id(0) << ";";
+        source.new_line() << "size_t block_size = " << source.local_size(0) << ";";
+        source.grid_stride_loop().open("{");
+    }
+}
+
+// Closes the loop and reduces each accumulator across the workgroup.
+// Partial results are interleaved: g_odata[group * N + k].
+template <typename real>
+void close_reduction_loop(backend::source_generator &source, bool cpu, size_t N) {
+    source.close("}");
+
+    for(size_t k = 1; k <= N; ++k) {
+        if (cpu) {
+            source.new_line() << "g_odata[" << source.group_id(0) << " * " << N
+                << " + " << k - 1 << "] = mySum" << k << ";";
+            continue;
+        }
+
+        source.new_line() << "sdata[tid] = mySum" << k << ";";
+        source.new_line().barrier();
+        for(unsigned bs = 512; bs > 32; bs /= 2) {
+            source.new_line() << "if (block_size >= " << bs * 2 << ")";
+            source.open("{").new_line() << "if (tid < " << bs << ") "
+                "{ sdata[tid] = mySum" << k << " = reduce_operation" << k
+                << "(mySum" << k << ", sdata[tid + " << bs << "]); }";
+            source.new_line().barrier().close("}");
+        }
+        source.new_line() << "if (tid < 32)";
+        source.open("{");
+        source.new_line() << "volatile " << type_name< shared_ptr<real> >() << " smem = sdata;";
+        for(unsigned bs = 32; bs > 0; bs /= 2) {
+            source.new_line() << "if (block_size >= " << 2 * bs << ") "
+                "{ smem[tid] = mySum" << k << " = reduce_operation" << k
+                << "(mySum" << k << ", smem[tid + " << bs << "]); }";
+        }
+        source.close("}");
+        source.new_line() << "if (tid == 0) g_odata[" << source.group_id(0) << " * " << N
+            << " + " << k - 1 << "] = sdata[0];";
+
+        // sdata is reused by the next reduction.
+        source.new_line().barrier();
+    }
+
+    source.close("}");
+}
+
+// Launch configuration of a kernel writing N interleaved partial results
+// per workgroup into a buffer of the given size.
+inline size_t configure_reduction(backend::kernel &kernel,
+        const backend::command_queue &q, size_t n, size_t N, size_t bufsize)
+{
+    const size_t max_groups = bufsize / N;
+    precondition(max_groups > 0, "Too many reductions");
+
+    kernel.tune(q, n, max_groups, backend::is_cpu(q) ? 1 : 0);
+
+    if (kernel.num_groups() > max_groups)
+        kernel.config(max_groups, kernel.workgroup_size());
+
+    return kernel.num_groups();
+}
+
+// Reads interleaved partial results back and finishes the reductions on host.
+template <typename real, size_t N>
+std::array<real, N> reduce_partial_results(
+        const std::array<reduction_kind<real>, N> &kind,
+        const std::vector<backend::command_queue> &queue,
+        const std::vector<size_t> &idx,
+        const std::vector< backend::device_vector<real> > &dbuf,
+        std::vector<real> &hbuf,
+        const std::vector<size_t> &groups
+        )
+{
+    for(unsigned d = 0; d < queue.size(); d++) {
+        if (groups[d])
+            dbuf[d].read(queue[d], 0, groups[d] * N, &hbuf[idx[d]]);
+    }
+
+    for(unsigned d = 0; d < queue.size(); d++)
+        if (groups[d]) queue[d].finish();
+
+    std::array<real, N> result;
+    std::vector<real> partial;
+
+    for(size_t k = 0; k < N; ++k) {
+        partial.assign(1, kind[k].initial);
+
+        for(unsigned d = 0; d < queue.size(); d++)
+            for(size_t g = 0; g < groups[d]; ++g)
+                partial.push_back(hbuf[idx[d] + g * N + k]);
+
+        result[k] = kind[k].reduce(partial.begin(), partial.end());
+    }
+
+    return result;
+}
+
+// Reduces every component of a multivector expression (or of a tuple of
+// vector expressions) in a single kernel.
+template <typename real, size_t N, class Expr>
+std::array<real, N> reduce_components(
+        kernel_cache &cache,
+        const std::array<reduction_kind<real>, N> &kind,
+        const std::vector<backend::command_queue> &queue,
+        const std::vector<size_t> &idx,
+        const std::vector< backend::device_vector<real> > &dbuf,
+        std::vector<real> &hbuf,
+        const Expr &expr
+        )
+{
+    typedef for_each_component<0, N> each;
+
+    get_expression_properties prop;
+    each::apply(reduced_properties(prop), expr);
+
+    std::array<real, N> result;
+
+    if (prop.size == 0) {
+        for(size_t k = 0; k < N; ++k) result[k] = kind[k].initial;
+        return result;
+    }
+
+    if (prop.part.empty())
+        prop.part = vex::partition(prop.size, queue);
+
+    std::vector<size_t> groups(queue.size(), 0);
+
+    for(unsigned d = 0; d < queue.size(); ++d) {
+        backend::select_context(queue[d]);
+
+        auto &kernel = cache.get(queue[d], [&]() -> backend::kernel {
+            backend::source_generator source(queue[d]);
+
+            for(size_t k = 1; k <= N; ++k) {
+                std::ostringstream name;
+                name << "reduce_operation" << k;
+                kind[k - 1].define(source, name.str());
+            }
+
+            each::apply(reduced_preamble(source, queue[d], empty_state()), expr);
+
+            source.kernel("vexcl_multi_reductor_kernel")
+                .open("(").template parameter<size_t>("n");
+
+            each::apply(reduced_parameters(source, queue[d], empty_state()), expr);
+
+            source
+                .template parameter< global_ptr<real> >("g_odata")
+                .template smem_parameter<real>()
+                .close(")");
+
+            const bool cpu = backend::is_cpu(queue[d]);
+
+            open_reduction_loop(source, cpu, kind);
+            each::apply(reduced_increment(source, queue[d], empty_state(), empty_state()), expr);
+            close_reduction_loop<real>(source, cpu, N);
+
+            if (cpu)
+                return backend::kernel(queue[d], source.str(), "vexcl_multi_reductor_kernel");
+            else
+                return backend::kernel(queue[d], source.str(), "vexcl_multi_reductor_kernel", sizeof(real));
+        });
+
+        if (size_t psize = prop.part_size(d)) {
+            groups[d] = configure_reduction(kernel, queue[d], psize, N, idx[d + 1] - idx[d]);
+
+            kernel.push_arg(psize);
+            each::apply(reduced_arguments(kernel, d, prop.part_start(d), empty_state()), expr);
+            kernel.push_arg(dbuf[d]);
+            kernel.set_smem([](size_t wgs){ return wgs * sizeof(real); });
+
+            kernel(queue[d]);
+        }
+    }
+
+    return reduce_partial_results(kind, queue, idx, dbuf, hbuf, groups);
+}
+
+} // namespace detail
+/// \endcond
+
 #ifndef DOXYGEN
 template <typename real, class RDC>
 Reductor<real,RDC>::Reductor(const std::vector<backend::command_queue> &queue)
     : queue(queue)
 {
+    memory_category cat("reductor");
+
     idx.reserve(queue.size() + 1);
     idx.push_back(0);
 
@@ -224,13 +629,16 @@ Reductor<real,RDC>::operator()(const Expr &expr) const {
     if (prop.size && prop.part.empty())
         prop.part = vex::partition(prop.size, queue);
 
-    for(unsigned d = 0; d < queue.size(); ++d) {
-        auto key    = backend::cache_key(queue[d]);
-        auto kernel = cache.find(key);
+    // Common subexpressions depend on which vectors are the same.
+    const std::string alias = terminal_aliasing::key(expr);
 
+    // Number of partial results written by each device.
+    std::vector<size_t> groups(queue.size(), 0);
+
+    for(unsigned d = 0; d < queue.size(); ++d) {
         backend::select_context(queue[d]);
 
-        if (kernel == cache.end()) {
+        auto &kernel = cache.get(queue[d], alias, [&]() -> backend::kernel {
             backend::source_generator source(queue[d]);
 
             typedef typename RDC::template function<real> fun;
@@ -254,9 +662,10 @@ Reductor<real,RDC>::operator()(const Expr &expr) const {
     output_local_preamble loc_init(source, queue[d], "prm", empty_state());    \
     boost::proto::eval(expr, loc_init);                                        \
     vector_expr_context expr_ctx(source, queue[d], "prm", empty_state());      \
-    source.new_line() << "mySum = reduce_operation(mySum, ";                   \
-    boost::proto::eval(expr, expr_ctx);                                        \
-    source << ");";                                                            \
+    std::string expr_src = eliminate_common_subexpressions(                    \
+        source, expr, expr_ctx);                                               \
+    source.new_line() << "mySum = reduce_operation(mySum, "                    \
+                      << expr_src << ");";                                     \
   }
 
             source.open("{");
@@ -277,8 +686,7 @@ Reductor<real,RDC>::operator()(const Expr &expr) const {
                 source.new_line() << "g_odata[" << source.group_id(0) << "] = mySum;";
                 source.close("}");
 
-                backend::kernel krn(queue[d], source.str(), "vexcl_reductor_kernel");
-                kernel = cache.insert(std::make_pair(key, krn)).first;
+                return backend::kernel(queue[d], source.str(), "vexcl_reductor_kernel");
             } else {
                 source.new_line() << "size_t tid = " << source.local_id(0) << ";";
                 source.new_line() << "size_t block_size = " << source.local_size(0) << ";";
@@ -306,33 +714,39 @@ Reductor<real,RDC>::operator()(const Expr &expr) const {
                 source.new_line() << "if (tid == 0) g_odata[" << source.group_id(0) << "] = sdata[0];";
                 source.close("}");
 
-                backend::kernel krn(queue[d], source.str(), "vexcl_reductor_kernel", sizeof(real));
-                kernel = cache.insert(std::make_pair(key, krn)).first;
+                return backend::kernel(queue[d], source.str(), "vexcl_reductor_kernel", sizeof(real));
             }
-        }
+        });
 
 #undef VEXCL_INCREMENT_MY_SUM
 
         if (size_t psize = prop.part_size(d)) {
-            kernel->second.push_arg(psize);
+            // The partial results have to fit into dbuf, and the CPU
+            // variant of the kernel expects single work-item workgroups.
+            kernel.tune(queue[d], psize, idx[d + 1] - idx[d],
+                    backend::is_cpu(queue[d]) ? 1 : 0);
+
+            groups[d] = kernel.num_groups();
+
+            kernel.push_arg(psize);
 
             extract_terminals()(
                     expr,
-                    set_expression_argument(kernel->second, d, prop.part_start(d), empty_state())
+                    set_expression_argument(kernel, d, prop.part_start(d), empty_state())
                     );
 
-            kernel->second.push_arg(dbuf[d]);
-            kernel->second.set_smem([](size_t wgs){ return wgs * sizeof(real); });
+            kernel.push_arg(dbuf[d]);
+            kernel.set_smem([](size_t wgs){ return wgs * sizeof(real); });
 
-            kernel->second(queue[d]);
+            kernel(queue[d]);
         }
     }
 
     std::fill(hbuf.begin(), hbuf.end(), RDC::template initial<real>());
 
     for(unsigned d = 0; d < queue.size(); d++) {
-        if (prop.part_size(d))
-            dbuf[d].read(queue[d], 0, idx[d + 1] - idx[d], &hbuf[idx[d]]);
+        if (groups[d])
+            dbuf[d].read(queue[d], 0, groups[d], &hbuf[idx[d]]);
     }
 
     for(unsigned d = 0; d < queue.size(); d++)
@@ -341,6 +755,139 @@ Reductor<real,RDC>::operator()(const Expr &expr) const {
     return RDC::reduce(hbuf.begin(), hbuf.end());
 }
 
+template <typename real, class RDC> template <class LHS, class RHS, class... Expr>
+std::array<real, sizeof...(Expr)>
+Reductor<real,RDC>::fused_reduce(LHS &lhs, const RHS &rhs, const Expr&... expr) const {
+    using namespace detail;
+
+    const size_t N = sizeof...(Expr);
+
+    static kernel_cache cache;
+
+    const std::vector<size_t> &part = lhs.partition();
+
+    precondition(lhs.nparts() == queue.size(), "Incompatible queue lists");
+
+    // Values of lhs are held in a private variable, and are only loaded
+    // from memory when the assigned expression depends on them.
+    fused_vector_names names;
+    names[&lhs] = "lhs_val";
+
+    bool load = false;
+
+    // Generated code depends on which of the vector terminals refer to lhs.
+    std::string variant;
+    {
+        std::vector<fused_vector_info> vec;
+        extract_terminals()(boost::proto::as_child(rhs), collect_fused_vectors(vec));
+
+        for(auto v = vec.begin(); v != vec.end(); ++v)
+            if (v->ptr == &lhs) load = true;
+
+        for_each_arg(reduced_vectors(vec), expr...);
+
+        for(auto v = vec.begin(); v != vec.end(); ++v)
+            variant += (v->ptr == &lhs ? '1' : '0');
+    }
+
+    auto state = [&]() -> kernel_generator_state_ptr {
+        auto st = empty_state();
+        (*st)["fused_vectors"] = names;
+        return st;
+    };
+
+    std::array<reduction_kind<real>, N> kind;
+    kind.fill(reduction_kind<real>::template get<RDC>());
+
+    std::vector<size_t> groups(queue.size(), 0);
+
+    for(unsigned d = 0; d < queue.size(); ++d) {
+        backend::select_context(queue[d]);
+
+        auto &kernel = cache.get(queue[d], variant, [&]() -> backend::kernel {
+            backend::source_generator source(queue[d]);
+
+            for(size_t k = 1; k <= N; ++k) {
+                std::ostringstream name;
+                name << "reduce_operation" << k;
+                kind[k - 1].define(source, name.str());
+            }
+
+            auto pre = state();
+            {
+                output_terminal_preamble termpream(source, queue[d], "rhs", pre);
+                boost::proto::eval(boost::proto::as_child(rhs), termpream);
+            }
+            for_each_arg(reduced_preamble(source, queue[d], pre), expr...);
+
+            source.kernel("vexcl_assign_reduce_kernel")
+                .open("(")
+                    .template parameter<size_t>("n");
+
+            traits::fused_vector<LHS>::declare(source, "lhs");
+
+            auto decl = state();
+            extract_terminals()(boost::proto::as_child(rhs),
+                    declare_expression_parameter(source, queue[d], "rhs", decl));
+            for_each_arg(reduced_parameters(source, queue[d], decl), expr...);
+
+            source
+                .template parameter< global_ptr<real> >("g_odata")
+                .template smem_parameter<real>()
+                .close(")");
+
+            const bool cpu = backend::is_cpu(queue[d]);
+
+            open_reduction_loop(source, cpu, kind);
+
+            source.new_line() << traits::fused_vector<LHS>::type() << " lhs_val";
+            if (load) source << " = lhs[idx]";
+            source << ";";
+
+            {
+                auto loc = state(), ex = state();
+
+                output_local_preamble loc_init(source, queue[d], "rhs", loc);
+                boost::proto::eval(boost::proto::as_child(rhs), loc_init);
+
+                vector_expr_context expr_ctx(source, queue[d], "rhs", ex);
+                source.new_line() << "lhs_val = ";
+                boost::proto::eval(boost::proto::as_child(rhs), expr_ctx);
+                source << ";";
+                source.new_line() << "lhs[idx] = lhs_val;";
+
+                for_each_arg(reduced_increment(source, queue[d], loc, ex), expr...);
+            }
+
+            close_reduction_loop<real>(source, cpu, N);
+
+            if (cpu)
+                return backend::kernel(queue[d], source.str(), "vexcl_assign_reduce_kernel");
+            else
+                return backend::kernel(queue[d], source.str(), "vexcl_assign_reduce_kernel", sizeof(real));
+        });
+
+        if (size_t psize = part[d + 1] - part[d]) {
+            groups[d] = configure_reduction(kernel, queue[d], psize, N, idx[d + 1] - idx[d]);
+
+            kernel.push_arg(psize);
+            traits::fused_vector<LHS>::set(lhs, kernel, d);
+
+            auto setarg = state();
+            extract_terminals()(boost::proto::as_child(rhs),
+                    set_expression_argument(kernel, d, part[d], setarg));
+            for_each_arg(reduced_arguments(kernel, d, part[d], setarg), expr...);
+
+            kernel.push_arg(dbuf[d]);
+            kernel.set_smem([](size_t wgs){ return wgs * sizeof(real); });
+
+            kernel(queue[d]);
+        }
+    }
+
+    return reduce_partial_results(kind, queue, idx, dbuf, hbuf, groups);
+}
+
 template <typename real, class RDC> template <class Expr>
 typename std::enable_if<
     boost::proto::matches<Expr, multivector_expr_grammar>::value &&
@@ -348,24 +895,46 @@ typename std::enable_if<
     std::array<real, std::result_of<traits::multiex_dimension(Expr)>::type::value>
 >::type
 Reductor<real,RDC>::operator()(const Expr &expr) const {
+    using namespace detail;
+
     const size_t dim = std::result_of<traits::multiex_dimension(Expr)>::type::value;
-    std::array<real, dim> result;
 
+    // All components are reduced in a single kernel unless their partial
+    // results do not fit into the temporary buffers.
+    bool fits = true;
+    for(unsigned d = 0; d < queue.size(); ++d)
+        if (idx[d + 1] - idx[d] < dim) fits = false;
+
+    if (fits) {
+        static kernel_cache cache;
+
+        std::array<reduction_kind<real>, dim> kind;
+        kind.fill(reduction_kind<real>::template get<RDC>());
+
+        return reduce_components(cache, kind, queue, idx, dbuf, hbuf, expr);
+    }
+
+    std::array<real, dim> result;
     assign_subexpressions<0, dim, Expr>(result, expr);
 
     return result;
 }
 #endif
 
-/// Returns a reference to a static instance of vex::Reductor<T,R>
+/// Returns a reference to the instance of vex::Reductor<T,R> owned by the current thread.
 template <typename T, class R>
 const vex::Reductor<T, R>& get_reductor(const std::vector<backend::command_queue> &queue)
 {
-    // We will hold one static reductor per set of queues (or, rather, contexts):
-    static std::map< std::vector<backend::kernel_cache_key>, vex::Reductor<T, R> > cache;
+    // Reductors are not thread-safe, so we will hold one reductor per thread
+    // and per set of queues (or, rather, contexts). The reductors of a thread
+    // are released when it exits.
+    typedef std::vector<backend::kernel_cache_key> key_type;
+    typedef std::map< key_type, vex::Reductor<T, R> > cache_type;
+
+    cache_type &cache = detail::thread_local_instance<cache_type>();
 
     // Extract OpenCL context handles from command queues:
-    std::vector<backend::kernel_cache_key> ctx;
+    key_type ctx;
     ctx.reserve(queue.size());
     for(auto q = queue.begin(); q != queue.end(); ++q)
         ctx.push_back( backend::cache_key(*q) );
@@ -382,6 +951,93 @@ const vex::Reductor<T, R>& get_reductor(const std::vector<backend::command_queue
     return r->second;
 }
 
+/// Several reductions of possibly different kinds computed in a single pass.
+/**
+ * Each expression is reduced with the kind at the same position in the
+ * template parameter list. All expressions are reduced in one kernel, and the
+ * partial results are read back to host at once:
+ \code
+ vex::MultiReductor<double, vex::SUM, vex::MIN, vex::MAX> stats(ctx);
+ std::tuple<double, double, double> s = stats(x * x, x, x);
+ \endcode
+ * The expressions may also be passed as a tuple (e.g. with std::tie()).
+ */
+template <typename real, class... RDC>
+class MultiReductor {
+    public:
+        /// Constructor.
+        MultiReductor(const std::vector<backend::command_queue> &queue
+#ifndef VEXCL_NO_STATIC_CONTEXT_CONSTRUCTORS
+                = current_context().queue()
+#endif
+                ) : queue(queue)
+        {
+            memory_category cat("reductor");
+
+            idx.reserve(queue.size() + 1);
+            idx.push_back(0);
+
+            // Each workgroup writes N partial results.
+            for(auto q = queue.begin(); q != queue.end(); q++) {
+                size_t bufsize = N * backend::kernel::num_workgroups(*q);
+                idx.push_back(idx.back() + bufsize);
+
+                dbuf.push_back(backend::device_vector<real>(*q, bufsize));
+            }
+
+            hbuf.resize(idx.back());
+        }
+
+        /// Computes reductions of the vector expressions.
+        template <class... Expr>
+#ifdef DOXYGEN
+        std::tuple<real...>
+#else
+        typename std::enable_if<
+            sizeof...(Expr) == sizeof...(RDC),
+            std::tuple<typename detail::reduction_result<real, RDC>::type...>
+        >::type
+#endif
+        operator()(const Expr&... expr) const {
+            return (*this)(std::tuple<const Expr&...>(expr...));
+        }
+
+        /// Computes reductions of the tuple of vector expressions.
+        template <class... Expr>
+#ifdef DOXYGEN
+        std::tuple<real...>
+#else
+        std::tuple<typename detail::reduction_result<real, RDC>::type...>
+#endif
+        operator()(const std::tuple<Expr...> &expr) const {
+            static_assert(sizeof...(Expr) == N,
+                    "Number of expressions should match number of reduction kinds");
+
+            using namespace detail;
+
+            static kernel_cache cache;
+
+            std::array<reduction_kind<real>, N> kind = {{
+                reduction_kind<real>::template get<RDC>()...
+            }};
+
+            std::tuple<typename reduction_result<real, RDC>::type...> result;
+            copy_to_tuple<0, N>::apply(
+                    reduce_components(cache, kind, queue, idx, dbuf, hbuf, expr),
+                    result);
+
+            return result;
+        }
+    private:
+        static const size_t N = sizeof...(RDC);
+
+        const std::vector<backend::command_queue> &queue;
+        std::vector<size_t> idx;
+        std::vector< backend::device_vector<real> > dbuf;
+
+        mutable std::vector<real> hbuf;
+};
+
 } // namespace vex
 
 #endif
@@ -67,10 +67,7 @@ backend::kernel block_inclusive_scan(const backend::command_queue &queue)
 {
     static detail::kernel_cache cache;
 
-    auto cache_key = backend::cache_key(queue);
-    auto kernel    = cache.find(cache_key);
-
-    if (kernel == cache.end()) {
+    return cache.get(queue, [&]() -> backend::kernel {
         backend::source_generator src(queue);
 
         Oper::define(src, "oper");
@@ -136,11 +133,8 @@ backend::kernel block_inclusive_scan(const backend::command_queue &queue)
         src.close("}");
         src.close("}");
 
-        backend::kernel krn(queue, src.str(), "block_inclusive_scan");
-        kernel = cache.insert(std::make_pair(cache_key, krn)).first;
-    }
-
-    return kernel->second;
+        return backend::kernel(queue, src.str(), "block_inclusive_scan");
+    });
 }
 
 template <int NT, typename T, typename Oper>
@@ -148,10 +142,7 @@ backend::kernel intra_block_inclusive_scan(const backend::command_queue &queue)
 {
     static detail::kernel_cache cache;
 
-    auto cache_key = backend::cache_key(queue);
-    auto kernel    = cache.find(cache_key);
-
-    if (kernel == cache.end()) {
+    return cache.get(queue, [&]() -> backend::kernel {
         backend::source_generator src(queue);
 
         Oper::define(src, "oper");
@@ -239,11 +230,8 @@ backend::kernel intra_block_inclusive_scan(const backend::command_queue &queue)
         src.close("}");
         src.close("}");
 
-        backend::kernel krn(queue, src.str(), "intra_block_inclusive_scan");
-        kernel = cache.insert(std::make_pair(cache_key, krn)).first;
-    }
-
-    return kernel->second;
+        return backend::kernel(queue, src.str(), "intra_block_inclusive_scan");
+    });
 }
 
 //---------------------------------------------------------------------------
@@ -253,10 +241,7 @@ backend::kernel block_addition(
 {
     static detail::kernel_cache cache;
 
-    auto cache_key = backend::cache_key(queue);
-    auto kernel    = cache.find(cache_key);
-
-    if (kernel == cache.end()) {
+    return cache.get(queue, [&]() -> backend::kernel {
         backend::source_generator src(queue);
 
         Oper::define(src, "oper");
@@ -329,11 +314,8 @@ backend::kernel block_addition(
 
         src.close("}");
 
-        backend::kernel krn(queue, src.str(), "block_addition");
-        kernel = cache.insert(std::make_pair(cache_key, krn)).first;
-    }
-
-    return kernel->second;
+        return backend::kernel(queue, src.str(), "block_addition");
+    });
 }
 
 template <typename T, typename Oper>
@@ -351,6 +333,8 @@ void scan(
             "Wrong output size in inclusive_scan"
             );
 
+    memory_category cat("scan");
+
     backend::select_context(queue);
 
     const int NT_cpu = 1;
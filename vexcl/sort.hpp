@@ -813,10 +813,7 @@ template <int NT, int VT, typename K, typename V, typename Comp>
 backend::kernel& block_sort_kernel(const backend::command_queue &queue) {
     static detail::kernel_cache cache;
 
-    auto cache_key = backend::cache_key(queue);
-    auto kernel    = cache.find(cache_key);
-
-    if (kernel == cache.end()) {
+    return cache.get(queue, [&]() -> backend::kernel {
         backend::source_generator src(queue);
 
         Comp::define(src, "comp");
@@ -950,11 +947,8 @@ backend::kernel& block_sort_kernel(const backend::command_queue &queue) {
 
         src.close("}");
 
-        backend::kernel krn(queue, src.str(), "block_sort");
-        kernel = cache.insert(std::make_pair(cache_key, krn)).first;
-    }
-
-    return kernel->second;
+        return backend::kernel(queue, src.str(), "block_sort");
+    });
 }
 
 //---------------------------------------------------------------------------
@@ -987,10 +981,7 @@ template <int NT, typename T, typename Comp>
 backend::kernel merge_partition_kernel(const backend::command_queue &queue) {
     static detail::kernel_cache cache;
 
-    auto cache_key = backend::cache_key(queue);
-    auto kernel    = cache.find(cache_key);
-
-    if (kernel == cache.end()) {
+    return cache.get(queue, [&]() -> backend::kernel {
         backend::source_generator src(queue);
 
         Comp::define(src, "comp");
@@ -1042,11 +1033,8 @@ backend::kernel merge_partition_kernel(const backend::command_queue &queue) {
 
         src.close("}");
 
-        backend::kernel krn(queue, src.str(), "merge_partition");
-        kernel = cache.insert(std::make_pair(cache_key, krn)).first;
-    }
-
-    return kernel->second;
+        return backend::kernel(queue, src.str(), "merge_partition");
+    });
 }
 
 template <class K, size_t I = 0, class Enable = void>
@@ -1672,10 +1660,7 @@ template <int NT, int VT, typename K, typename V, typename Comp>
 backend::kernel merge_kernel(const backend::command_queue &queue) {
     static detail::kernel_cache cache;
 
-    auto cache_key = backend::cache_key(queue);
-    auto kernel    = cache.find(cache_key);
-
-    if (kernel == cache.end()) {
+    return cache.get(queue, [&]() -> backend::kernel {
         backend::source_generator src(queue);
 
         Comp::define(src, "comp");
@@ -1759,11 +1744,8 @@ backend::kernel merge_kernel(const backend::command_queue &queue) {
 
         src.close("}");
 
-        backend::kernel krn(queue, src.str(), "merge");
-        kernel = cache.insert(std::make_pair(cache_key, krn)).first;
-    }
-
-    return kernel->second;
+        return backend::kernel(queue, src.str(), "merge");
+    });
 }
 
 //---------------------------------------------------------------------------
@@ -2156,6 +2138,8 @@ template <class K, class Comp>
 void sort_sink(K &&keys, Comp comp) {
     namespace fusion = boost::fusion;
 
+    memory_category cat("sort");
+
     const auto &queue = boost::fusion::at_c<0>(keys).queue_list();
 
     for(unsigned d = 0; d < queue.size(); ++d)
@@ -2177,6 +2161,8 @@ template <class K, class V, class Comp>
 void sort_by_key_sink(K &&keys, V &&vals, Comp comp) {
     namespace fusion = boost::fusion;
 
+    memory_category cat("sort");
+
     precondition(
             fusion::at_c<0>(keys).nparts() == fusion::at_c<0>(vals).nparts(),
             "Keys and values span different devices"
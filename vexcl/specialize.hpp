@@ -0,0 +1,187 @@
+#ifndef VEXCL_SPECIALIZE_HPP
+#define VEXCL_SPECIALIZE_HPP
+
+/*
+The MIT License
+
+Copyright (c) 2012-2014 Denis Demidov <dennis.demidov@gmail.com>
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+/**
+ * \file   vexcl/specialize.hpp
+ * \author Denis Demidov <dennis.demidov@gmail.com>
+ * \brief  Scalars baked into generated kernels as compile-time constants.
+ */
+
+#include <string>
+#include <sstream>
+#include <cmath>
+#include <limits>
+#include <type_traits>
+
+#include <vexcl/operations.hpp>
+
+namespace vex {
+
+/// \cond INTERNAL
+template <typename T>
+struct specialized_value {
+    static_assert(std::is_arithmetic<T>::value,
+            "Only arithmetic values may be specialized");
+
+    typedef T value_type;
+
+    T value;
+
+    specialized_value(T value) : value(value) {}
+
+    // Literal representation of the value in the kernel source.
+    std::string literal() const {
+        std::ostringstream s;
+        s.precision(std::numeric_limits<T>::digits10 + 3);
+        s << "(" << type_name<T>() << ")(";
+        print(s, value, std::is_floating_point<T>());
+        s << ")";
+        return s.str();
+    }
+
+    private:
+        // Non-finite values are spelled with the INFINITY and NAN macros,
+        // which are available both in OpenCL C and in CUDA device code.
+        static void print(std::ostream &s, T v, std::true_type) {
+            if (std::isnan(v))
+                s << "NAN";
+            else if (std::isinf(v))
+                s << (v < 0 ? "-INFINITY" : "INFINITY");
+            else
+                s << v;
+        }
+
+        // Integers get suffixes, so that values out of range of int are
+        // valid literals. The most negative value has no literal of its own.
+        static void print(std::ostream &s, T v, std::false_type) {
+            const char *suffix = std::is_unsigned<T>::value
+                ? (sizeof(T) > 4 ? "ul" : "u")
+                : (sizeof(T) > 4 ? "l"  : "");
+
+            if (std::is_signed<T>::value && v == std::numeric_limits<T>::min())
+                s << "(" << +(v + 1) << suffix << " - 1)";
+            else
+                s << +v << suffix;
+        }
+};
+/// \endcond
+
+/// Scalar that is baked into the generated kernel as a compile-time constant.
+/**
+ * One kernel variant is compiled for each distinct value. When a kernel has
+ * seen too many different values (8 by default, see
+ * detail::jit_specialization), the generic kernel that takes the value as an
+ * argument is used for the new ones.
+ \code
+ x = vex::specialize(2.0) * y + z;
+ \endcode
+ */
+template <typename T>
+#ifdef DOXYGEN
+specialized_value<T>
+#else
+inline typename boost::proto::result_of::as_expr<specialized_value<T>, vector_domain>::type const
+#endif
+specialize(const T &value) {
+    return boost::proto::as_expr<vector_domain>(specialized_value<T>(value));
+}
+
+/// Enables or disables specialization of kernels for vector sizes.
+/**
+ * When enabled, partition sizes are baked into the element-wise kernels,
+ * which lets the compiler unroll the loops for small fixed-size vectors. May
+ * also be enabled with VEXCL_SPECIALIZE_SIZES environment variable.
+ */
+inline void specialize_sizes(bool enable = true) {
+    detail::jit_specialization<>::sizes() = enable;
+}
+
+namespace traits {
+
+template <typename T>
+struct is_vector_expr_terminal< specialized_value<T> > : std::true_type {};
+
+template <typename T>
+struct is_multivector_expr_terminal< specialized_value<T> > : std::true_type {};
+
+template <typename T>
+struct is_fusable_terminal< specialized_value<T> > : std::true_type {};
+
+template <typename T>
+struct is_specialized_terminal< specialized_value<T> > : std::true_type {};
+
+template <typename T>
+struct specialization_key< specialized_value<T> > {
+    static void get(std::string &key, const specialized_value<T> &term) {
+        key += term.literal();
+        key += ";";
+    }
+};
+
+template <typename T>
+struct kernel_param_declaration< specialized_value<T> >
+{
+    static void get(backend::source_generator &src,
+            const specialized_value<T>&,
+            const backend::command_queue&, const std::string &prm_name,
+            detail::kernel_generator_state_ptr state)
+    {
+        if (!state->count("specialize")) src.parameter<T>(prm_name);
+    }
+};
+
+template <typename T>
+struct partial_vector_expr< specialized_value<T> >
+{
+    static void get(backend::source_generator &src,
+            const specialized_value<T> &term,
+            const backend::command_queue&, const std::string &prm_name,
+            detail::kernel_generator_state_ptr state)
+    {
+        if (state->count("specialize"))
+            src << term.literal();
+        else
+            src << prm_name;
+    }
+};
+
+template <typename T>
+struct kernel_arg_setter< specialized_value<T> >
+{
+    static void set(const specialized_value<T> &term,
+            backend::kernel &kernel, unsigned/*part*/, size_t/*index_offset*/,
+            detail::kernel_generator_state_ptr state)
+    {
+        if (!state->count("specialize")) kernel.push_arg(term.value);
+    }
+};
+
+} // namespace traits
+
+} // namespace vex;
+
+#endif
@@ -81,6 +81,8 @@ class SpMat {
               mtx(queue.size()), exc(queue.size()),
               nrows(n), ncols(m), nnz(row[n])
         {
+            memory_category cat("spmat");
+
             auto col_part = partition(m, queue);
 
             // Create secondary queues.
@@ -147,12 +149,19 @@ class SpMat {
             }
 
             // Start computing contribution from local part of the matrix.
+            load_sample sample(queue, part);
+
             for(unsigned d = 0; d < queue.size(); d++)
                 if (mtx[d]) {
                     backend::select_context(queue[d]);
+
+                    sample.start(d);
                     mtx[d]->mul_local(x(d), y(d), alpha, append);
+                    sample.stop(d);
                 }
 
+            sample.report();
+
 
             if (rx.size()) {
                 // Meanwhile, get gathered values to host, ...
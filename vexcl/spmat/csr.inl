@@ -143,12 +143,9 @@ struct SpMatCSR : public sparse_matrix {
 
         static kernel_cache cache;
 
-        auto key    = backend::cache_key(queue);
-        auto kernel = cache.find(key);
-
         backend::select_context(queue);
 
-        if (kernel == cache.end()) {
+        auto &kernel = cache.get(queue, [&]() -> backend::kernel {
             backend::source_generator source(queue);
 
             source.kernel("csr_spmv")
@@ -171,19 +168,19 @@ struct SpMatCSR : public sparse_matrix {
             source.new_line() << "out[i] " << OP::string() << " scale * sum;";
             source.close("}").close("}");
 
-            backend::kernel krn(queue, source.str(), "csr_spmv");
-            kernel = cache.insert(std::make_pair(key, krn)).first;
-        }
+            return backend::kernel(queue, source.str(), "csr_spmv");
+        });
 
-        kernel->second.push_arg(n);
-        kernel->second.push_arg(scale);
-        kernel->second.push_arg(part.row);
-        kernel->second.push_arg(part.col);
-        kernel->second.push_arg(part.val);
-        kernel->second.push_arg(in);
-        kernel->second.push_arg(out);
+        kernel.tune(queue, n);
+        kernel.push_arg(n);
+        kernel.push_arg(scale);
+        kernel.push_arg(part.row);
+        kernel.push_arg(part.col);
+        kernel.push_arg(part.val);
+        kernel.push_arg(in);
+        kernel.push_arg(out);
 
-        kernel->second(queue);
+        kernel(queue);
     }
 
     void mul_local(
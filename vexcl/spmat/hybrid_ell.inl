@@ -228,12 +228,9 @@ struct SpMatHELL : public sparse_matrix {
 
         static kernel_cache cache;
 
-        auto key    = backend::cache_key(queue);
-        auto kernel = cache.find(key);
-
         backend::select_context(queue);
 
-        if (kernel == cache.end()) {
+        auto &kernel = cache.get(queue, [&]() -> backend::kernel {
             backend::source_generator source(queue);
 
             source.kernel("hybrid_ell_spmv")
@@ -269,36 +266,36 @@ struct SpMatHELL : public sparse_matrix {
             source.new_line() << "out[i] " << OP::string() << " scale * sum;";
             source.close("}").close("}");
 
-            backend::kernel krn(queue, source.str(), "hybrid_ell_spmv");
-            kernel = cache.insert(std::make_pair(key, krn)).first;
-        }
+            return backend::kernel(queue, source.str(), "hybrid_ell_spmv");
+        });
 
-        kernel->second.push_arg(n);
-        kernel->second.push_arg(scale);
-        kernel->second.push_arg(part.ell.width);
-        kernel->second.push_arg(pitch);
+        kernel.tune(queue, n);
+        kernel.push_arg(n);
+        kernel.push_arg(scale);
+        kernel.push_arg(part.ell.width);
+        kernel.push_arg(pitch);
 
         if (part.ell.width) {
-            kernel->second.push_arg(part.ell.col);
-            kernel->second.push_arg(part.ell.val);
+            kernel.push_arg(part.ell.col);
+            kernel.push_arg(part.ell.val);
         } else {
-            kernel->second.push_arg(static_cast<void*>(0));
-            kernel->second.push_arg(static_cast<void*>(0));
+            kernel.push_arg(static_cast<void*>(0));
+            kernel.push_arg(static_cast<void*>(0));
         }
 
         if (part.csr.nnz) {
-            kernel->second.push_arg(part.csr.row);
-            kernel->second.push_arg(part.csr.col);
-            kernel->second.push_arg(part.csr.val);
+            kernel.push_arg(part.csr.row);
+            kernel.push_arg(part.csr.col);
+            kernel.push_arg(part.csr.val);
         } else {
-            kernel->second.push_arg(static_cast<void*>(0));
-            kernel->second.push_arg(static_cast<void*>(0));
-            kernel->second.push_arg(static_cast<void*>(0));
+            kernel.push_arg(static_cast<void*>(0));
+            kernel.push_arg(static_cast<void*>(0));
+            kernel.push_arg(static_cast<void*>(0));
         }
-        kernel->second.push_arg(in);
-        kernel->second.push_arg(out);
+        kernel.push_arg(in);
+        kernel.push_arg(out);
 
-        kernel->second(queue);
+        kernel(queue);
     }
 
     void mul_local(
@@ -69,6 +69,8 @@ stencil_base<T>::stencil_base(
       dbuf(queue.size()), s(queue.size()),
       lhalo(center), rhalo(width - center - 1)
 {
+    memory_category cat("stencil");
+
     assert(queue.size());
     assert(lhalo >= 0);
     assert(rhalo >= 0);
@@ -296,12 +298,9 @@ const detail::kernel_cache_entry& stencil<T>::slow_conv(const backend::command_q
 
     static kernel_cache cache;
 
-    auto key    = backend::cache_key(queue);
-    auto kernel = cache.find(key);
-
     backend::select_context(queue);
 
-    if (kernel == cache.end()) {
+    return cache.get(queue, [&]() -> backend::kernel {
         backend::source_generator source(queue);
 
         define_read_x<T>(source);
@@ -334,11 +333,8 @@ const detail::kernel_cache_entry& stencil<T>::slow_conv(const backend::command_q
         source.new_line() << "else y[idx] = beta * sum;";
         source.close("}").close("}");
 
-        backend::kernel krn(queue, source.str(), "slow_conv");
-        kernel = cache.insert(std::make_pair(key, krn)).first;
-    }
-
-    return kernel->second;
+        return backend::kernel(queue, source.str(), "slow_conv");
+    });
 }
 
 template <typename T>
@@ -347,12 +343,9 @@ const detail::kernel_cache_entry& stencil<T>::fast_conv(const backend::command_q
 
     static kernel_cache cache;
 
-    auto key    = backend::cache_key(queue);
-    auto kernel = cache.find(key);
-
     backend::select_context(queue);
 
-    if (kernel == cache.end()) {
+    return cache.get(queue, [&]() -> backend::kernel {
         backend::source_generator source(queue);
 
         define_read_x<T>(source);
@@ -402,11 +395,8 @@ const detail::kernel_cache_entry& stencil<T>::fast_conv(const backend::command_q
         source.new_line().barrier();
         source.close("}").close("}");
 
-        backend::kernel krn(queue, source.str(), "fast_conv");
-        kernel = cache.insert(std::make_pair(key, krn)).first;
-    }
-
-    return kernel->second;
+        return backend::kernel(queue, source.str(), "fast_conv");
+    });
 }
 
 template <typename T>
@@ -557,17 +547,13 @@ void StencilOperator<T, width, center, Impl>::apply(
     T beta = append ? 1 : 0;
 
     static kernel_cache cache;
-    static std::map<backend::kernel_cache_key, size_t> lmem;
 
     Base::exchange_halos(x);
 
     for(unsigned d = 0; d < queue.size(); d++) {
         backend::select_context(queue[d]);
 
-        auto key    = backend::cache_key(queue[d]);
-        auto kernel = cache.find(key);
-
-        if (kernel == cache.end()) {
+        auto &kernel = cache.get(queue[d], [&]() -> backend::kernel {
             backend::source_generator source(queue[d]);
 
             define_read_x<T>(source);
@@ -617,33 +603,30 @@ void StencilOperator<T, width, center, Impl>::apply(
             source.new_line().barrier();
             source.close("}").close("}");
 
-            backend::kernel krn(queue[d], source.str(), "convolve",
+            return backend::kernel(queue[d], source.str(), "convolve",
                     [](size_t wgs) { return (width + wgs - 1) * sizeof(T); }
                     );
-            kernel = cache.insert(std::make_pair(key, krn)).first;
-
-            lmem[key] = sizeof(T) * (krn.workgroup_size() + width - 1);
-        }
+        });
 
         if (size_t psize = x.part_size(d)) {
             char has_left  = d > 0;
             char has_right = d + 1 < queue.size();
 
-            kernel->second.push_arg(psize);
-            kernel->second.push_arg(has_left);
-            kernel->second.push_arg(has_right);
-            kernel->second.push_arg(lhalo);
-            kernel->second.push_arg(rhalo);
-            kernel->second.push_arg(x(d));
-            kernel->second.push_arg(dbuf[d]);
-            kernel->second.push_arg(y(d));
-            kernel->second.push_arg(beta);
-            kernel->second.push_arg(alpha);
-
-            size_t smem_bytes = lmem[key];
-            kernel->second.set_smem([smem_bytes](size_t){ return smem_bytes; });
-
-            kernel->second(queue[d]);
+            kernel.push_arg(psize);
+            kernel.push_arg(has_left);
+            kernel.push_arg(has_right);
+            kernel.push_arg(lhalo);
+            kernel.push_arg(rhalo);
+            kernel.push_arg(x(d));
+            kernel.push_arg(dbuf[d]);
+            kernel.push_arg(y(d));
+            kernel.push_arg(beta);
+            kernel.push_arg(alpha);
+
+            size_t smem_bytes = sizeof(T) * (kernel.workgroup_size() + width - 1);
+            kernel.set_smem([smem_bytes](size_t){ return smem_bytes; });
+
+            kernel(queue[d]);
         }
     }
 }
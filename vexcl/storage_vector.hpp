@@ -0,0 +1,443 @@
+#ifndef VEXCL_STORAGE_VECTOR_HPP
+#define VEXCL_STORAGE_VECTOR_HPP
+
+/*
+The MIT License
+
+Copyright (c) 2012-2014 Denis Demidov <dennis.demidov@gmail.com>
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+/**
+ * \file   vexcl/storage_vector.hpp
+ * \author Denis Demidov <dennis.demidov@gmail.com>
+ * \brief  Device vector with reduced precision storage.
+ */
+
+#include <vector>
+#include <string>
+#include <cstring>
+#include <cmath>
+#include <type_traits>
+
+#include <vexcl/operations.hpp>
+#include <vexcl/vector.hpp>
+
+namespace vex {
+
+/// Half precision (16 bit) floating point storage type.
+/**
+ * Only used as the storage type of vex::storage_vector. Values are stored as
+ * raw 16 bit patterns and are converted with vload_half() and vstore_half()
+ * in the generated kernels.
+ */
+struct half_float {};
+
+/// \cond INTERNAL
+
+template <>
+struct type_name_impl<half_float> {
+    static std::string get() { return "half"; }
+};
+
+namespace detail {
+
+// Conversion between single and half precision (round to nearest even).
+inline cl_ushort float_to_half(float f) {
+    cl_uint x;
+    std::memcpy(&x, &f, sizeof(x));
+
+    const cl_uint sign = (x >> 16) & 0x8000;
+    const cl_uint exp  = (x >> 23) & 0xff;
+    cl_uint       man  = x & 0x7fffff;
+
+    // Infinity or NaN.
+    if (exp == 0xff) return static_cast<cl_ushort>(sign | 0x7c00 | (man ? 0x200 : 0));
+
+    const int e = static_cast<int>(exp) - 127 + 15;
+
+    // Overflow.
+    if (e >= 31) return static_cast<cl_ushort>(sign | 0x7c00);
+
+    cl_uint h, rem, mid;
+
+    if (e <= 0) {
+        // Subnormal result (or zero).
+        if (e < -10) return static_cast<cl_ushort>(sign);
+
+        man |= 0x800000;
+
+        const int shift = 14 - e;
+
+        h   = man >> shift;
+        rem = man & ((1u << shift) - 1);
+        mid = 1u << (shift - 1);
+    } else {
+        h   = (static_cast<cl_uint>(e) << 10) | (man >> 13);
+        rem = man & 0x1fff;
+        mid = 0x1000;
+    }
+
+    // Carry into the exponent gives correct result (up to infinity).
+    if (rem > mid || (rem == mid && (h & 1))) ++h;
+
+    return static_cast<cl_ushort>(sign | h);
+}
+
+inline float half_to_float(cl_ushort h) {
+    const cl_uint sign = static_cast<cl_uint>(h & 0x8000) << 16;
+    const cl_uint exp  = (h >> 10) & 0x1f;
+    const cl_uint man  = h & 0x3ff;
+
+    if (exp == 0) {
+        float f = std::ldexp(static_cast<float>(man), -24);
+        return sign ? -f : f;
+    }
+
+    cl_uint x = (exp == 0x1f)
+        ? (sign | 0x7f800000 | (man << 13))
+        : (sign | ((exp + 112) << 23) | (man << 13));
+
+    float f;
+    std::memcpy(&f, &x, sizeof(f));
+    return f;
+}
+
+// Representation of T values stored as S in device memory.
+template <typename T, typename S>
+struct storage_format {
+    static_assert(std::is_arithmetic<S>::value,
+            "Unsupported storage type");
+
+    typedef S type;
+
+    static void declare(backend::source_generator &src, const std::string &prm_name) {
+        src.parameter< global_ptr<S> >(prm_name);
+    }
+
+    static void load(backend::source_generator &src, const std::string &prm_name) {
+        if (std::is_same<T, S>::value)
+            src << prm_name << "[idx]";
+        else
+            src << "((" << type_name<T>() << ")" << prm_name << "[idx])";
+    }
+
+    static void store(backend::source_generator &src, const std::string &prm_name,
+            const std::string &op, const std::string &rhs)
+    {
+        src.new_line() << prm_name << "[idx] " << op << " " << rhs << ";";
+    }
+
+    static S pack(T v) {
+        return static_cast<S>(v);
+    }
+
+    static T unpack(S v) {
+        return static_cast<T>(v);
+    }
+};
+
+template <typename T>
+struct storage_format<T, half_float> {
+#ifdef VEXCL_BACKEND_CUDA
+    static_assert(!std::is_same<T, T>::value,
+            "Half precision storage is only supported by OpenCL backend");
+#endif
+
+    typedef cl_ushort type;
+
+    static void declare(backend::source_generator &src, const std::string &prm_name) {
+        src.parameter< global_ptr<half_float> >(prm_name);
+    }
+
+    static void load(backend::source_generator &src, const std::string &prm_name) {
+        if (std::is_same<T, cl_float>::value)
+            src << "vload_half(idx, " << prm_name << ")";
+        else
+            src << "((" << type_name<T>() << ")vload_half(idx, " << prm_name << "))";
+    }
+
+    static void store(backend::source_generator &src, const std::string &prm_name,
+            const std::string &op, const std::string &rhs)
+    {
+        src.new_line() << "vstore_half(";
+
+        if (op == "=") {
+            src << rhs;
+        } else {
+            load(src, prm_name);
+            src << " " << op.substr(0, op.size() - 1) << " (" << rhs << ")";
+        }
+
+        src << ", idx, " << prm_name << ");";
+    }
+
+    static cl_ushort pack(T v) {
+        return float_to_half(static_cast<float>(v));
+    }
+
+    static T unpack(cl_ushort v) {
+        return static_cast<T>(half_to_float(v));
+    }
+};
+
+} // namespace detail
+
+struct storage_vector_terminal {};
+
+typedef vector_expression<
+    typename boost::proto::terminal< storage_vector_terminal >::type
+    > storage_vector_terminal_expression;
+
+namespace traits {
+
+// Hold storage vector terminals by reference:
+template <class T>
+struct hold_terminal_by_reference< T,
+        typename std::enable_if<
+            boost::proto::matches<
+                typename boost::proto::result_of::as_expr< T >::type,
+                boost::proto::terminal< storage_vector_terminal >
+            >::value
+        >::type
+    >
+    : std::true_type
+{ };
+
+} // namespace traits
+
+/// \endcond
+
+/// Device vector of T values stored with reduced precision S.
+/**
+ * Values are converted to T when read in the generated kernels, and are
+ * converted back to S when stored, so that all computations are done in T,
+ * while memory traffic is reduced. S may be any arithmetic type, or
+ * vex::half_float for 16 bit storage (OpenCL backend only):
+ \code
+ vex::storage_vector<float, vex::half_float> x(ctx, n);
+ vex::vector<float> y(ctx, n);
+
+ x = sin(y);
+ y = 2 * x + 1;
+ \endcode
+ * Storage vectors may be used in any vector expression, and may be assigned
+ * element-wise vector expressions (including the ones done with vex::tie()
+ * and vex::where()). Copies between host and storage vectors convert the
+ * values on the host.
+ */
+template <typename T, typename S>
+class storage_vector : public storage_vector_terminal_expression {
+    public:
+        typedef T value_type;
+
+        /// Type of the elements in device memory.
+        typedef typename detail::storage_format<T, S>::type storage_type;
+
+        /// Empty constructor.
+        storage_vector() {}
+
+        /// Creates vector of the given size.
+        storage_vector(const std::vector<backend::command_queue> &queue, size_t size)
+            : buf(queue, size)
+        {}
+
+        /// Copies (and converts) host data to the new vector.
+        storage_vector(const std::vector<backend::command_queue> &queue,
+                const std::vector<T> &host
+                ) : buf(queue, host.size())
+        {
+            write_data(0, host.size(), host.data());
+        }
+
+#ifndef VEXCL_NO_STATIC_CONTEXT_CONSTRUCTORS
+        /// Creates vector of the given size, uses static context.
+        explicit storage_vector(size_t size) : buf(size) {}
+
+        /// Copies (and converts) host data to the new vector, uses static context.
+        explicit storage_vector(const std::vector<T> &host) : buf(host.size()) {
+            write_data(0, host.size(), host.data());
+        }
+#endif
+
+        /// Copies the stored data (without conversion).
+        const storage_vector& operator=(const storage_vector &v) {
+            if (&v != this) buf = v.buf;
+            return *this;
+        }
+
+#define VEXCL_ASSIGNMENT(cop, op)                                              \
+  template <class Expr>                                                        \
+  typename std::enable_if<                                                     \
+      boost::proto::matches<                                                   \
+          typename boost::proto::result_of::as_expr<Expr>::type,               \
+          vector_expr_grammar>::value,                                         \
+      const storage_vector &>::type operator cop(const Expr & expr) {          \
+    detail::assign_expression<op>(*this, expr, queue_list(), partition());     \
+    return *this;                                                              \
+  }
+
+        VEXCL_ASSIGNMENT(=,   assign::SET)
+        VEXCL_ASSIGNMENT(+=,  assign::ADD)
+        VEXCL_ASSIGNMENT(-=,  assign::SUB)
+        VEXCL_ASSIGNMENT(*=,  assign::MUL)
+        VEXCL_ASSIGNMENT(/=,  assign::DIV)
+
+#undef VEXCL_ASSIGNMENT
+
+        /// Vector size.
+        size_t size() const {
+            return buf.size();
+        }
+
+        /// Number of partitions.
+        size_t nparts() const {
+            return buf.nparts();
+        }
+
+        /// Return reference to vector's queue list.
+        const std::vector<backend::command_queue>& queue_list() const {
+            return buf.queue_list();
+        }
+
+        /// Return reference to vector's partition.
+        const std::vector<size_t>& partition() const {
+            return buf.partition();
+        }
+
+        /// Underlying vector holding the stored values.
+        const vector<storage_type>& storage() const {
+            return buf;
+        }
+
+        /// Underlying vector holding the stored values.
+        vector<storage_type>& storage() {
+            return buf;
+        }
+
+        /// Converts and copies data from host buffer to device(s).
+        void write_data(size_t offset, size_t size, const T *hostptr) {
+            if (!size) return;
+
+            std::vector<storage_type> tmp(size);
+            for(size_t i = 0; i < size; ++i)
+                tmp[i] = detail::storage_format<T, S>::pack(hostptr[i]);
+
+            buf.write_data(offset, size, tmp.data(), true);
+        }
+
+        /// Copies data from device(s) to host buffer and converts it.
+        void read_data(size_t offset, size_t size, T *hostptr) const {
+            if (!size) return;
+
+            std::vector<storage_type> tmp(size);
+            buf.read_data(offset, size, tmp.data(), true);
+
+            for(size_t i = 0; i < size; ++i)
+                hostptr[i] = detail::storage_format<T, S>::unpack(tmp[i]);
+        }
+    private:
+        vector<storage_type> buf;
+};
+
+/// Copy storage vector to host vector.
+template <typename T, typename S>
+void copy(const storage_vector<T, S> &dv, std::vector<T> &hv) {
+    dv.read_data(0, dv.size(), hv.data());
+}
+
+/// Copy host vector to storage vector.
+template <typename T, typename S>
+void copy(const std::vector<T> &hv, storage_vector<T, S> &dv) {
+    dv.write_data(0, dv.size(), hv.data());
+}
+
+/// \cond INTERNAL
+
+namespace traits {
+
+template <>
+struct is_vector_expr_terminal< storage_vector_terminal > : std::true_type {};
+
+template <>
+struct proto_terminal_is_value< storage_vector_terminal > : std::true_type {};
+
+template <typename T, typename S>
+struct kernel_param_declaration< storage_vector<T, S> > {
+    static void get(backend::source_generator &src,
+            const storage_vector<T, S>&,
+            const backend::command_queue&, const std::string &prm_name,
+            detail::kernel_generator_state_ptr)
+    {
+        detail::storage_format<T, S>::declare(src, prm_name);
+    }
+};
+
+template <typename T, typename S>
+struct partial_vector_expr< storage_vector<T, S> > {
+    static void get(backend::source_generator &src,
+            const storage_vector<T, S>&,
+            const backend::command_queue&, const std::string &prm_name,
+            detail::kernel_generator_state_ptr)
+    {
+        detail::storage_format<T, S>::load(src, prm_name);
+    }
+};
+
+template <typename T, typename S>
+struct converting_store< storage_vector<T, S> > : std::true_type {
+    static void store(backend::source_generator &src, const std::string &prm_name,
+            const std::string &op, const std::string &rhs)
+    {
+        detail::storage_format<T, S>::store(src, prm_name, op, rhs);
+    }
+};
+
+template <typename T, typename S>
+struct kernel_arg_setter< storage_vector<T, S> > {
+    static void set(const storage_vector<T, S> &term,
+            backend::kernel &kernel, unsigned device, size_t/*index_offset*/,
+            detail::kernel_generator_state_ptr)
+    {
+        kernel.push_arg(term.storage()(device));
+    }
+};
+
+template <typename T, typename S>
+struct expression_properties< storage_vector<T, S> > {
+    static void get(const storage_vector<T, S> &term,
+            std::vector<backend::command_queue> &queue_list,
+            std::vector<size_t> &partition,
+            size_t &size
+            )
+    {
+        queue_list = term.queue_list();
+        partition  = term.partition();
+        size       = term.size();
+    }
+};
+
+} // namespace traits
+
+/// \endcond
+
+} // namespace vex
+
+#endif
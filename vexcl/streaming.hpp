@@ -0,0 +1,272 @@
+#ifndef VEXCL_STREAMING_HPP
+#define VEXCL_STREAMING_HPP
+
+/*
+The MIT License
+
+Copyright (c) 2012-2014 Denis Demidov <dennis.demidov@gmail.com>
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+
+/**
+ * \file   vexcl/streaming.hpp
+ * \author Denis Demidov <dennis.demidov@gmail.com>
+ * \brief  Out-of-core evaluation of vector expressions.
+ */
+
+#include <vector>
+#include <memory>
+#include <algorithm>
+
+#include <vexcl/vector.hpp>
+
+namespace vex {
+
+/// \cond INTERNAL
+
+namespace detail {
+
+struct host_stream_base {
+    bool in, out;
+
+    host_stream_base(bool in, bool out) : in(in), out(out) {}
+    virtual ~host_stream_base() {}
+
+    virtual void upload(const backend::command_queue &q, unsigned slot,
+            size_t offset, size_t size, backend::event &e) = 0;
+
+    virtual void download(const backend::command_queue &q, unsigned slot,
+            size_t offset, size_t size, backend::event &e) = 0;
+
+    virtual void activate(const backend::command_queue &q, unsigned slot,
+            size_t size) = 0;
+};
+
+template <typename T>
+struct host_stream : public host_stream_base {
+    T *host;
+    std::vector< backend::device_vector<T> > buf;
+    vector<T> vec;
+
+    host_stream(const backend::command_queue &q, T *host,
+            size_t chunk, unsigned depth, bool in, bool out)
+        : host_stream_base(in, out), host(host)
+    {
+        for(unsigned i = 0; i < depth; ++i)
+            buf.push_back(backend::device_vector<T>(q, chunk));
+    }
+
+    void upload(const backend::command_queue &q, unsigned slot,
+            size_t offset, size_t size, backend::event &e)
+    {
+        buf[slot].write(q, 0, size, host + offset, false, &e);
+    }
+
+    void download(const backend::command_queue &q, unsigned slot,
+            size_t offset, size_t size, backend::event &e)
+    {
+        buf[slot].read(q, 0, size, host + offset, false, &e);
+    }
+
+    void activate(const backend::command_queue &q, unsigned slot, size_t size) {
+        vector<T>(q, buf[slot], size).swap(vec);
+    }
+};
+
+} // namespace detail
+
+/// \endcond
+
+/// Out-of-core evaluation of vector expressions.
+/**
+ * Data stays in host memory (which may also be a memory-mapped file) and is
+ * processed by chunks small enough to fit into device memory. Each host array
+ * is registered with input(), output(), or inout(), which return a vector
+ * that holds the current chunk of the array. run() calls the given functor
+ * for each chunk; the functor may contain any vector expressions and
+ * reductions of the chunk vectors:
+ \code
+ vex::stream_executor ex(ctx.queue(0), n);
+
+ const vex::vector<double> &X = ex.input(x.data());
+ vex::vector<double>       &Y = ex.output(y.data());
+
+ vex::Reductor<double, vex::SUM> sum(ex.queue_list());
+
+ double s = 0;
+ ex.run([&]() {
+     Y = sin(X);
+     s += sum(Y);
+ });
+ \endcode
+ * Each array has depth device buffers, so that the upload of the next
+ * chunks and the download of the previous one (done on a separate command
+ * queue) overlap with the computation on the current chunk. The element-wise
+ * kernels are the same for all chunks.
+ *
+ * The chunk vectors are indexed from zero, so vex::element_index() restarts
+ * for each chunk. Use offset() to get the global index:
+ \code
+ ex.run([&]() {
+     Y = sin(vex::element_index(ex.offset()));
+ });
+ \endcode
+ */
+class stream_executor {
+    public:
+        /// Constructor.
+        /**
+         * \param q     Command queue used for computations.
+         * \param size  Size of the host arrays.
+         * \param chunk Number of elements in a chunk.
+         * \param depth Number of chunks in flight (2 for double buffering,
+         *              3 for triple buffering).
+         */
+        stream_executor(const backend::command_queue &q, size_t size,
+                size_t chunk = 1 << 22, unsigned depth = 3)
+            : queue(1, q), tq(backend::duplicate_queue(q)), n(size),
+              chunk(std::max<size_t>(1, std::min(chunk, size))), depth(depth),
+              pos(0)
+        {
+            precondition(depth >= 2, "Streaming depth should be at least 2");
+        }
+
+        ~stream_executor() {
+            // The chunk buffers are released to the memory pool of the
+            // compute queue; transfers interrupted by an exception in run()
+            // should complete first.
+            try {
+                tq.finish();
+            } catch(...) {
+            }
+        }
+
+        /// Registers host array that is read by the computations.
+        template <typename T>
+        const vector<T>& input(const T *host) {
+            return add(const_cast<T*>(host), true, false);
+        }
+
+        /// Registers host array that is written by the computations.
+        template <typename T>
+        vector<T>& output(T *host) {
+            return add(host, false, true);
+        }
+
+        /// Registers host array that is both read and written by the computations.
+        template <typename T>
+        vector<T>& inout(T *host) {
+            return add(host, true, true);
+        }
+
+        /// Position of the current chunk in the host arrays.
+        size_t offset() const {
+            return pos;
+        }
+
+        /// Queue list for creating reductors or auxiliary vectors.
+        const std::vector<backend::command_queue>& queue_list() const {
+            return queue;
+        }
+
+        /// Calls f for each chunk of the registered arrays.
+        template <class Func>
+        void run(Func &&f) {
+            const size_t nchunks = (n + chunk - 1) / chunk;
+
+            // The last transfer to or from each slot. The transfer queue
+            // keeps the order, so the upload to a slot also completes the
+            // download from it.
+            std::vector<backend::event> ready(depth);
+            std::vector<char> pending(depth, false);
+
+            for(size_t i = 0; i + 1 < depth && i < nchunks; ++i)
+                upload(i, ready, pending);
+
+            for(size_t i = 0; i < nchunks; ++i) {
+                // The slot of this upload was downloaded from last.
+                if (i + depth - 1 < nchunks) upload(i + depth - 1, ready, pending);
+
+                unsigned slot = static_cast<unsigned>(i % depth);
+                size_t   size = std::min(chunk, n - i * chunk);
+
+                pos = i * chunk;
+
+                if (pending[slot]) {
+                    ready[slot].wait();
+                    pending[slot] = false;
+                }
+
+                for(auto s = streams.begin(); s != streams.end(); ++s)
+                    (*s)->activate(queue[0], slot, size);
+
+                f();
+                queue[0].finish();
+
+                for(auto s = streams.begin(); s != streams.end(); ++s)
+                    if ((*s)->out) {
+                        (*s)->download(tq, slot, pos, size, ready[slot]);
+                        pending[slot] = true;
+                    }
+            }
+
+            tq.finish();
+            pos = 0;
+        }
+    private:
+        std::vector<backend::command_queue> queue;
+        backend::command_queue tq;
+
+        size_t   n;
+        size_t   chunk;
+        unsigned depth;
+        size_t   pos;
+
+        std::vector< std::unique_ptr<detail::host_stream_base> > streams;
+
+        template <typename T>
+        vector<T>& add(T *host, bool in, bool out) {
+            std::unique_ptr< detail::host_stream<T> > s(new detail::host_stream<T>(
+                        queue[0], host, chunk, depth, in, out));
+
+            vector<T> &v = s->vec;
+            streams.push_back(std::move(s));
+            return v;
+        }
+
+        void upload(size_t i, std::vector<backend::event> &ready,
+                std::vector<char> &pending)
+        {
+            unsigned slot   = static_cast<unsigned>(i % depth);
+            size_t   offset = i * chunk;
+            size_t   size   = std::min(chunk, n - offset);
+
+            for(auto s = streams.begin(); s != streams.end(); ++s)
+                if ((*s)->in) {
+                    (*s)->upload(tq, slot, offset, size, ready[slot]);
+                    pending[slot] = true;
+                }
+        }
+};
+
+} // namespace vex
+
+#endif
@@ -0,0 +1,259 @@
+#ifndef VEXCL_TRANSFER_HPP
+#define VEXCL_TRANSFER_HPP
+
+/*
+The MIT License
+
+Copyright (c) 2012-2014 Denis Demidov <dennis.demidov@gmail.com>
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+
+/**
+ * \file   vexcl/transfer.hpp
+ * \author Denis Demidov <dennis.demidov@gmail.com>
+ * \brief  Asynchronous and pinned host-device transfers.
+ */
+
+#include <vector>
+#include <memory>
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+
+#include <vexcl/backend.hpp>
+#include <vexcl/backend/memory_pool.hpp>
+
+namespace vex {
+
+/// Handle to an asynchronous host-device transfer.
+/**
+ * Returned by vex::copy_async(). The host memory taking part in the transfer
+ * should not be accessed or released until wait() returns.
+ */
+class copy_event {
+    public:
+        /// Blocks until the transfer completes.
+        void wait() const {
+            for(auto e = ev.begin(); e != ev.end(); ++e) e->wait();
+        }
+
+        /// \cond INTERNAL
+        void add(const backend::event &e) {
+            ev.push_back(e);
+        }
+        /// \endcond
+    private:
+        std::vector<backend::event> ev;
+};
+
+/// \cond INTERNAL
+
+namespace detail {
+
+/// Chunked double-buffered transfers through pinned memory.
+/**
+ * Data is copied between the user memory and a pair of page-locked staging
+ * buffers on the host, so that the host side copy of a chunk overlaps with
+ * the device transfer of the previous one. Staging buffers are taken from a
+ * pool and are reused by subsequent transfers. Transfers of all partitions of
+ * a vector are collected in a batch and advanced in turns, so that the
+ * devices are kept busy at the same time.
+ */
+template <bool dummy = true>
+struct staged_transfer {
+    static_assert(dummy, "dummy parameter should be true");
+
+    typedef memory_pool<
+                backend::kernel_cache_key,
+                std::shared_ptr<backend::pinned_buffer>
+                > pool;
+
+    static std::atomic<bool>& enabled() {
+#ifdef _MSC_VER
+#  pragma warning(push)
+#  pragma warning(disable: 4996)
+#endif
+        static std::atomic<bool> on(getenv("VEXCL_PINNED_TRANSFERS") != 0);
+#ifdef _MSC_VER
+#  pragma warning(pop)
+#endif
+        return on;
+    }
+
+    /// Size of a staging buffer in bytes.
+    static size_t chunk_bytes() {
+        return 4 << 20;
+    }
+
+    /// Checks if a blocking transfer of the given size should be staged.
+    static bool use(size_t bytes) {
+        return enabled() && bytes >= chunk_bytes();
+    }
+
+    private:
+        struct slot {
+            typename pool::lease mem;
+            backend::event e;
+            size_t pos, n;
+            bool busy;
+
+            slot() : pos(0), n(0), busy(false) {}
+
+            void acquire(const backend::command_queue &q) {
+                mem = pool::instance().get(backend::cache_key(q), chunk_bytes(),
+                        [&q](size_t bytes) {
+                            return std::make_shared<backend::pinned_buffer>(q, bytes);
+                        });
+            }
+
+            template <typename T>
+            T* data() const {
+                return reinterpret_cast<T*>((*mem)->data());
+            }
+
+            template <typename T>
+            void unload(T *host) {
+                if (!busy) return;
+
+                e.wait();
+                std::copy(data<T>(), data<T>() + n, host + pos);
+                busy = false;
+            }
+        };
+
+    public:
+    template <typename T>
+    class batch {
+        public:
+            /// Adds transfer of host memory to the device buffer.
+            void write(const backend::command_queue &q,
+                    const backend::device_vector<T> &buf,
+                    size_t offset, size_t size, const T *host)
+            {
+                task.push_back(transfer(q, buf, offset, size, host, 0));
+            }
+
+            /// Adds transfer of the device buffer to host memory.
+            void read(const backend::command_queue &q,
+                    const backend::device_vector<T> &buf,
+                    size_t offset, size_t size, T *host)
+            {
+                task.push_back(transfer(q, buf, offset, size, 0, host));
+            }
+
+            /// Performs the transfers and waits for their completion.
+            void finish() {
+                // Enqueue a chunk of each transfer in turn, so that the
+                // transfers to different devices overlap.
+                for(bool active = true; active; ) {
+                    active = false;
+                    for(auto t = task.begin(); t != task.end(); ++t)
+                        if (t->step()) active = true;
+                }
+
+                for(auto t = task.begin(); t != task.end(); ++t) t->finish();
+
+                task.clear();
+            }
+        private:
+            struct transfer {
+                const backend::command_queue     *q;
+                const backend::device_vector<T> *buf;
+                size_t offset, size, pos;
+                const T *src;   // Set for transfers to the device.
+                T       *dst;   // Set for transfers to the host.
+                int     k;
+                slot    s[2];
+
+                transfer(const backend::command_queue &q,
+                        const backend::device_vector<T> &buf,
+                        size_t offset, size_t size, const T *src, T *dst)
+                    : q(&q), buf(&buf), offset(offset), size(size), pos(0),
+                      src(src), dst(dst), k(0)
+                {}
+
+                // Enqueues transfer of the next chunk. Returns false when
+                // all chunks have been enqueued.
+                bool step() {
+                    if (pos >= size) return false;
+
+                    const size_t n = std::min(chunk_bytes() / sizeof(T), size - pos);
+
+                    if (!s[k].mem) s[k].acquire(*q);
+
+                    if (src) {
+                        if (s[k].busy) s[k].e.wait();
+
+                        std::copy(src + pos, src + pos + n, s[k].template data<T>());
+                        buf->write(*q, offset + pos, n, s[k].template data<T>(), false, &s[k].e);
+                    } else {
+                        s[k].pos = pos;
+                        s[k].n   = n;
+
+                        buf->read(*q, offset + pos, n, s[k].template data<T>(), false, &s[k].e);
+
+                        // Unload the previous chunk while the current one
+                        // is in flight.
+                        s[k ^ 1].unload(dst);
+                    }
+
+                    s[k].busy = true;
+
+                    pos += n;
+                    k ^= 1;
+
+                    return true;
+                }
+
+                void finish() {
+                    for(int i = 0; i < 2; ++i) {
+                        if (src) {
+                            if (s[i].busy) s[i].e.wait();
+                            s[i].busy = false;
+                        } else {
+                            s[i].unload(dst);
+                        }
+                    }
+                }
+            };
+
+            std::vector<transfer> task;
+    };
+};
+
+} // namespace detail
+
+/// \endcond
+
+/// Enables or disables staging of large host-device transfers through pinned memory.
+/**
+ * When enabled, blocking transfers of at least 4 MB are split into chunks
+ * that are copied through page-locked host buffers. This is usually faster
+ * on discrete GPUs, but adds an extra host side copy. May also be enabled
+ * with VEXCL_PINNED_TRANSFERS environment variable.
+ */
+inline void pinned_transfers(bool enable = true) {
+    detail::staged_transfer<>::enabled() = enable;
+}
+
+} // namespace vex
+
+#endif
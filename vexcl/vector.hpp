@@ -39,6 +39,10 @@ THE SOFTWARE.
 #include <string>
 #include <type_traits>
 #include <functional>
+#include <algorithm>
+#include <numeric>
+#include <limits>
+#include <atomic>
 
 #include <boost/proto/proto.hpp>
 #include <boost/io/ios_state.hpp>
@@ -47,6 +51,9 @@ THE SOFTWARE.
 #include <vexcl/backend.hpp>
 #include <vexcl/util.hpp>
 #include <vexcl/operations.hpp>
+#include <vexcl/fusion.hpp>
+#include <vexcl/transfer.hpp>
+#include <vexcl/backend/device_weights.hpp>
 #include <vexcl/profiler.hpp>
 #include <vexcl/devlist.hpp>
 
@@ -87,6 +94,8 @@ struct partitioning_scheme {
     typedef std::function< double(const backend::command_queue&) > weight_function;
 
     static void set(weight_function f) {
+        detail::lock_guard lock(mx);
+
         if (!is_set) {
             weight = f;
             is_set = true;
@@ -100,25 +109,113 @@ struct partitioning_scheme {
 
     static std::vector<size_t> get(size_t n, const std::vector<backend::command_queue> &queue);
 
+    /// Forgets device weights, so that they are measured again.
+    static void reset() {
+        {
+            detail::lock_guard lock(mx);
+            device_weight.clear();
+        }
+
+        device_weight_cache<>::invalidate();
+    }
+
+    /// Predicted fraction of time the fastest device is idle.
+    /**
+     * Compares current device weights with the ones measured by
+     * load_balancer. Returns zero if the weights are not known yet.
+     */
+    static double imbalance(const std::vector<backend::command_queue> &queue) {
+        std::vector<double> cur, msr;
+        if (!weights(queue, cur, msr)) return 0;
+
+        double tmin = std::numeric_limits<double>::max(), tmax = 0;
+        for(unsigned d = 0; d < queue.size(); d++) {
+            double t = cur[d] / msr[d];
+            tmin = std::min(tmin, t);
+            tmax = std::max(tmax, t);
+        }
+
+        return 1 - tmin / tmax;
+    }
+
+    /// Replaces device weights with the measured ones.
+    /**
+     * Only done if imbalance exceeds the threshold. Returns true if the
+     * weights were changed.
+     */
+    static bool rebalance(const std::vector<backend::command_queue> &queue, double threshold) {
+        if (imbalance(queue) <= threshold) return false;
+
+        std::vector<double> cur, msr;
+        if (!weights(queue, cur, msr)) return false;
+
+        // Keep the scale of the weights, so that other device sets are
+        // not affected.
+        double scale = std::accumulate(cur.begin(), cur.end(), 0.0)
+                     / std::accumulate(msr.begin(), msr.end(), 0.0);
+
+        detail::lock_guard lock(mx);
+        for(unsigned d = 0; d < queue.size(); d++)
+            device_weight[backend::get_device_id(queue[d])] = scale * msr[d];
+
+        return true;
+    }
+
     private:
         static bool is_set;
+        static bool cached;
         static weight_function weight;
         static std::map<backend::device_id, double> device_weight;
+        static detail::mutex mx;
+
+        static bool weights(const std::vector<backend::command_queue> &queue,
+                std::vector<double> &cur, std::vector<double> &msr)
+        {
+            if (queue.size() < 2 || !load_balancer<>::weights(queue, msr))
+                return false;
+
+            detail::lock_guard lock(mx);
+
+            cur.resize(queue.size());
+            for(unsigned d = 0; d < queue.size(); d++) {
+                auto dw = device_weight.find(backend::get_device_id(queue[d]));
+                if (dw == device_weight.end()) return false;
+                cur[d] = dw->second;
+            }
+
+            return true;
+        }
 };
 
 template <bool dummy>
 bool partitioning_scheme<dummy>::is_set = false;
 
+template <bool dummy>
+bool partitioning_scheme<dummy>::cached = false;
+
 template <bool dummy>
 std::map<backend::device_id, double> partitioning_scheme<dummy>::device_weight;
 
+template <bool dummy>
+detail::mutex partitioning_scheme<dummy>::mx;
+
 template <bool dummy>
 std::vector<size_t> partitioning_scheme<dummy>::get(size_t n,
         const std::vector<backend::command_queue> &queue)
 {
-    if (!is_set) {
-        weight = device_vector_perf;
-        is_set = true;
+    weight_function wfun;
+    bool use_cache;
+    {
+        detail::lock_guard lock(mx);
+
+        if (!is_set) {
+            weight = device_vector_perf;
+            is_set = true;
+            cached = true;
+        }
+
+        wfun      = weight;
+        use_cache = cached;
     }
 
     std::vector<size_t> part;
@@ -132,11 +229,36 @@ std::vector<size_t> partitioning_scheme<dummy>::get(size_t n,
 
         for(auto q = queue.begin(); q != queue.end(); q++) {
             auto dev_id = backend::get_device_id(*q);
-            auto dw = device_weight.find(dev_id);
 
-            double w = (dw == device_weight.end()) ?
-                (device_weight[dev_id] = weight(*q)) :
-                dw->second;
+            double w     = 0;
+            bool   found = false;
+            {
+                detail::lock_guard lock(mx);
+                auto dw = device_weight.find(dev_id);
+                if (dw != device_weight.end()) {
+                    w     = dw->second;
+                    found = true;
+                }
+            }
+
+            // Weight function may itself need to partition vectors, so it is
+            // called without holding the lock. Only the default weights
+            // are stored on disk.
+            if (!found) {
+                if (!use_cache) {
+                    w = wfun(*q);
+                } else {
+                    std::string sig = backend::device_signature(*q);
+
+                    if (!device_weight_cache<>::load(sig, w)) {
+                        w = wfun(*q);
+                        device_weight_cache<>::store(sig, w);
+                    }
+                }
+
+                detail::lock_guard lock(mx);
+                w = device_weight.insert(std::make_pair(dev_id, w)).first->second;
+            }
 
             cumsum.push_back(cumsum.back() + w);
         }
@@ -178,6 +300,53 @@ inline std::vector<size_t> partition(size_t n,
     return partitioning_scheme<>::get(n, queue);
 }
 
+/// Measures device weights again.
+/**
+ * Weights of the default partitioning scheme are stored on disk (see
+ * VEXCL_CACHE_DIR and VEXCL_DEVICE_WEIGHTS_TTL environment variables), so
+ * that they are only measured once. This forgets both in-memory and stored
+ * weights; objects created afterwards are partitioned with newly measured
+ * weights.
+ */
+inline void recompute_device_weights() {
+    partitioning_scheme<>::reset();
+}
+
+/// Enables measurement of device performance from real kernel launches.
+/**
+ * Every 16th large enough multi-device element-wise assignment or sparse
+ * matrix-vector product is timed on each device, and relative device
+ * performance is updated with exponential smoothing. Partitioning is only
+ * changed by rebalance_partitioning(). May also be enabled with
+ * VEXCL_ADAPTIVE_PARTITIONING environment variable.
+ */
+inline void adaptive_partitioning(bool enable = true, double smoothing = 0.25) {
+    load_balancer<>::enable(enable, smoothing);
+}
+
+/// Predicted fraction of time the fastest device of the set is idle.
+/**
+ * Estimated from the measured device performance (see
+ * adaptive_partitioning()) and the current partitioning.
+ */
+inline double load_imbalance(const std::vector<backend::command_queue> &queue) {
+    return partitioning_scheme<>::imbalance(queue);
+}
+
+/// Updates device weights from the measured performance.
+/**
+ * Weights are only updated when load_imbalance() exceeds the threshold.
+ * Objects created afterwards are partitioned with the new weights. Existing
+ * vectors should then be repartitioned with vector::repartition(), and
+ * existing matrices should be recreated. Returns true if the weights were
+ * changed.
+ */
+inline bool rebalance_partitioning(
+        const std::vector<backend::command_queue> &queue, double threshold = 0.05)
+{
+    return partitioning_scheme<>::rebalance(queue, threshold);
+}
+
 /// \cond INTERNAL
 
 //--- Vector Type -----------------------------------------------------------
@@ -204,6 +373,20 @@ struct hold_terminal_by_reference< T,
 
 } // namespace traits
 
+namespace detail {
+
+// Incremented by vector::repartition(), so that the objects that depend on
+// partitioning of vectors (see vex::compile()) may detect the change.
+template <bool dummy = true>
+struct partition_generation {
+    static std::atomic<size_t> value;
+};
+
+template <bool dummy>
+std::atomic<size_t> partition_generation<dummy>::value(0);
+
+} // namespace detail
+
 /// \endcond
 
 /// \defgroup containers Container classes
@@ -353,10 +536,11 @@ class vector : public vector_terminal_expression {
         typedef iterator_type<const vector, const element> const_iterator;
 
         /// Empty constructor.
-        vector() {}
+        vector() : flags(backend::MEM_READ_WRITE), host(0) {}
 
         /// Copy constructor.
-        vector(const vector &v) : queue(v.queue), part(v.part)
+        vector(const vector &v) : queue(v.queue), part(v.part),
+            flags(backend::MEM_READ_WRITE), host(0)
         {
 #ifdef VEXCL_SHOW_COPIES
             std::cout << "Copying vex::vector<" << type_name<T>()
@@ -370,7 +554,8 @@ class vector : public vector_terminal_expression {
         vector(const backend::command_queue &q,
                const backend::device_vector<T> &buffer,
                size_t size = 0
-               ) : queue(1, q), part(2), buf(1, buffer)
+               ) : queue(1, q), part(2), buf(1, buffer),
+                   flags(backend::MEM_READ_WRITE), host(0)
         {
             part[0] = 0;
             part[1] = size ? size : buffer.size();
@@ -380,7 +565,8 @@ class vector : public vector_terminal_expression {
         vector(const std::vector<backend::command_queue> &queue,
                 size_t size, const T *host = 0,
                 backend::mem_flags flags = backend::MEM_READ_WRITE
-              ) : queue(queue), part(vex::partition(size, queue))
+              ) : queue(queue), part(vex::partition(size, queue)),
+                  flags(flags), host(0)
         {
             if (size) allocate_buffers(flags, host);
         }
@@ -389,7 +575,8 @@ class vector : public vector_terminal_expression {
         /// Copy host data to the new buffer, use static context.
         vector(size_t size, const T *host = 0,
                 backend::mem_flags flags = backend::MEM_READ_WRITE
-              ) : queue(current_context().queue()), part(vex::partition(size, queue))
+              ) : queue(current_context().queue()), part(vex::partition(size, queue)),
+                  flags(flags), host(0)
         {
             if (size) allocate_buffers(flags, host);
         }
@@ -399,7 +586,8 @@ class vector : public vector_terminal_expression {
         vector(const std::vector<backend::command_queue> &queue,
                 const std::vector<T> &host,
                 backend::mem_flags flags = backend::MEM_READ_WRITE
-              ) : queue(queue), part(vex::partition(host.size(), queue))
+              ) : queue(queue), part(vex::partition(host.size(), queue)),
+                  flags(flags), host(0)
         {
             if (!host.empty()) allocate_buffers(flags, host.data());
         }
@@ -408,17 +596,27 @@ class vector : public vector_terminal_expression {
         /// Copy host data to the new buffer, use static context.
         vector(const std::vector<T> &host,
                 backend::mem_flags flags = backend::MEM_READ_WRITE
-              ) : queue(current_context().queue()), part(vex::partition(host.size(), queue))
+              ) : queue(current_context().queue()), part(vex::partition(host.size(), queue)),
+                  flags(flags), host(0)
         {
             if (!host.empty()) allocate_buffers(flags, host.data());
         }
 #endif
 
         /// Move constructor
-        vector(vector &&v) noexcept {
+        vector(vector &&v) noexcept : flags(backend::MEM_READ_WRITE), host(0) {
             swap(v);
         }
 
+        ~vector() {
+            // Fused assignments recorded in a fusion scope may still
+            // reference the vector.
+            try {
+                detail::fusion_barrier(*this);
+            } catch(...) {
+            }
+        }
+
         /// Construct new vector from vector expression.
         /**
          * Vector expression should contain at least one vector for the
@@ -435,7 +633,7 @@ class vector : public vector_terminal_expression {
             >::type
 #endif
         >
-        vector(const Expr &expr) {
+        vector(const Expr &expr) : flags(backend::MEM_READ_WRITE), host(0) {
 #ifdef BOOST_NO_CXX11_FUNCTION_TEMPLATE_DEFAULT_ARGS
             static_assert(
                 boost::proto::matches<
@@ -467,10 +665,16 @@ class vector : public vector_terminal_expression {
         }
 
         /// Swap function.
+        /**
+         * Fused assignments recorded in a fusion scope hold on to the buffers
+         * of their vectors, so no flush is needed here.
+         */
         void swap(vector &v) {
             std::swap(queue,   v.queue);
             std::swap(part,    v.part);
             std::swap(buf,     v.buf);
+            std::swap(flags,   v.flags);
+            std::swap(host,    v.host);
         }
 
         /// Resize vector.
@@ -507,6 +711,31 @@ class vector : public vector_terminal_expression {
             vector(size, host, flags).swap(*this);
         }
 
+        /// Moves vector data according to the current partitioning.
+        /**
+         * Should be called for long-lived vectors after
+         * rebalance_partitioning(). The data is copied through host memory.
+         * Memory flags of the vector are preserved; vectors created with
+         * vex::host_view() keep using the same host memory.
+         */
+        void repartition() {
+            if (queue.size() < 2 || vex::partition(size(), queue) == part)
+                return;
+
+            if (host) {
+                // The host memory is the storage of the vector, so its
+                // contents only need to be synchronized.
+                read_data(0, size(), const_cast<T*>(host), true);
+                vector(queue, size(), host, flags).swap(*this);
+            } else {
+                std::vector<T> data(size());
+                read_data(0, size(), data.data(), true);
+                vector(queue, size(), data.data(), flags).swap(*this);
+            }
+
+            ++detail::partition_generation<>::value;
+        }
+
         /// Fills vector with zeros.
         void clear() {
             *this = static_cast<T>(0);
@@ -514,11 +743,13 @@ class vector : public vector_terminal_expression {
 
         /// Return memory buffer located on a given device.
         const backend::device_vector<T>& operator()(unsigned d = 0) const {
+            detail::fusion_barrier(*this);
             return buf[d];
         }
 
         /// Return memory buffer located on a given device.
         backend::device_vector<T>& operator()(unsigned d = 0) {
+            detail::fusion_barrier(*this);
             return buf[d];
         }
 
@@ -544,6 +775,8 @@ class vector : public vector_terminal_expression {
 
         /// Access element.
         const element operator[](size_t index) const {
+            detail::fusion_barrier(*this);
+
             size_t d = std::upper_bound(
                     part.begin(), part.end(), index) - part.begin() - 1;
             return element(queue[d], buf[d], index - part[d]);
@@ -551,6 +784,8 @@ class vector : public vector_terminal_expression {
 
         /// Access element.
         element operator[](size_t index) {
+            detail::fusion_barrier(*this);
+
             unsigned d = static_cast<unsigned>(
                 std::upper_bound(part.begin(), part.end(), index) - part.begin() - 1
                 );
@@ -589,13 +824,14 @@ class vector : public vector_terminal_expression {
 
         const vector& operator=(const vector &x) {
             if (&x != this)
-                detail::assign_expression<assign::SET>(*this, x, queue, part);
+                detail::assign_or_fuse<assign::SET>(*this, x, queue, part);
             return *this;
         }
 
         /// Maps device buffer to host array.
         typename backend::device_vector<T>::mapped_array
         map(unsigned d = 0) {
+            detail::fusion_barrier(*this);
             return buf[d].map(queue[d]);
         }
 
@@ -616,7 +852,7 @@ class vector : public vector_terminal_expression {
           typename boost::proto::result_of::as_expr<Expr>::type,               \
           vector_expr_grammar>::value,                                         \
       const vector &>::type operator cop(const Expr & expr) {                  \
-    detail::assign_expression<op>(*this, expr, queue, part);                   \
+    detail::assign_or_fuse<op>(*this, expr, queue, part);                      \
     return *this;                                                              \
   }
 #endif
@@ -743,19 +979,36 @@ class vector : public vector_terminal_expression {
 #endif
 
         /// Copy data from host buffer to device(s).
-        void write_data(size_t offset, size_t size, const T *hostptr, bool blocking)
+        void write_data(size_t offset, size_t size, const T *hostptr, bool blocking,
+                copy_event *event = 0)
         {
             if (!size) return;
 
+            detail::fusion_barrier(*this);
+
+            bool staged = blocking && detail::staged_transfer<>::use(size * sizeof(T));
+            detail::staged_transfer<>::batch<T> staged_copy;
+
             for(unsigned d = 0; d < queue.size(); d++) {
                 size_t start = std::max(offset,        part[d]);
                 size_t stop  = std::min(offset + size, part[d + 1]);
 
                 if (stop <= start) continue;
 
-                buf[d].write(queue[d], start - part[d], stop - start, hostptr + start - offset);
+                if (staged) {
+                    staged_copy.write(queue[d], buf[d],
+                            start - part[d], stop - start, hostptr + start - offset);
+                    continue;
+                }
+
+                backend::event e;
+                buf[d].write(queue[d], start - part[d], stop - start, hostptr + start - offset,
+                        false, event ? &e : 0);
+                if (event) event->add(e);
             }
 
+            if (staged) staged_copy.finish();
+
             if (blocking)
                 for(size_t d = 0; d < queue.size(); d++) {
                     size_t start = std::max(offset,        part[d]);
@@ -766,19 +1019,36 @@ class vector : public vector_terminal_expression {
         }
 
         /// Copy data from device(s) to host buffer .
-        void read_data(size_t offset, size_t size, T *hostptr, bool blocking) const
+        void read_data(size_t offset, size_t size, T *hostptr, bool blocking,
+                copy_event *event = 0) const
         {
             if (!size) return;
 
+            detail::fusion_barrier(*this);
+
+            bool staged = blocking && detail::staged_transfer<>::use(size * sizeof(T));
+            detail::staged_transfer<>::batch<T> staged_copy;
+
             for(unsigned d = 0; d < queue.size(); d++) {
                 size_t start = std::max(offset,        part[d]);
                 size_t stop  = std::min(offset + size, part[d + 1]);
 
                 if (stop <= start) continue;
 
-                buf[d].read(queue[d], start - part[d], stop - start, hostptr + start - offset);
+                if (staged) {
+                    staged_copy.read(queue[d], buf[d],
+                            start - part[d], stop - start, hostptr + start - offset);
+                    continue;
+                }
+
+                backend::event e;
+                buf[d].read(queue[d], start - part[d], stop - start, hostptr + start - offset,
+                        false, event ? &e : 0);
+                if (event) event->add(e);
             }
 
+            if (staged) staged_copy.finish();
+
             if (blocking)
                 for(unsigned d = 0; d < queue.size(); d++) {
                     size_t start = std::max(offset,        part[d]);
@@ -793,7 +1063,17 @@ class vector : public vector_terminal_expression {
         std::vector<size_t>                      part;
         std::vector< backend::device_vector<T> > buf;
 
+        // Creation flags, and the host memory used as the storage (if any),
+        // needed to reallocate the buffers in repartition().
+        backend::mem_flags                       flags;
+        const T                                 *host;
+
         void allocate_buffers(backend::mem_flags flags, const T *hostptr) {
+            memory_category cat("vector");
+
+            this->flags = flags;
+            this->host  = backend::uses_host_ptr(flags) ? hostptr : 0;
+
             buf.clear();
             buf.reserve(queue.size());
 
@@ -807,6 +1087,8 @@ class vector : public vector_terminal_expression {
 
         template <typename S, size_t N>
         friend class multivector;
+
+        friend struct traits::fused_vector<vector>;
 };
 
 //---------------------------------------------------------------------------
@@ -823,32 +1105,90 @@ struct proto_terminal_is_value< vector_terminal > : std::true_type {};
 template <typename T>
 struct kernel_param_declaration< vector<T> > {
     static void get(backend::source_generator &src,
-            const vector<T>&,
+            const vector<T> &term,
             const backend::command_queue&, const std::string &prm_name,
-            detail::kernel_generator_state_ptr)
+            detail::kernel_generator_state_ptr state)
     {
-        src.parameter< global_ptr<T> >(prm_name);
+        // Fused kernels hold vectors in private variables (see
+        // detail::fused_sequence).
+        if (!detail::fused_vector_name(state, &term))
+            src.parameter< global_ptr<T> >(prm_name);
     }
 };
 
 template <typename T>
 struct partial_vector_expr< vector<T> > {
     static void get(backend::source_generator &src,
-            const vector<T>&,
+            const vector<T> &term,
             const backend::command_queue&, const std::string &prm_name,
-            detail::kernel_generator_state_ptr)
+            detail::kernel_generator_state_ptr state)
     {
-        src << prm_name << "[idx]";
+        if (const std::string *name = detail::fused_vector_name(state, &term)) {
+            src << *name;
+            return;
+        }
+
+        // In vectorized assignments idx enumerates groups of simd_width
+        // elements (see detail::assign_expression()).
+        auto w = state->find("simd_width");
+
+        if (w != state->end())
+            src << "vload" << boost::any_cast<unsigned>(w->second)
+                << "(idx, " << prm_name << ")";
+        else
+            src << prm_name << "[idx]";
     }
 };
 
+template <typename T>
+struct simd_terminal< vector<T>, T > : std::true_type {};
+
+template <typename T>
+struct simd_lhs< vector<T> > : std::is_floating_point<T> {
+    typedef T value_type;
+};
+
 template <typename T>
 struct kernel_arg_setter< vector<T> > {
     static void set(const vector<T> &term,
             backend::kernel &kernel, unsigned device, size_t/*index_offset*/,
-            detail::kernel_generator_state_ptr)
+            detail::kernel_generator_state_ptr state)
     {
-        kernel.push_arg(term(device));
+        if (!detail::fused_vector_name(state, &term))
+            kernel.push_arg(term(device));
+    }
+};
+
+template <typename T>
+struct is_fusable_terminal< vector<T> > : std::true_type {};
+
+template <typename T>
+struct fused_vector< vector<T> > : std::true_type {
+    static std::string type() {
+        return type_name<T>();
+    }
+
+    static void declare(backend::source_generator &src, const std::string &name) {
+        src.parameter< global_ptr<T> >(name);
+    }
+
+    static void set(const vector<T> &v, backend::kernel &kernel, unsigned d) {
+        kernel.push_arg(v(d));
+    }
+
+    // Memory of the vector is identified by its first nonempty buffer.
+    static const void* id(const vector<T> &v) {
+        for(auto b = v.buf.begin(); b != v.buf.end(); ++b)
+            if (b->size()) return reinterpret_cast<const void*>(b->raw());
+        return &v;
+    }
+
+    static std::function<void(backend::kernel&, unsigned)> bind(const vector<T> &v) {
+        std::vector< backend::device_vector<T> > buf = v.buf;
+
+        return [buf](backend::kernel &kernel, unsigned d) {
+            kernel.push_arg(buf[d]);
+        };
     }
 };
 
@@ -893,6 +1233,45 @@ void copy(const T *hv, vex::vector<T> &dv, bool blocking = true) {
     dv.write_data(0, dv.size(), hv, blocking);
 }
 
+/// Asynchronously copy device vector to host vector.
+/**
+ * The host vector should not be accessed until the returned event completes.
+ */
+template <class T>
+copy_event copy_async(const vex::vector<T> &dv, std::vector<T> &hv) {
+    copy_event e;
+    dv.read_data(0, dv.size(), hv.data(), false, &e);
+    return e;
+}
+
+/// Asynchronously copy device vector to host pointer.
+template <class T>
+copy_event copy_async(const vex::vector<T> &dv, T *hv) {
+    copy_event e;
+    dv.read_data(0, dv.size(), hv, false, &e);
+    return e;
+}
+
+/// Asynchronously copy host vector to device vector.
+/**
+ * The host vector should not be modified or released until the returned
+ * event completes.
+ */
+template <class T>
+copy_event copy_async(const std::vector<T> &hv, vex::vector<T> &dv) {
+    copy_event e;
+    dv.write_data(0, dv.size(), hv.data(), false, &e);
+    return e;
+}
+
+/// Asynchronously copy host pointer to device vector.
+template <class T>
+copy_event copy_async(const T *hv, vex::vector<T> &dv) {
+    copy_event e;
+    dv.write_data(0, dv.size(), hv, false, &e);
+    return e;
+}
+
 /// \cond INTERNAL
 
 template<class Iterator, class Enable = void>
@@ -36,7 +36,15 @@ THE SOFTWARE.
 #include <vexcl/devlist.hpp>
 #include <vexcl/constants.hpp>
 #include <vexcl/element_index.hpp>
+#include <vexcl/specialize.hpp>
 #include <vexcl/vector.hpp>
+#include <vexcl/storage_vector.hpp>
+#include <vexcl/host_view.hpp>
+#include <vexcl/file_io.hpp>
+#include <vexcl/streaming.hpp>
+#include <vexcl/fusion.hpp>
+#include <vexcl/compiled.hpp>
+#include <vexcl/where.hpp>
 #include <vexcl/vector_view.hpp>
 #include <vexcl/vector_pointer.hpp>
 #include <vexcl/tagged_terminal.hpp>
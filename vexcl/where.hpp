@@ -0,0 +1,295 @@
+#ifndef VEXCL_WHERE_HPP
+#define VEXCL_WHERE_HPP
+
+/*
+The MIT License
+
+Copyright (c) 2012-2014 Denis Demidov <dennis.demidov@gmail.com>
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+/**
+ * \file   vexcl/where.hpp
+ * \author Denis Demidov <dennis.demidov@gmail.com>
+ * \brief  Masked assignments.
+ */
+
+#include <vector>
+#include <tuple>
+#include <type_traits>
+
+#include <vexcl/operations.hpp>
+#include <vexcl/fusion.hpp>
+
+namespace vex {
+
+/// \cond INTERNAL
+namespace detail {
+
+// Assigns components of rhs to the components of lhs for the elements where
+// the mask holds. Elements of lhs where the mask does not hold are neither
+// read nor written, and rhs is not evaluated for them.
+template <class OP, class Mask, class LHS, class RHS>
+void assign_masked_expression(const Mask &mask, const LHS &lhs, const RHS &rhs,
+        const std::vector<backend::command_queue> &queue,
+        const std::vector<size_t> &part
+        )
+{
+#if (VEXCL_CHECK_SIZES > 0)
+    {
+        get_expression_properties prop;
+        extract_terminals()(boost::proto::as_child(mask), prop);
+        extract_terminals()(subexpression<0>::get(lhs), prop);
+        extract_terminals()(boost::proto::as_child(subexpression<0>::get(rhs)), prop);
+
+        precondition(
+                prop.queue.empty() || prop.queue.size() == queue.size(),
+                "Incompatible queue lists"
+                );
+
+        precondition(
+                prop.size == 0 || prop.size == part.back(),
+                "Incompatible expression sizes"
+                );
+    }
+#endif
+
+    typedef traits::get_dimension<LHS> N;
+
+    static kernel_cache cache;
+
+    fusion_barrier();
+
+    for(unsigned d = 0; d < queue.size(); d++) {
+        backend::select_context(queue[d]);
+
+        auto &kernel = cache.get(queue[d], [&]() -> backend::kernel {
+            backend::source_generator source(queue[d]);
+
+            {
+                output_terminal_preamble termpream(source, queue[d], "msk", empty_state());
+                boost::proto::eval(boost::proto::as_child(mask), termpream);
+            }
+
+            static_for<0, N::value>::loop(
+                    preamble_constructor<LHS, RHS>(lhs, rhs, source, queue[d])
+                    );
+
+            source.kernel("vexcl_masked_kernel")
+                .open("(")
+                    .parameter<size_t>("n");
+
+            {
+                declare_expression_parameter declare(source, queue[d], "msk", empty_state());
+                extract_terminals()(boost::proto::as_child(mask), declare);
+            }
+
+            static_for<0, N::value>::loop(
+                    parameter_declarator<LHS, RHS>(lhs, rhs, source, queue[d])
+                    );
+
+            source.close(")").open("{")
+                .grid_stride_loop().open("{");
+
+            {
+                output_local_preamble loc_init(source, queue[d], "msk", empty_state());
+                boost::proto::eval(boost::proto::as_child(mask), loc_init);
+
+                vector_expr_context expr_ctx(source, queue[d], "msk", empty_state());
+
+                source.new_line() << "if (";
+                boost::proto::eval(boost::proto::as_child(mask), expr_ctx);
+                source << ")";
+            }
+
+            source.open("{");
+
+            static_for<0, N::value>::loop(expression_init<LHS, RHS>(lhs, rhs, source, queue[d]));
+            static_for<0, N::value>::loop(expression_finalize<OP, LHS>(lhs, source, queue[d]));
+
+            source.close("}").close("}").close("}");
+
+            return backend::kernel(queue[d], source.str(), "vexcl_masked_kernel");
+        });
+
+        if (size_t psize = part[d + 1] - part[d]) {
+            kernel.tune(queue[d], psize);
+            kernel.push_arg(psize);
+
+            set_expression_argument setarg(kernel, d, part[d], empty_state());
+            extract_terminals()(boost::proto::as_child(mask), setarg);
+
+            static_for<0, N::value>::loop(
+                    kernel_arg_setter<LHS, RHS>(lhs, rhs, kernel, d, part[d])
+                    );
+
+            kernel(queue[d]);
+        }
+    }
+}
+
+template <class OP, class Mask, class LHS, class RHS>
+void assign_masked_expression(const Mask &mask, const LHS &lhs, const RHS &rhs) {
+    get_expression_properties prop;
+    extract_terminals()(subexpression<0>::get(lhs), prop);
+
+    precondition(!prop.queue.empty() && !prop.part.empty(),
+            "Can not determine expression size and queue list"
+            );
+
+    assign_masked_expression<OP>(mask, lhs, rhs, prop.queue, prop.part);
+}
+
+} // namespace detail
+
+/// Vector expression assigned only where the mask holds.
+template <class Mask, class LHS>
+struct masked_expression {
+    typename std::conditional<
+        traits::hold_terminal_by_reference<Mask>::value, const Mask&, const Mask
+        >::type mask;
+
+    typename std::conditional<
+        traits::hold_terminal_by_reference<LHS>::value, const LHS&, const LHS
+        >::type lhs;
+
+    masked_expression(const Mask &mask, const LHS &lhs) : mask(mask), lhs(lhs) {}
+
+#define VEXCL_ASSIGNMENT(cop, op)                                              \
+  template <class RHS>                                                         \
+  typename std::enable_if<                                                     \
+      boost::proto::matches<                                                   \
+          typename boost::proto::result_of::as_expr<RHS>::type,                \
+          vector_expr_grammar>::value,                                         \
+      const masked_expression &>::type operator cop(const RHS & rhs) const {   \
+    detail::assign_masked_expression<op>(mask, std::tie(lhs), std::tie(rhs));  \
+    return *this;                                                              \
+  }
+
+    VEXCL_ASSIGNMENT(=,   assign::SET)
+    VEXCL_ASSIGNMENT(+=,  assign::ADD)
+    VEXCL_ASSIGNMENT(-=,  assign::SUB)
+    VEXCL_ASSIGNMENT(*=,  assign::MUL)
+    VEXCL_ASSIGNMENT(/=,  assign::DIV)
+    VEXCL_ASSIGNMENT(%=,  assign::MOD)
+    VEXCL_ASSIGNMENT(&=,  assign::AND)
+    VEXCL_ASSIGNMENT(|=,  assign::OR)
+    VEXCL_ASSIGNMENT(^=,  assign::XOR)
+    VEXCL_ASSIGNMENT(<<=, assign::LSH)
+    VEXCL_ASSIGNMENT(>>=, assign::RSH)
+
+#undef VEXCL_ASSIGNMENT
+};
+
+/// Tuple of vector expressions assigned only where the mask holds.
+template <class Mask, class LHS>
+struct masked_expression_tuple {
+    typename std::conditional<
+        traits::hold_terminal_by_reference<Mask>::value, const Mask&, const Mask
+        >::type mask;
+
+    const LHS lhs;
+
+    masked_expression_tuple(const Mask &mask, const LHS &lhs) : mask(mask), lhs(lhs) {}
+
+#define VEXCL_ASSIGNMENT(cop, op)                                              \
+  template <class RHS>                                                         \
+  typename std::enable_if<                                                     \
+      boost::proto::matches<                                                   \
+          typename boost::proto::result_of::as_expr<RHS>::type,                \
+          multivector_expr_grammar>::value || is_tuple<RHS>::value,            \
+      const masked_expression_tuple &>::type                                   \
+  operator cop(const RHS & rhs) const {                                        \
+    detail::assign_masked_expression<op>(mask, lhs, rhs);                      \
+    return *this;                                                              \
+  }
+
+    VEXCL_ASSIGNMENT(=,   assign::SET)
+    VEXCL_ASSIGNMENT(+=,  assign::ADD)
+    VEXCL_ASSIGNMENT(-=,  assign::SUB)
+    VEXCL_ASSIGNMENT(*=,  assign::MUL)
+    VEXCL_ASSIGNMENT(/=,  assign::DIV)
+    VEXCL_ASSIGNMENT(%=,  assign::MOD)
+    VEXCL_ASSIGNMENT(&=,  assign::AND)
+    VEXCL_ASSIGNMENT(|=,  assign::OR)
+    VEXCL_ASSIGNMENT(^=,  assign::XOR)
+    VEXCL_ASSIGNMENT(<<=, assign::LSH)
+    VEXCL_ASSIGNMENT(>>=, assign::RSH)
+
+#undef VEXCL_ASSIGNMENT
+};
+/// \endcond
+
+/// Masked assignment.
+/**
+ * The returned object may be assigned a vector expression. The generated
+ * kernel evaluates the expression and stores the result only for the
+ * elements where the mask holds; the rest of the elements are neither read
+ * nor written:
+ \code
+ vex::where(x > 0, y) = sqrt(x);   // y[i] = sqrt(x[i]) if x[i] > 0
+ \endcode
+ */
+template <class Mask, class LHS>
+#ifdef DOXYGEN
+masked_expression<Mask, LHS>
+#else
+typename std::enable_if<
+    boost::proto::matches<
+        typename boost::proto::result_of::as_expr<Mask>::type,
+        vector_expr_grammar
+    >::value &&
+    boost::proto::matches<
+        typename boost::proto::result_of::as_expr<LHS>::type,
+        vector_expr_grammar
+    >::value,
+    masked_expression<Mask, LHS>
+>::type
+#endif
+where(const Mask &mask, const LHS &lhs) {
+    return masked_expression<Mask, LHS>(mask, lhs);
+}
+
+/// Masked assignment to several vectors at once.
+/**
+ * Assignments to all vectors in the tuple are done in a single kernel:
+ \code
+ vex::where(x > 0, vex::tie(y, z)) = std::make_tuple(sqrt(x), log(x));
+ \endcode
+ */
+template <class Mask, class LHS>
+#ifdef DOXYGEN
+masked_expression_tuple<Mask, LHS>
+#else
+typename std::enable_if<
+    boost::proto::matches<
+        typename boost::proto::result_of::as_expr<Mask>::type,
+        vector_expr_grammar
+    >::value,
+    masked_expression_tuple<Mask, LHS>
+>::type
+#endif
+where(const Mask &mask, const expression_tuple<LHS> &lhs) {
+    return masked_expression_tuple<Mask, LHS>(mask, lhs.lhs);
+}
+
+} // namespace vex
+
+#endif